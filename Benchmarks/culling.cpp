@@ -0,0 +1,79 @@
+// Compares frustum culling through a BoxHierarchy with testing every box,
+// for grids of unit boxes seen from a camera that sees a corner of the grid.
+
+#include <Innovator/Bounds.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+template <typename Function>
+double milliseconds_per_frame(size_t frames, Function function)
+{
+  const auto start = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < frames; i++) {
+    function();
+  }
+  const auto stop = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(stop - start).count() / frames;
+}
+
+int main(int, char **)
+{
+  const glm::dmat4 view = glm::lookAt(glm::dvec3(-10.0, -10.0, -10.0),
+                                      glm::dvec3(0.0, 0.0, 0.0),
+                                      glm::dvec3(0.0, 1.0, 0.0));
+  const glm::dmat4 projection = glm::perspective(0.7, 4.0 / 3.0, 0.1, 100.0);
+  const Frustum frustum(projection * view);
+
+  std::cout << std::setw(10) << "boxes"
+            << std::setw(10) << "visible"
+            << std::setw(16) << "linear (ms)"
+            << std::setw(16) << "hierarchy (ms)" << std::endl;
+
+  for (size_t side : { 10, 22, 47, 100 }) {
+    // boxes in row order, the order a scene would list them in
+    std::vector<Box3> boxes;
+    for (size_t z = 0; z < side; z++) {
+      for (size_t y = 0; y < side; y++) {
+        for (size_t x = 0; x < side; x++) {
+          Box3 box;
+          box.extend(glm::vec3(x, y, z) * 2.0f);
+          box.extend(glm::vec3(x, y, z) * 2.0f + 1.0f);
+          boxes.push_back(box);
+        }
+      }
+    }
+    const BoxHierarchy hierarchy(boxes);
+    const size_t frames = std::max<size_t>(10, 10000000 / boxes.size());
+
+    size_t visible = 0;
+    const double linear = milliseconds_per_frame(frames, [&]() {
+      visible = 0;
+      for (auto & box : boxes) {
+        visible += frustum.intersects(box) ? 1 : 0;
+      }
+    });
+
+    size_t hierarchy_visible = 0;
+    const double culled = milliseconds_per_frame(frames, [&]() {
+      hierarchy_visible = 0;
+      hierarchy.cull(frustum, [&](uint32_t) { hierarchy_visible++; });
+    });
+
+    if (visible != hierarchy_visible) {
+      std::cerr << "hierarchy visited " << hierarchy_visible
+                << " boxes, expected " << visible << std::endl;
+      return 1;
+    }
+
+    std::cout << std::setw(10) << boxes.size()
+              << std::setw(10) << visible
+              << std::setw(16) << linear
+              << std::setw(16) << culled << std::endl;
+  }
+  return 0;
+}
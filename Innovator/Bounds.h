@@ -0,0 +1,285 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define INNOVATOR_SSE
+#include <xmmintrin.h>
+#endif
+
+// Axis-aligned bounding box. A default constructed box is empty.
+struct Box3 {
+  glm::vec3 lower{ std::numeric_limits<float>::max() };
+  glm::vec3 upper{ std::numeric_limits<float>::lowest() };
+
+  // a box that is never culled, for subtrees without any known bounds
+  static Box3 unbounded()
+  {
+    Box3 box;
+    box.lower = glm::vec3(-1e30f);
+    box.upper = glm::vec3(1e30f);
+    return box;
+  }
+
+  bool empty() const
+  {
+    return this->lower.x > this->upper.x ||
+           this->lower.y > this->upper.y ||
+           this->lower.z > this->upper.z;
+  }
+
+  void extend(const glm::vec3 & point)
+  {
+    this->lower = glm::min(this->lower, point);
+    this->upper = glm::max(this->upper, point);
+  }
+
+  void extend(const Box3 & box)
+  {
+    this->lower = glm::min(this->lower, box.lower);
+    this->upper = glm::max(this->upper, box.upper);
+  }
+
+  glm::vec3 center() const
+  {
+    return (this->lower + this->upper) * 0.5f;
+  }
+
+  glm::vec3 extent() const
+  {
+    return (this->upper - this->lower) * 0.5f;
+  }
+
+  // bounds of this box after transformation (J. Arvo, Graphics Gems 1990)
+  Box3 transform(const glm::dmat4 & matrix) const
+  {
+    if (this->empty()) {
+      return *this;
+    }
+    const glm::mat4 m(matrix);
+    Box3 box;
+    box.lower = box.upper = glm::vec3(m[3]);
+    for (int col = 0; col < 3; col++) {
+      for (int row = 0; row < 3; row++) {
+        const float a = m[col][row] * this->lower[col];
+        const float b = m[col][row] * this->upper[col];
+        box.lower[row] += std::min(a, b);
+        box.upper[row] += std::max(a, b);
+      }
+    }
+    return box;
+  }
+};
+
+// Bounds of count positions of 2, 3 or 4 floats, stride bytes apart.
+inline Box3 compute_bounds(const char * data, size_t count, size_t stride, uint32_t components)
+{
+  Box3 box;
+  if (count == 0) {
+    return box;
+  }
+  size_t i = 0;
+#ifdef INNOVATOR_SSE
+  if (components >= 3) {
+    // loads four floats per position, so the last position of a tightly
+    // packed float3 array is left to the scalar loop below
+    const size_t simd_count = (components == 4 || stride >= 16) ? count : count - 1;
+    __m128 lower = _mm_set1_ps(std::numeric_limits<float>::max());
+    __m128 upper = _mm_set1_ps(std::numeric_limits<float>::lowest());
+    for (; i < simd_count; i++) {
+      const __m128 p = _mm_loadu_ps(reinterpret_cast<const float*>(data + i * stride));
+      lower = _mm_min_ps(lower, p);
+      upper = _mm_max_ps(upper, p);
+    }
+    alignas(16) float l[4];
+    alignas(16) float u[4];
+    _mm_store_ps(l, lower);
+    _mm_store_ps(u, upper);
+    box.lower = glm::vec3(l[0], l[1], l[2]);
+    box.upper = glm::vec3(u[0], u[1], u[2]);
+  }
+#endif
+  for (; i < count; i++) {
+    float p[3] = { 0.0f, 0.0f, 0.0f };
+    std::memcpy(p, data + i * stride, std::min<uint32_t>(components, 3) * sizeof(float));
+    box.extend(glm::vec3(p[0], p[1], p[2]));
+  }
+  return box;
+}
+
+// The six planes of a view frustum, extracted from a model-view-projection
+// matrix with the [0, 1] clip space depth range of Vulkan. The planes are
+// stored one component per array, so that boxes are tested against four
+// planes per instruction.
+class Frustum {
+public:
+  explicit Frustum(const glm::dmat4 & matrix)
+  {
+    const glm::mat4 m(matrix);
+    const auto row = [&m](int i) {
+      return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    };
+    const glm::vec4 planes[6]{
+      row(3) + row(0),  // left
+      row(3) - row(0),  // right
+      row(3) + row(1),  // bottom
+      row(3) - row(1),  // top
+      row(2),           // near
+      row(3) - row(2),  // far
+    };
+    // the two padding planes contain everything
+    for (int i = 0; i < 8; i++) {
+      const glm::vec4 plane = i < 6 ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+      this->a[i] = plane.x;
+      this->b[i] = plane.y;
+      this->c[i] = plane.z;
+      this->d[i] = plane.w;
+    }
+  }
+
+  // false if the box is entirely outside one of the planes
+  bool intersects(const Box3 & box) const
+  {
+    const glm::vec3 center = box.center();
+    const glm::vec3 extent = box.extent();
+#ifdef INNOVATOR_SSE
+    const __m128 cx = _mm_set1_ps(center.x);
+    const __m128 cy = _mm_set1_ps(center.y);
+    const __m128 cz = _mm_set1_ps(center.z);
+    const __m128 ex = _mm_set1_ps(extent.x);
+    const __m128 ey = _mm_set1_ps(extent.y);
+    const __m128 ez = _mm_set1_ps(extent.z);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+
+    for (int i = 0; i < 8; i += 4) {
+      const __m128 pa = _mm_load_ps(this->a + i);
+      const __m128 pb = _mm_load_ps(this->b + i);
+      const __m128 pc = _mm_load_ps(this->c + i);
+      // signed distance of the center plus the projected radius of the box
+      __m128 distance = _mm_load_ps(this->d + i);
+      distance = _mm_add_ps(distance, _mm_mul_ps(pa, cx));
+      distance = _mm_add_ps(distance, _mm_mul_ps(pb, cy));
+      distance = _mm_add_ps(distance, _mm_mul_ps(pc, cz));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_andnot_ps(sign, pa), ex));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_andnot_ps(sign, pb), ey));
+      distance = _mm_add_ps(distance, _mm_mul_ps(_mm_andnot_ps(sign, pc), ez));
+      if (_mm_movemask_ps(_mm_cmplt_ps(distance, _mm_setzero_ps()))) {
+        return false;
+      }
+    }
+#else
+    for (int i = 0; i < 6; i++) {
+      const float distance =
+        this->a[i] * center.x + this->b[i] * center.y + this->c[i] * center.z +
+        std::abs(this->a[i]) * extent.x + std::abs(this->b[i]) * extent.y + std::abs(this->c[i]) * extent.z +
+        this->d[i];
+      if (distance < 0.0f) {
+        return false;
+      }
+    }
+#endif
+    return true;
+  }
+
+private:
+  alignas(16) float a[8];
+  alignas(16) float b[8];
+  alignas(16) float c[8];
+  alignas(16) float d[8];
+};
+
+// Bounding volume hierarchy over a sequence of boxes. Each node covers a
+// contiguous range of the sequence, split in the middle, so the boxes that
+// pass the frustum test are visited in their original order, and culled
+// ranges are skipped without visiting their boxes.
+class BoxHierarchy {
+public:
+  BoxHierarchy() = default;
+  ~BoxHierarchy() = default;
+
+  explicit BoxHierarchy(std::vector<Box3> boxes) :
+    boxes(std::move(boxes))
+  {
+    if (!this->boxes.empty()) {
+      this->nodes.reserve(2 * this->boxes.size() / leaf_size + 1);
+      this->build(0, static_cast<uint32_t>(this->boxes.size()));
+    }
+  }
+
+  size_t size() const
+  {
+    return this->boxes.size();
+  }
+
+  // calls visit(index) for every box that intersects the frustum, in order
+  template <typename Visit>
+  void cull(const Frustum & frustum, Visit visit) const
+  {
+    if (!this->nodes.empty()) {
+      this->cull(0, frustum, visit);
+    }
+  }
+
+private:
+  static constexpr uint32_t leaf_size = 4;
+
+  struct Node {
+    Box3 box;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t right;  // the left child follows its parent
+  };
+
+  uint32_t build(uint32_t begin, uint32_t end)
+  {
+    const uint32_t index = static_cast<uint32_t>(this->nodes.size());
+    this->nodes.push_back({ Box3(), begin, end, 0 });
+
+    Box3 box;
+    if (end - begin <= leaf_size) {
+      for (uint32_t i = begin; i < end; i++) {
+        box.extend(this->boxes[i]);
+      }
+    }
+    else {
+      const uint32_t middle = begin + (end - begin) / 2;
+      const uint32_t left = this->build(begin, middle);
+      const uint32_t right = this->build(middle, end);
+      box.extend(this->nodes[left].box);
+      box.extend(this->nodes[right].box);
+      this->nodes[index].right = right;
+    }
+    this->nodes[index].box = box;
+    return index;
+  }
+
+  template <typename Visit>
+  void cull(uint32_t index, const Frustum & frustum, Visit & visit) const
+  {
+    const Node & node = this->nodes[index];
+    if (!frustum.intersects(node.box)) {
+      return;
+    }
+    if (node.end - node.begin <= leaf_size) {
+      for (uint32_t i = node.begin; i < node.end; i++) {
+        if (frustum.intersects(this->boxes[i])) {
+          visit(i);
+        }
+      }
+      return;
+    }
+    this->cull(index + 1, frustum, visit);
+    this->cull(node.right, frustum, visit);
+  }
+
+  std::vector<Box3> boxes;
+  std::vector<Node> nodes;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+
+// returns the contents of the file, or nothing if it can not be read
+inline std::vector<char> read_file(const fs::path & path)
+{
+  std::ifstream input(path, std::ios::in | std::ios::binary);
+  if (!input) {
+    return {};
+  }
+  return std::vector<char>(std::istreambuf_iterator<char>(input),
+                           std::istreambuf_iterator<char>());
+}
+
+// Writes to a temporary file next to path and renames it into place, so
+// readers never observe a partially written file, even if the process dies.
+// The temporary file has a random name, so that threads or processes
+// writing the same path at once each write a file of their own.
+inline void write_file(const fs::path & path, const std::vector<char> & data)
+{
+  std::random_device random;
+  const uint64_t suffix = (uint64_t(random()) << 32) ^ random();
+  fs::path tmp = path;
+  tmp += "." + std::to_string(suffix) + ".tmp";
+  {
+    std::ofstream output(tmp, std::ios::out | std::ios::binary | std::ios::trunc);
+    output.write(data.data(), static_cast<std::streamsize>(data.size()));
+    output.flush();
+    if (!output) {
+      throw std::runtime_error("write_file: could not write " + tmp.string());
+    }
+  }
+  std::error_code error;
+  fs::rename(tmp, path, error);
+  if (error) {
+    fs::remove(tmp, error);
+    throw std::runtime_error("write_file: could not rename " + tmp.string() + " to " + path.string());
+  }
+}
+
+// 64-bit FNV-1a, pass the previous result as hash to continue hashing
+inline uint64_t fnv1a(const void * data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+  const unsigned char * bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+inline uint64_t fnv1a(const std::string & str, uint64_t hash = 14695981039346656037ull)
+{
+  // include the terminator so that consecutive strings can not run into each other
+  return fnv1a(str.c_str(), str.size() + 1, hash);
+}
+
+inline std::string to_hex(uint64_t value)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(16, '0');
+  for (int i = 15; i >= 0; i--, value >>= 4) {
+    hex[i] = digits[value & 0xf];
+  }
+  return hex;
+}
@@ -3,7 +3,11 @@
 #include <Innovator/Defines.h>
 #include <vulkan/vulkan.h>
 #include <functional>
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <cctype>
+#include <map>
 
 class VulkanTextureImage {
 public:
@@ -23,14 +27,45 @@ public:
   virtual VkImageType image_type() const = 0;
   virtual VkImageViewType image_view_type() const = 0;
   virtual VkImageSubresourceRange subresource_range() const = 0;
+
+  // texels per block of compressed formats, which are copied in whole blocks
+  virtual VkExtent3D block_extent() const
+  {
+    return { 1, 1, 1 };
+  }
+
+  // offset in data() of an array layer of a mip level, by default levels
+  // are stored one after the other, each with its layers one after the other
+  virtual size_t offset(size_t level, size_t layer) const
+  {
+    size_t offset = 0;
+    for (size_t i = 0; i < level; i++) {
+      offset += this->size(i);
+    }
+    return offset + layer * (this->size(level) / this->layers());
+  }
 };
 
 class VulkanImageFactory {
 public:
   typedef std::function<std::shared_ptr<VulkanTextureImage>(const std::string &)> ImageFunc;
+  typedef std::function<bool(VkFormat)> FormatFunc;
 
+  // files with an extension registered for an image type are created as
+  // that type, all other files as the type registered without an extension
   static std::shared_ptr<VulkanTextureImage> Create(const std::string & filename)
   {
+    const size_t dot = filename.find_last_of("./\\");
+    if (dot != std::string::npos && filename[dot] == '.') {
+      std::string extension = filename.substr(dot);
+      std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) {
+        return static_cast<char>(std::tolower(c));
+      });
+      auto it = extension_images.find(extension);
+      if (it != extension_images.end()) {
+        return it->second(filename);
+      }
+    }
     return create_image(filename);
   }
 
@@ -43,27 +78,78 @@ public:
     };
   }
 
+  // extension including the dot, in lower case, such as ".ktx2"
+  template <typename ImageType>
+  static void Register(const std::string & extension)
+  {
+    extension_images[extension] = [](const std::string & filename)
+    {
+      return std::make_shared<ImageType>(filename);
+    };
+  }
+
+  // Whether textures can be sampled in a format on the device they are
+  // created for, for image types that choose between formats, such as
+  // transcoded textures. Without a device, no format is assumed.
+  static bool Supports(VkFormat format)
+  {
+    return supports_format && supports_format(format);
+  }
+
   inline static ImageFunc create_image;
+  inline static std::map<std::string, ImageFunc> extension_images;
+  inline static FormatFunc supports_format;
 };
 
 #include <gli/gli.hpp>
+#include <stdexcept>
+#include <string>
 
+// Textures in the formats and targets gli reads from .dds, .ktx and .kmg
+// files. Cube map faces are array layers, 6 per cube.
 class GliTextureImage : public VulkanTextureImage {
 public:
   NO_COPY_OR_ASSIGNMENT(GliTextureImage)
 
-    explicit GliTextureImage(const std::string& filename) :
+  explicit GliTextureImage(const std::string& filename) :
     texture(gli::load(filename))
-  {}
+  {
+    if (this->texture.empty()) {
+      throw std::runtime_error("GliTextureImage: failed to load " + filename);
+    }
+    this->vkformat = vulkan_format(this->texture.format());
+    if (this->vkformat == VK_FORMAT_UNDEFINED) {
+      throw std::runtime_error("GliTextureImage: " + filename + " has a format without a Vulkan equivalent");
+    }
+  }
 
   virtual ~GliTextureImage() = default;
 
+  // gli numbers its formats like VkFormat, up to the last ASTC format. Of
+  // the formats after those, only ETC1 has an equivalent, as a subset of ETC2.
+  static VkFormat vulkan_format(gli::format format)
+  {
+    static_assert(int(gli::FORMAT_RGBA8_UNORM_PACK8) == int(VK_FORMAT_R8G8B8A8_UNORM) &&
+                  int(gli::FORMAT_RGBA_BP_UNORM_BLOCK16) == int(VK_FORMAT_BC7_UNORM_BLOCK) &&
+                  int(gli::FORMAT_RGBA_ASTC_12X12_SRGB_BLOCK16) == int(VK_FORMAT_ASTC_12x12_SRGB_BLOCK),
+                  "gli formats are numbered like VkFormat");
+
+    if (format >= gli::FORMAT_FIRST && format <= gli::FORMAT_RGBA_ASTC_12X12_SRGB_BLOCK16) {
+      return static_cast<VkFormat>(format);
+    }
+    if (format == gli::FORMAT_RGB_ETC_UNORM_BLOCK8) {
+      return VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK;
+    }
+    return VK_FORMAT_UNDEFINED;
+  }
+
   VkExtent3D extent(size_t level) const override
   {
+    const gli::extent3d extent = this->texture.extent(level);
     return {
-      static_cast<uint32_t>(static_cast<uint32_t>(this->texture[level].extent().x)),
-      static_cast<uint32_t>(static_cast<uint32_t>(this->texture[level].extent().y)),
-      1
+      static_cast<uint32_t>(extent.x),
+      static_cast<uint32_t>(extent.y),
+      static_cast<uint32_t>(extent.z)
     };
   }
 
@@ -79,12 +165,12 @@ public:
 
   uint32_t base_layer() const override
   {
-    return static_cast<uint32_t>(this->texture.base_layer());
+    return static_cast<uint32_t>(this->texture.base_layer() * this->texture.faces());
   }
 
   uint32_t layers() const override
   {
-    return static_cast<uint32_t>(this->texture.layers());
+    return static_cast<uint32_t>(this->texture.layers() * this->texture.faces());
   }
 
   size_t size() const override
@@ -92,9 +178,18 @@ public:
     return this->texture.size();
   }
 
+  // gli sizes a level of a single layer and face
   size_t size(size_t level) const override
   {
-    return this->texture.size(level);
+    return this->texture.size(level) * this->layers();
+  }
+
+  // gli stores the levels of each face of each layer together
+  size_t offset(size_t level, size_t layer) const override
+  {
+    const size_t faces = this->texture.faces();
+    const auto * level_data = static_cast<const unsigned char*>(this->texture.data(layer / faces, layer % faces, level));
+    return static_cast<size_t>(level_data - this->data());
   }
 
   const unsigned char* data() const override
@@ -104,17 +199,41 @@ public:
 
   VkFormat format() const override
   {
-    return VK_FORMAT_R8G8B8A8_UNORM;
+    return this->vkformat;
+  }
+
+  VkExtent3D block_extent() const override
+  {
+    const gli::extent3d extent = gli::block_extent(this->texture.format());
+    return {
+      static_cast<uint32_t>(extent.x),
+      static_cast<uint32_t>(extent.y),
+      static_cast<uint32_t>(extent.z)
+    };
   }
 
   VkImageType image_type() const override
   {
-    return VK_IMAGE_TYPE_2D;
+    switch (this->texture.target()) {
+    case gli::TARGET_1D:
+    case gli::TARGET_1D_ARRAY: return VK_IMAGE_TYPE_1D;
+    case gli::TARGET_3D: return VK_IMAGE_TYPE_3D;
+    default: return VK_IMAGE_TYPE_2D;
+    }
   }
 
   VkImageViewType image_view_type() const override
   {
-    return VK_IMAGE_VIEW_TYPE_2D;
+    switch (this->texture.target()) {
+    case gli::TARGET_1D: return VK_IMAGE_VIEW_TYPE_1D;
+    case gli::TARGET_1D_ARRAY: return VK_IMAGE_VIEW_TYPE_1D_ARRAY;
+    case gli::TARGET_2D_ARRAY:
+    case gli::TARGET_RECT_ARRAY: return VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    case gli::TARGET_3D: return VK_IMAGE_VIEW_TYPE_3D;
+    case gli::TARGET_CUBE: return VK_IMAGE_VIEW_TYPE_CUBE;
+    case gli::TARGET_CUBE_ARRAY: return VK_IMAGE_VIEW_TYPE_CUBE_ARRAY;
+    default: return VK_IMAGE_VIEW_TYPE_2D;
+    }
   }
 
   VkImageSubresourceRange subresource_range() const override
@@ -128,5 +247,6 @@ public:
     };
   }
 
-  gli::texture2d texture;
+  gli::texture texture;
+  VkFormat vkformat{ VK_FORMAT_UNDEFINED };
 };
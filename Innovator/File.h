@@ -1,13 +1,17 @@
 #pragma once
 
 #include <Innovator/Nodes.h>
+#include <Innovator/Mesh.h>
+#include <Innovator/GltfScene.h>
 #include <Innovator/Scheme.h>
 
 #include <string>
 #include <memory>
 #include <vector>
+#include <cmath>
 #include <fstream>
 #include <utility>
+#include <algorithm>
 
 using namespace scm;
 
@@ -63,6 +67,366 @@ uint32_t count(const List & list)
   return static_cast<uint32_t>(bufferdata->count());
 }
 
+// Indices of 16 or 32 bits, told apart by the stride of the buffer data,
+// such as the result of meshindices
+std::vector<uint32_t> meshindexdata(const BufferData & data, const std::string & function)
+{
+  if (data.stride() == sizeof(uint16_t)) {
+    std::vector<uint16_t> indices(data.size() / sizeof(uint16_t));
+    data.copy(reinterpret_cast<char *>(indices.data()), 0, indices.size() * sizeof(uint16_t));
+    return std::vector<uint32_t>(indices.begin(), indices.end());
+  }
+  if (data.stride() != sizeof(uint32_t)) {
+    throw std::invalid_argument(function + " takes indices of 16 or 32 bits");
+  }
+  std::vector<uint32_t> indices(data.size() / sizeof(uint32_t));
+  data.copy(reinterpret_cast<char *>(indices.data()), 0, indices.size() * sizeof(uint32_t));
+  return indices;
+}
+
+// (meshlevels vertices [indices] levelcount ratio), a chain of levels of
+// detail for float3 positions, read as a triangle soup unless indices are
+// given. Each level has about ratio times the triangles of the previous one.
+// (meshlevels mesh levelcount ratio) builds the chain from the result of
+// meshoptimize, and keeps its normals.
+std::shared_ptr<MeshLevels> meshlevels(const List & lst)
+{
+  if (lst.size() != 3 && lst.size() != 4) {
+    throw std::invalid_argument("meshlevels takes vertices, optional indices, level count and ratio");
+  }
+  const auto level_count = static_cast<size_t>(std::any_cast<Number>(lst[lst.size() - 2]));
+  const auto ratio = static_cast<float>(std::any_cast<Number>(lst[lst.size() - 1]));
+
+  if (lst[0].type() == typeid(std::shared_ptr<MeshLevels>)) {
+    auto optimized = std::any_cast<std::shared_ptr<MeshLevels>>(lst[0]);
+    Mesh mesh;
+    mesh.positions = optimized->positions;
+    mesh.indices = optimized->levels[0];
+    return std::make_shared<MeshLevels>(load_mesh_levels(std::move(mesh), level_count, ratio, !optimized->normals.empty()));
+  }
+
+  auto vertices = std::dynamic_pointer_cast<BufferData>(std::any_cast<std::shared_ptr<Node>>(lst[0]));
+  if (!vertices) {
+    throw std::invalid_argument("meshlevels only works on BufferData nodes!");
+  }
+  std::vector<glm::vec3> positions(vertices->size() / sizeof(glm::vec3));
+  vertices->copy(reinterpret_cast<char *>(positions.data()), 0, positions.size() * sizeof(glm::vec3));
+
+  Mesh mesh;
+  if (lst.size() == 4) {
+    auto indices = std::dynamic_pointer_cast<BufferData>(std::any_cast<std::shared_ptr<Node>>(lst[1]));
+    if (!indices) {
+      throw std::invalid_argument("meshlevels only works on BufferData nodes!");
+    }
+    mesh.indices = meshindexdata(*indices, "meshlevels");
+    mesh.positions = std::move(positions);
+  }
+  else {
+    mesh = index_positions(reinterpret_cast<const float *>(positions.data()), positions.size());
+  }
+  return std::make_shared<MeshLevels>(load_mesh_levels(std::move(mesh), level_count, ratio));
+}
+
+// (meshoptimize vertices [indices] [#t]), welds the float3 positions and
+// reorders the triangles for the vertex cache and overdraw. With #t, smooth
+// normals are generated too. The result is used like that of meshlevels,
+// and can be passed to meshlevels to build levels of detail from it.
+std::shared_ptr<MeshLevels> meshoptimize(const List & lst)
+{
+  if (lst.empty() || lst.size() > 3) {
+    throw std::invalid_argument("meshoptimize takes vertices, optional indices and optional #t for normals");
+  }
+  const auto bufferdata = [](const std::any & value) {
+    auto data = std::dynamic_pointer_cast<BufferData>(std::any_cast<std::shared_ptr<Node>>(value));
+    if (!data) {
+      throw std::invalid_argument("meshoptimize only works on BufferData nodes!");
+    }
+    return data;
+  };
+  const bool normals = lst.back().type() == typeid(Boolean) && std::any_cast<Boolean>(lst.back());
+  const bool indexed = lst.size() > 1 && lst[1].type() == typeid(std::shared_ptr<Node>);
+
+  auto vertices = bufferdata(lst[0]);
+  std::vector<glm::vec3> positions(vertices->size() / sizeof(glm::vec3));
+  vertices->copy(reinterpret_cast<char *>(positions.data()), 0, positions.size() * sizeof(glm::vec3));
+
+  Mesh mesh;
+  if (indexed) {
+    mesh.indices = meshindexdata(*bufferdata(lst[1]), "meshoptimize");
+    mesh.positions = std::move(positions);
+  }
+  else {
+    mesh = index_positions(reinterpret_cast<const float *>(positions.data()), positions.size());
+  }
+  return std::make_shared<MeshLevels>(optimize_mesh(std::move(mesh), normals));
+}
+
+// (meshvertices levels), the positions shared by all levels
+std::shared_ptr<Node> meshvertices(const List & lst)
+{
+  auto levels = std::any_cast<std::shared_ptr<MeshLevels>>(lst[0]);
+  const float * begin = reinterpret_cast<const float *>(levels->positions.data());
+  return std::make_shared<InlineBufferData<float>>(
+    std::vector<float>(begin, begin + levels->positions.size() * 3));
+}
+
+// (meshnormals levels), the normals shared by all levels
+std::shared_ptr<Node> meshnormals(const List & lst)
+{
+  auto levels = std::any_cast<std::shared_ptr<MeshLevels>>(lst[0]);
+  if (levels->normals.empty()) {
+    throw std::invalid_argument("meshnormals: the mesh has no normals, pass #t to meshoptimize");
+  }
+  const float * begin = reinterpret_cast<const float *>(levels->normals.data());
+  return std::make_shared<InlineBufferData<float>>(
+    std::vector<float>(begin, begin + levels->normals.size() * 3));
+}
+
+// (meshindextype levels), the narrowest index type for the vertex count
+VkIndexType meshindextype(const List & lst)
+{
+  auto levels = std::any_cast<std::shared_ptr<MeshLevels>>(lst[0]);
+  return levels->positions.size() <= 0x10000 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
+// (meshindices levels [level]), the indices of a level, or of the last level
+// if the mesh could not be simplified that far, of type meshindextype
+std::shared_ptr<Node> meshindices(const List & lst)
+{
+  auto levels = std::any_cast<std::shared_ptr<MeshLevels>>(lst[0]);
+  const size_t requested = lst.size() > 1 ? static_cast<size_t>(std::any_cast<Number>(lst[1])) : 0;
+  const std::vector<uint32_t> & indices = levels->levels[std::min(requested, levels->levels.size() - 1)];
+
+  if (meshindextype(lst) == VK_INDEX_TYPE_UINT16) {
+    return std::make_shared<InlineBufferData<uint16_t>>(
+      std::vector<uint16_t>(indices.begin(), indices.end()));
+  }
+  return std::make_shared<InlineBufferData<uint32_t>>(indices);
+}
+
+// (meshquantize levels [normalbits]), the vertices of a mesh as compact
+// vertex streams: positions as 16 bit normalized values relative to the
+// mesh bounds at location 0, binding 0, and octahedral normals as two 8 or
+// 16 bit normalized values at location 1, binding 1, decoded in the shader
+// with Shaders/octahedral.glsl. The group starts with the transform that
+// restores the positions, so it must precede the transformbuffer.
+std::shared_ptr<Node> meshquantize(const List & lst)
+{
+  auto levels = std::any_cast<std::shared_ptr<MeshLevels>>(lst[0]);
+  const auto normal_bits = lst.size() > 1 ? static_cast<uint32_t>(std::any_cast<Number>(lst[1])) : 16;
+  const QuantizedVertices quantized = quantize_vertices(levels->positions, levels->normals, normal_bits);
+
+  const glm::dvec3 scale(quantized.scale);
+  std::vector<std::shared_ptr<Node>> children{
+    std::make_shared<DequantizeTransform>(glm::dvec3(quantized.offset), scale),
+    std::make_shared<InlineBufferData<uint16_t>>(quantized.positions),
+    std::make_shared<GpuMemoryBuffer>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+    std::make_shared<VertexInputAttributeDescription>(0, 0, VK_FORMAT_R16G16B16A16_UNORM, 0),
+    std::make_shared<VertexInputBindingDescription>(0, 4 * sizeof(uint16_t), VK_VERTEX_INPUT_RATE_VERTEX),
+  };
+
+  if (quantized.normal_bits) {
+    const uint32_t stride = quantized.normal_bits / 4;
+    children.push_back(std::make_shared<InlineBufferData<uint8_t>>(quantized.normals));
+    children.push_back(std::make_shared<GpuMemoryBuffer>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
+    children.push_back(std::make_shared<VertexInputAttributeDescription>(
+      1, 1, quantized.normal_bits == 8 ? VK_FORMAT_R8G8_SNORM : VK_FORMAT_R16G16_SNORM, 0));
+    children.push_back(std::make_shared<VertexInputBindingDescription>(1, stride, VK_VERTEX_INPUT_RATE_VERTEX));
+  }
+  return std::make_shared<Group>(children);
+}
+
+// (bufferdata-half data), float data, such as texture coordinates, as half
+// floats, for use with the VK_FORMAT_*_SFLOAT formats of 16 bit components
+std::shared_ptr<Node> bufferdata_half(const List & lst)
+{
+  auto data = std::dynamic_pointer_cast<BufferData>(std::any_cast<std::shared_ptr<Node>>(lst[0]));
+  if (!data) {
+    throw std::invalid_argument("bufferdata-half only works on BufferData nodes!");
+  }
+  std::vector<float> values(data->size() / sizeof(float));
+  data->copy(reinterpret_cast<char *>(values.data()), 0, values.size() * sizeof(float));
+
+  std::vector<uint16_t> halves(values.size());
+  std::transform(values.begin(), values.end(), halves.begin(), float_to_half);
+  return std::make_shared<InlineBufferData<uint16_t>>(halves);
+}
+
+// (instances binding location transforms [colors]), draws the following
+// geometry once per transform, see the Instances node
+std::shared_ptr<Node> instances(const List & lst)
+{
+  const auto bufferdata = [](const std::any & value) {
+    auto data = std::dynamic_pointer_cast<BufferData>(std::any_cast<std::shared_ptr<Node>>(value));
+    if (!data) {
+      throw std::invalid_argument("instances only works on BufferData nodes!");
+    }
+    return data;
+  };
+  return std::make_shared<Instances>(std::any_cast<uint32_t>(lst[0]),
+                                     std::any_cast<uint32_t>(lst[1]),
+                                     bufferdata(lst[2]),
+                                     lst.size() > 3 ? bufferdata(lst[3]) : nullptr);
+}
+
+// (instancegrid nx ny nz spacing), the transforms of nx * ny * nz instances
+// translated to the points of a grid
+std::shared_ptr<Node> instancegrid(const List & lst)
+{
+  const auto nx = static_cast<size_t>(std::any_cast<Number>(lst[0]));
+  const auto ny = static_cast<size_t>(std::any_cast<Number>(lst[1]));
+  const auto nz = static_cast<size_t>(std::any_cast<Number>(lst[2]));
+  const auto spacing = static_cast<float>(std::any_cast<Number>(lst[3]));
+
+  std::vector<float> values;
+  values.reserve(nx * ny * nz * 16);
+  for (size_t z = 0; z < nz; z++) {
+    for (size_t y = 0; y < ny; y++) {
+      for (size_t x = 0; x < nx; x++) {
+        glm::mat4 matrix(1.0f);
+        matrix[3] = glm::vec4(glm::vec3(x, y, z) * spacing, 1.0f);
+        const float * m = glm::value_ptr(matrix);
+        values.insert(values.end(), m, m + 16);
+      }
+    }
+  }
+  return std::make_shared<InlineBufferData<float>>(values);
+}
+
+// (instancecolors transforms), a color per instance, with hues spread over
+// the instances
+std::shared_ptr<Node> instancecolors(const List & lst)
+{
+  auto transforms = std::dynamic_pointer_cast<BufferData>(std::any_cast<std::shared_ptr<Node>>(lst[0]));
+  if (!transforms) {
+    throw std::invalid_argument("instancecolors only works on BufferData nodes!");
+  }
+  const size_t count = transforms->size() / sizeof(glm::mat4);
+
+  std::vector<float> values;
+  values.reserve(count * 4);
+  for (size_t i = 0; i < count; i++) {
+    // consecutive instances are a golden angle apart on the hue circle
+    const float hue = std::fmod(float(i) * 0.618034f, 1.0f) * 6.0f;
+    values.push_back(glm::clamp(std::abs(hue - 3.0f) - 1.0f, 0.0f, 1.0f));
+    values.push_back(glm::clamp(2.0f - std::abs(hue - 2.0f), 0.0f, 1.0f));
+    values.push_back(glm::clamp(2.0f - std::abs(hue - 4.0f), 0.0f, 1.0f));
+    values.push_back(1.0f);
+  }
+  return std::make_shared<InlineBufferData<float>>(values);
+}
+
+// (meshlets levels [level]), the meshlets of a level, or of the last level
+// if the mesh could not be simplified that far, for meshletculling. The
+// meshlets are ranges of the indices of the same level in meshindices, and
+// bounded in the model space of the mesh, so meshletculling must precede
+// meshquantize. See 3DBenchy/meshlets.scene.
+std::shared_ptr<Node> meshlets(const List & lst)
+{
+  auto levels = std::any_cast<std::shared_ptr<MeshLevels>>(lst[0]);
+  const size_t requested = lst.size() > 1 ? static_cast<size_t>(std::any_cast<Number>(lst[1])) : 0;
+  const std::vector<uint32_t> & indices = levels->levels[std::min(requested, levels->levels.size() - 1)];
+  return std::make_shared<InlineBufferData<Meshlet>>(build_meshlets(levels->positions, indices));
+}
+
+// (meshfile filename), a memory mapped mesh file written by meshconvert
+std::shared_ptr<MeshFile> meshfile(const List & lst)
+{
+  return std::make_shared<MeshFile>(std::any_cast<std::string>(lst[0]));
+}
+
+// (meshfilevertices file), the vertex streams of a mesh file with their
+// attribute and binding descriptions, bound in the order of the file's
+// vertex sections. The group starts with the transform that restores
+// quantized positions, so it must precede the transformbuffer.
+std::shared_ptr<Node> meshfilevertices(const List & lst)
+{
+  auto file = std::any_cast<std::shared_ptr<MeshFile>>(lst[0]);
+  const MeshFileHeader & header = file->header;
+
+  const glm::dvec3 offset(header.position_offset[0], header.position_offset[1], header.position_offset[2]);
+  const glm::dvec3 scale(header.position_scale[0], header.position_scale[1], header.position_scale[2]);
+  std::vector<std::shared_ptr<Node>> children{
+    std::make_shared<DequantizeTransform>(offset, scale)
+  };
+
+  uint32_t binding = 0;
+  for (uint32_t s = 0; s < file->sections.size(); s++) {
+    const MeshFileSection & section = file->sections[s];
+    if (section.type != static_cast<uint32_t>(MeshFileSectionType::Vertices)) {
+      continue;
+    }
+    auto data = std::make_shared<MeshFileBufferData>(file, section);
+    children.push_back(data);
+    children.push_back(std::make_shared<GpuMemoryBuffer>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
+    // the binding precedes its attributes, so the bounds are computed with its stride
+    children.push_back(std::make_shared<VertexInputBindingDescription>(binding, section.stride, VK_VERTEX_INPUT_RATE_VERTEX));
+    for (auto & attribute : file->attributes) {
+      if (attribute.section != s) {
+        continue;
+      }
+      // float positions are bounded by the bounds in the header, which
+      // saves reading them, quantized positions span the unit cube
+      if (attribute.location == 0 && static_cast<VkFormat>(attribute.format) == VK_FORMAT_R32G32B32_SFLOAT) {
+        const Box3 bounds{
+          glm::vec3(header.bounds[0], header.bounds[1], header.bounds[2]),
+          glm::vec3(header.bounds[3], header.bounds[4], header.bounds[5])
+        };
+        data->set_bounds(3, attribute.offset, section.stride, bounds);
+      }
+      children.push_back(std::make_shared<VertexInputAttributeDescription>(
+        attribute.location, binding, static_cast<VkFormat>(attribute.format), attribute.offset));
+    }
+    binding++;
+  }
+  return std::make_shared<Group>(children);
+}
+
+// (meshfileindextype file), the index type of the mesh file
+VkIndexType meshfileindextype(const List & lst)
+{
+  auto file = std::any_cast<std::shared_ptr<MeshFile>>(lst[0]);
+  const MeshFileSection * section = file->find(MeshFileSectionType::Indices, 0);
+  if (!section) {
+    throw std::invalid_argument("meshfileindextype: the mesh file has no indices");
+  }
+  return static_cast<VkIndexType>(section->format);
+}
+
+// (meshfileindices file [level]), the indices of a level of detail, or of
+// the last level if the file has fewer levels
+std::shared_ptr<Node> meshfileindices(const List & lst)
+{
+  auto file = std::any_cast<std::shared_ptr<MeshFile>>(lst[0]);
+  const uint32_t requested = lst.size() > 1 ? static_cast<uint32_t>(std::any_cast<Number>(lst[1])) : 0;
+  const uint32_t level = std::min(requested, std::max(file->header.level_count, 1u) - 1);
+  const MeshFileSection * section = file->find(MeshFileSectionType::Indices, level);
+  if (!section) {
+    throw std::invalid_argument("meshfileindices: the mesh file has no indices for level " + std::to_string(level));
+  }
+  return std::make_shared<MeshFileBufferData>(file, *section);
+}
+
+// (meshfilemeshlets file), the meshlets of the indices of level 0 of a mesh
+// file, for meshletculling
+std::shared_ptr<Node> meshfilemeshlets(const List & lst)
+{
+  auto file = std::any_cast<std::shared_ptr<MeshFile>>(lst[0]);
+  const MeshFileSection * section = file->find(MeshFileSectionType::Meshlets, 0);
+  if (!section) {
+    throw std::invalid_argument("meshfilemeshlets: the mesh file has no meshlets, convert it again");
+  }
+  return std::make_shared<MeshFileBufferData>(file, *section);
+}
+
+// (gltf filename), the default scene of a .glb or .gltf file, drawn with
+// Shaders/gltf.vert and Shaders/gltf.frag
+std::shared_ptr<Node> gltf(const List & lst)
+{
+  GltfScene scene(std::any_cast<std::string>(lst[0]));
+  return scene.root();
+}
+
 template <typename Flags, typename FlagBits>
 Flags flags(const List& lst) {
   if (lst.empty()) {
@@ -76,6 +440,49 @@ Flags flags(const List& lst) {
   return flags;
 }
 
+// (shader filename stage [optimization-level])
+std::shared_ptr<Node> shader(const List & lst)
+{
+  const auto optimization_level = (lst.size() > 2) ? 
+    std::any_cast<shaderc_optimization_level>(lst[2]) : 
+    shaderc_optimization_level_zero;
+
+  return std::make_shared<Shader>(std::any_cast<std::string>(lst[0]),
+                                  std::any_cast<VkShaderStageFlagBits>(lst[1]),
+                                  optimization_level);
+}
+
+// (specializationconstants id value id value ...), ids are uint32. Values 
+// may be uint32, int32, booleans, or numbers, which are passed as float.
+std::shared_ptr<Node> specializationconstants(const List & lst)
+{
+  if (lst.size() % 2 != 0) {
+    throw std::invalid_argument("specializationconstants takes pairs of constant id and value");
+  }
+  auto node = std::make_shared<SpecializationConstants>();
+  for (size_t i = 0; i < lst.size(); i += 2) {
+    const auto constant_id = std::any_cast<uint32_t>(lst[i]);
+    const std::any & value = lst[i + 1];
+
+    if (value.type() == typeid(uint32_t)) {
+      node->add(constant_id, std::any_cast<uint32_t>(value));
+    }
+    else if (value.type() == typeid(int32_t)) {
+      node->add(constant_id, std::any_cast<int32_t>(value));
+    }
+    else if (value.type() == typeid(Boolean)) {
+      node->add(constant_id, static_cast<VkBool32>(std::any_cast<Boolean>(value)));
+    }
+    else if (value.type() == typeid(Number)) {
+      node->add(constant_id, static_cast<float>(std::any_cast<Number>(value)));
+    }
+    else {
+      throw std::invalid_argument("specializationconstants: unsupported value type");
+    }
+  }
+  return node;
+}
+
 std::shared_ptr<Node> eval_file(const std::string & filename)
 {
   env_ptr env = scm::global_env();
@@ -85,27 +492,61 @@ std::shared_ptr<Node> eval_file(const std::string & filename)
     { "int32", fun_ptr(make_object<int32_t, Number>) },
     { "uint32", fun_ptr(make_object<uint32_t, Number>) },
     { "count", fun_ptr(count) },
-    { "shader", fun_ptr(node<Shader, std::string, VkShaderStageFlagBits>) },
+    { "shader", fun_ptr(shader) },
+    { "specializationconstants", fun_ptr(specializationconstants) },
     { "sampler", fun_ptr(node<Sampler, VkFilter, VkFilter, VkSamplerMipmapMode, VkSamplerAddressMode, VkSamplerAddressMode, VkSamplerAddressMode>) },
     { "textureimage", fun_ptr(node<TextureImage, std::string>) },
     { "image", fun_ptr(node<Image, VkSampleCountFlagBits, VkImageTiling, VkImageUsageFlags, VkSharingMode, VkImageCreateFlags, VkImageLayout>) },
+    { "streamingimage", fun_ptr(node<StreamingImage, VkSampleCountFlagBits, VkImageTiling, VkImageUsageFlags, VkSharingMode, VkImageCreateFlags, VkImageLayout>) },
+    { "mipmappedimage", fun_ptr(node<MipmappedImage, VkSampleCountFlagBits, VkImageTiling, VkImageUsageFlags, VkSharingMode, VkImageCreateFlags, VkImageLayout>) },
     { "imageview", fun_ptr(node<ImageView, VkComponentSwizzle, VkComponentSwizzle, VkComponentSwizzle, VkComponentSwizzle>) },
     { "group", fun_ptr(shared_from_node_list<Group, std::shared_ptr<Node>>) },
     { "separator", fun_ptr(shared_from_node_list<Separator, std::shared_ptr<Node>>) },
+    { "lod", fun_ptr(shared_from_node_list<LevelOfDetail, std::shared_ptr<Node>>) },
+    { "meshlevels", fun_ptr(meshlevels) },
+    { "meshoptimize", fun_ptr(meshoptimize) },
+    { "meshvertices", fun_ptr(meshvertices) },
+    { "meshnormals", fun_ptr(meshnormals) },
+    { "meshindextype", fun_ptr(meshindextype) },
+    { "meshquantize", fun_ptr(meshquantize) },
+    { "meshfile", fun_ptr(meshfile) },
+    { "meshfilevertices", fun_ptr(meshfilevertices) },
+    { "meshfileindices", fun_ptr(meshfileindices) },
+    { "meshfileindextype", fun_ptr(meshfileindextype) },
+    { "meshindices", fun_ptr(meshindices) },
+    { "meshlets", fun_ptr(meshlets) },
+    { "meshfilemeshlets", fun_ptr(meshfilemeshlets) },
+    { "stlbufferdata", fun_ptr(node<STLBufferData, std::string>) },
+    { "gltf", fun_ptr(gltf) },
+    { "instances", fun_ptr(instances) },
+    { "instancegrid", fun_ptr(instancegrid) },
+    { "instancecolors", fun_ptr(instancecolors) },
     { "bufferdata-float", fun_ptr(bufferdata<float>) },
     { "bufferdata-uint32", fun_ptr(bufferdata<uint32_t>) },
+    { "bufferdata-half", fun_ptr(bufferdata_half) },
     { "bufferusageflags", fun_ptr(flags<VkBufferUsageFlags, VkBufferUsageFlagBits>) },
     { "imageusageflags", fun_ptr(flags<VkImageUsageFlags, VkImageUsageFlagBits>) },
     { "imagecreateflags", fun_ptr(flags<VkImageCreateFlags, VkImageCreateFlagBits>) },
     { "cpumemorybuffer", fun_ptr(node<CpuMemoryBuffer, VkBufferUsageFlags>) },
     { "gpumemorybuffer", fun_ptr(node<GpuMemoryBuffer, VkBufferUsageFlags>) },
     { "transformbuffer", fun_ptr(node<TransformBuffer>) },
+    { "drawcommand", fun_ptr(node<DrawCommand, uint32_t, uint32_t, uint32_t, uint32_t, VkPrimitiveTopology>) },
     { "indexeddrawcommand", fun_ptr(node<IndexedDrawCommand, uint32_t, uint32_t, uint32_t, int32_t, uint32_t, VkPrimitiveTopology>) },
+    { "drawindirect", fun_ptr(node<IndirectDrawCommand, uint32_t, uint32_t, VkPrimitiveTopology>) },
+    { "drawindexedindirect", fun_ptr(node<IndexedIndirectDrawCommand, uint32_t, uint32_t, VkPrimitiveTopology>) },
     { "indexbufferdescription", fun_ptr(node<IndexBufferDescription, VkIndexType>) },
+    { "indirectbufferdescription", fun_ptr(node<IndirectBufferDescription>) },
+    { "indirectcountbufferdescription", fun_ptr(node<IndirectCountBufferDescription>) },
+    { "gpuculling", fun_ptr(node<GpuCulling, uint32_t>) },
+    { "meshletculling", fun_ptr(node<MeshletCulling, uint32_t>) },
     { "descriptorsetlayoutbinding", fun_ptr(node<DescriptorSetLayoutBinding, uint32_t, VkDescriptorType, VkShaderStageFlagBits>) },
     { "vertexinputbindingdescription", fun_ptr(node<VertexInputBindingDescription, uint32_t, uint32_t, VkVertexInputRate>) },
     { "vertexinputattributedescription", fun_ptr(node<VertexInputAttributeDescription, uint32_t, uint32_t, VkFormat, uint32_t>) },
 
+    { "shaderc_optimization_level_zero", shaderc_optimization_level_zero },
+    { "shaderc_optimization_level_size", shaderc_optimization_level_size },
+    { "shaderc_optimization_level_performance", shaderc_optimization_level_performance },
+
     { "VK_FILTER_NEAREST", VK_FILTER_NEAREST },
     { "VK_FILTER_LINEAR", VK_FILTER_LINEAR },
     { "VK_FILTER_CUBIC_IMG", VK_FILTER_CUBIC_IMG },
@@ -228,7 +669,13 @@ std::shared_ptr<Node> eval_file(const std::string & filename)
     { "VK_FORMAT_R32G32B32_SFLOAT", VK_FORMAT_R32G32B32_SFLOAT },
     { "VK_FORMAT_R32G32B32A32_UINT", VK_FORMAT_R32G32B32A32_UINT },
     { "VK_FORMAT_R32G32B32A32_SINT", VK_FORMAT_R32G32B32A32_SINT },
-    { "VK_FORMAT_R32G32B32A32_SFLOAT", VK_FORMAT_R32G32B32A32_SFLOAT }
+    { "VK_FORMAT_R32G32B32A32_SFLOAT", VK_FORMAT_R32G32B32A32_SFLOAT },
+    { "VK_FORMAT_R8G8_SNORM", VK_FORMAT_R8G8_SNORM },
+    { "VK_FORMAT_R16G16_SNORM", VK_FORMAT_R16G16_SNORM },
+    { "VK_FORMAT_R16G16_SFLOAT", VK_FORMAT_R16G16_SFLOAT },
+    { "VK_FORMAT_R16G16B16A16_UNORM", VK_FORMAT_R16G16B16A16_UNORM },
+    { "VK_FORMAT_R16G16B16A16_SNORM", VK_FORMAT_R16G16B16A16_SNORM },
+    { "VK_FORMAT_R16G16B16A16_SFLOAT", VK_FORMAT_R16G16B16A16_SFLOAT }
   });
 
   std::ifstream input(filename, std::ios::in);
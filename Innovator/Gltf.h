@@ -0,0 +1,396 @@
+#pragma once
+
+#include <Innovator/Cache.h>
+#include <Innovator/Defines.h>
+#include <Innovator/Factory.h>
+#include <Innovator/Json.h>
+#include <Innovator/MappedFile.h>
+#include <Innovator/ThreadPool.h>
+
+#include <vulkan/vulkan.h>
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+// glTF 2.0 component types
+enum GltfComponentType : uint32_t {
+  GLTF_BYTE = 5120,
+  GLTF_UNSIGNED_BYTE = 5121,
+  GLTF_SHORT = 5122,
+  GLTF_UNSIGNED_SHORT = 5123,
+  GLTF_UNSIGNED_INT = 5125,
+  GLTF_FLOAT = 5126,
+};
+
+inline uint32_t gltf_component_size(uint32_t component_type)
+{
+  switch (component_type) {
+  case GLTF_BYTE:
+  case GLTF_UNSIGNED_BYTE: return 1;
+  case GLTF_SHORT:
+  case GLTF_UNSIGNED_SHORT: return 2;
+  case GLTF_UNSIGNED_INT:
+  case GLTF_FLOAT: return 4;
+  default: throw std::runtime_error("glTF: unknown component type " + std::to_string(component_type));
+  }
+}
+
+inline uint32_t gltf_component_count(const std::string & type)
+{
+  if (type == "SCALAR") return 1;
+  if (type == "VEC2") return 2;
+  if (type == "VEC3") return 3;
+  if (type == "VEC4") return 4;
+  if (type == "MAT2") return 4;
+  if (type == "MAT3") return 9;
+  if (type == "MAT4") return 16;
+  throw std::runtime_error("glTF: unknown accessor type " + type);
+}
+
+// The vertex format of an accessor, or VK_FORMAT_UNDEFINED if the
+// combination can not be used as a vertex attribute
+inline VkFormat gltf_vertex_format(uint32_t component_type, uint32_t components, bool normalized)
+{
+  static const VkFormat formats[][4] = {
+    { VK_FORMAT_R8_SINT, VK_FORMAT_R8G8_SINT, VK_FORMAT_R8G8B8_SINT, VK_FORMAT_R8G8B8A8_SINT },
+    { VK_FORMAT_R8_SNORM, VK_FORMAT_R8G8_SNORM, VK_FORMAT_R8G8B8_SNORM, VK_FORMAT_R8G8B8A8_SNORM },
+    { VK_FORMAT_R8_UINT, VK_FORMAT_R8G8_UINT, VK_FORMAT_R8G8B8_UINT, VK_FORMAT_R8G8B8A8_UINT },
+    { VK_FORMAT_R8_UNORM, VK_FORMAT_R8G8_UNORM, VK_FORMAT_R8G8B8_UNORM, VK_FORMAT_R8G8B8A8_UNORM },
+    { VK_FORMAT_R16_SINT, VK_FORMAT_R16G16_SINT, VK_FORMAT_R16G16B16_SINT, VK_FORMAT_R16G16B16A16_SINT },
+    { VK_FORMAT_R16_SNORM, VK_FORMAT_R16G16_SNORM, VK_FORMAT_R16G16B16_SNORM, VK_FORMAT_R16G16B16A16_SNORM },
+    { VK_FORMAT_R16_UINT, VK_FORMAT_R16G16_UINT, VK_FORMAT_R16G16B16_UINT, VK_FORMAT_R16G16B16A16_UINT },
+    { VK_FORMAT_R16_UNORM, VK_FORMAT_R16G16_UNORM, VK_FORMAT_R16G16B16_UNORM, VK_FORMAT_R16G16B16A16_UNORM },
+    { VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT },
+    { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT },
+  };
+  if (components < 1 || components > 4) {
+    return VK_FORMAT_UNDEFINED;
+  }
+  switch (component_type) {
+  case GLTF_BYTE: return formats[normalized ? 1 : 0][components - 1];
+  case GLTF_UNSIGNED_BYTE: return formats[normalized ? 3 : 2][components - 1];
+  case GLTF_SHORT: return formats[normalized ? 5 : 4][components - 1];
+  case GLTF_UNSIGNED_SHORT: return formats[normalized ? 7 : 6][components - 1];
+  case GLTF_UNSIGNED_INT: return normalized ? VK_FORMAT_UNDEFINED : formats[8][components - 1];
+  case GLTF_FLOAT: return formats[9][components - 1];
+  default: return VK_FORMAT_UNDEFINED;
+  }
+}
+
+inline VkPrimitiveTopology gltf_topology(uint32_t mode)
+{
+  switch (mode) {
+  case 0: return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+  case 1: return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+  case 3: return VK_PRIMITIVE_TOPOLOGY_LINE_STRIP;
+  case 4: return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  case 5: return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+  case 6: return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_FAN;
+  default: throw std::runtime_error("glTF: unsupported primitive mode " + std::to_string(mode));
+  }
+}
+
+// Where the elements of an accessor are found in the buffers of a file
+struct GltfAccessor {
+  uint32_t buffer;            // index into GltfFile::buffers
+  int32_t view;               // buffer view, -1 for accessors without data
+  size_t offset;              // of the first element, from the start of the buffer
+  size_t count;               // number of elements
+  uint32_t stride;            // bytes between elements
+  uint32_t element_size;      // bytes of one element
+  bool interleaved;           // the buffer view has a byteStride
+  uint32_t component_type;
+  uint32_t components;
+  bool normalized;
+
+  // bytes from the first byte of the first element to the last byte of the last
+  size_t extent() const
+  {
+    return this->count ? (this->count - 1) * this->stride + this->element_size : 0;
+  }
+};
+
+// Decoded 8 bit RGBA pixels of a PNG or JPEG image, with a single mip level
+class GltfTextureImage : public VulkanTextureImage {
+public:
+  NO_COPY_OR_ASSIGNMENT(GltfTextureImage)
+  GltfTextureImage() = delete;
+  virtual ~GltfTextureImage() = default;
+
+  GltfTextureImage(const unsigned char * encoded, size_t size, const std::string & name)
+  {
+    int width, height, channels;
+    stbi_uc * pixels = stbi_load_from_memory(encoded, static_cast<int>(size), &width, &height, &channels, 4);
+    if (!pixels) {
+      throw std::runtime_error("GltfTextureImage: could not decode " + name + ": " + stbi_failure_reason());
+    }
+    this->width = static_cast<uint32_t>(width);
+    this->height = static_cast<uint32_t>(height);
+    this->pixels.assign(pixels, pixels + size_t(width) * size_t(height) * 4);
+    stbi_image_free(pixels);
+  }
+
+  VkExtent3D extent(size_t) const override
+  {
+    return { this->width, this->height, 1 };
+  }
+
+  uint32_t base_level() const override { return 0; }
+  uint32_t levels() const override { return 1; }
+  uint32_t base_layer() const override { return 0; }
+  uint32_t layers() const override { return 1; }
+
+  size_t size() const override
+  {
+    return this->pixels.size();
+  }
+
+  size_t size(size_t) const override
+  {
+    return this->pixels.size();
+  }
+
+  const unsigned char * data() const override
+  {
+    return this->pixels.data();
+  }
+
+  VkFormat format() const override
+  {
+    return VK_FORMAT_R8G8B8A8_UNORM;
+  }
+
+  VkImageType image_type() const override
+  {
+    return VK_IMAGE_TYPE_2D;
+  }
+
+  VkImageViewType image_view_type() const override
+  {
+    return VK_IMAGE_VIEW_TYPE_2D;
+  }
+
+  VkImageSubresourceRange subresource_range() const override
+  {
+    return {
+      VK_IMAGE_ASPECT_COLOR_BIT,  // aspectMask
+      0,                          // baseMipLevel
+      1,                          // levelCount
+      0,                          // baseArrayLayer
+      1                           // layerCount
+    };
+  }
+
+private:
+  uint32_t width{ 0 };
+  uint32_t height{ 0 };
+  std::vector<unsigned char> pixels;
+};
+
+// A glTF 2.0 asset, either a binary .glb file or a .gltf file with external
+// buffers. All buffers are memory mapped; the binary chunk of a .glb file is
+// used in place, so accessor data is read straight out of the mapping.
+class GltfFile {
+public:
+  NO_COPY_OR_ASSIGNMENT(GltfFile)
+  GltfFile() = delete;
+  ~GltfFile() = default;
+
+  struct Buffer {
+    const char * data;
+    size_t size;
+  };
+
+  explicit GltfFile(const std::string & filename) :
+    filename(filename),
+    directory(fs::path(filename).parent_path())
+  {
+    this->files.push_back(std::make_unique<MappedFile>(filename));
+    const MappedFile & file = *this->files.front();
+
+    Buffer binary{ nullptr, 0 };
+    std::string_view text(file.data(), file.size());
+
+    uint32_t header[3];
+    if (file.size() >= sizeof(header)) {
+      std::memcpy(header, file.data(), sizeof(header));
+    }
+    if (file.size() >= sizeof(header) && header[0] == glb_magic) {
+      if (header[1] != 2) {
+        throw std::runtime_error("GltfFile: " + filename + " has unsupported version " + std::to_string(header[1]));
+      }
+      const size_t length = std::min<size_t>(header[2], file.size());
+      size_t offset = sizeof(header);
+      text = std::string_view();
+
+      // a JSON chunk followed by an optional binary chunk
+      while (offset + 8 <= length) {
+        uint32_t chunk[2];
+        std::memcpy(chunk, file.data() + offset, sizeof(chunk));
+        offset += sizeof(chunk);
+        if (chunk[0] > length - offset) {
+          throw std::runtime_error("GltfFile: " + filename + " has a truncated chunk");
+        }
+        if (chunk[1] == glb_json_chunk && text.empty()) {
+          text = std::string_view(file.data() + offset, chunk[0]);
+        }
+        else if (chunk[1] == glb_binary_chunk && !binary.data) {
+          binary = { file.data() + offset, chunk[0] };
+        }
+        offset += (size_t(chunk[0]) + 3) & ~size_t(3);
+      }
+      if (text.empty()) {
+        throw std::runtime_error("GltfFile: " + filename + " has no JSON chunk");
+      }
+    }
+
+    this->json = JsonParser::parse(text);
+    if (this->json["asset"]["version"].string().compare(0, 2, "2.") != 0) {
+      throw std::runtime_error("GltfFile: " + filename + " is not a glTF 2.0 file");
+    }
+
+    const JsonValue & buffers = this->json["buffers"];
+    for (size_t i = 0; i < buffers.size(); i++) {
+      const JsonValue & buffer = buffers[i];
+      const size_t length = static_cast<size_t>(buffer["byteLength"].number());
+      if (!buffer.has("uri")) {
+        // the first buffer of a .glb file without uri is its binary chunk
+        if (i != 0 || !binary.data || binary.size < length) {
+          throw std::runtime_error("GltfFile: " + filename + " has a buffer without data");
+        }
+        this->buffers.push_back({ binary.data, length });
+        continue;
+      }
+      const std::string & uri = buffer["uri"].string();
+      if (uri.compare(0, 5, "data:") == 0) {
+        throw std::runtime_error("GltfFile: " + filename + " embeds a buffer as a data URI, which is not supported");
+      }
+      this->files.push_back(std::make_unique<MappedFile>((this->directory / uri).string()));
+      if (this->files.back()->size() < length) {
+        throw std::runtime_error("GltfFile: " + uri + " is smaller than its byteLength");
+      }
+      this->buffers.push_back({ this->files.back()->data(), length });
+    }
+  }
+
+  GltfAccessor accessor(size_t index) const
+  {
+    const JsonValue & accessor = this->json["accessors"][index];
+    if (!accessor.is_object()) {
+      throw std::runtime_error("GltfFile: accessor " + std::to_string(index) + " does not exist");
+    }
+    if (accessor.has("sparse")) {
+      throw std::runtime_error("GltfFile: sparse accessors are not supported");
+    }
+
+    GltfAccessor result{};
+    result.view = -1;
+    result.count = static_cast<size_t>(accessor["count"].number());
+    result.component_type = static_cast<uint32_t>(accessor["componentType"].number());
+    result.components = gltf_component_count(accessor["type"].string());
+    result.normalized = accessor["normalized"].boolean(false);
+    result.element_size = gltf_component_size(result.component_type) * result.components;
+    result.stride = result.element_size;
+    if (!accessor.has("bufferView")) {
+      return result;
+    }
+
+    result.view = static_cast<int32_t>(accessor["bufferView"].number());
+    const JsonValue & view = this->json["bufferViews"][static_cast<size_t>(result.view)];
+    result.buffer = static_cast<uint32_t>(view["buffer"].number());
+    if (result.buffer >= this->buffers.size()) {
+      throw std::runtime_error("GltfFile: buffer view " + std::to_string(result.view) + " has no buffer");
+    }
+    result.interleaved = view.has("byteStride");
+    if (result.interleaved) {
+      result.stride = static_cast<uint32_t>(view["byteStride"].number());
+    }
+
+    const size_t view_offset = static_cast<size_t>(view["byteOffset"].number(0));
+    const size_t view_length = static_cast<size_t>(view["byteLength"].number());
+    const size_t offset = static_cast<size_t>(accessor["byteOffset"].number(0));
+    result.offset = view_offset + offset;
+
+    if (view_offset + view_length > this->buffers[result.buffer].size ||
+        offset + result.extent() > view_length) {
+      throw std::runtime_error("GltfFile: accessor " + std::to_string(index) + " is outside its buffer");
+    }
+    return result;
+  }
+
+  const char * data(const GltfAccessor & accessor) const
+  {
+    return this->buffers[accessor.buffer].data + accessor.offset;
+  }
+
+  // Decodes the images of the given indices on the shared thread pool, and
+  // returns all images, with nullptr for those not decoded. Images in buffer
+  // views and external PNG and JPEG files are decoded here, other external
+  // images, such as KTX files, through the VulkanImageFactory.
+  std::vector<std::shared_ptr<VulkanTextureImage>> decode_images(const std::vector<size_t> & indices) const
+  {
+    const JsonValue & images = this->json["images"];
+    std::vector<std::shared_ptr<VulkanTextureImage>> result(images.size());
+
+    ThreadPool::shared().parallel_for(indices.size(), 1, [&](size_t begin, size_t end) {
+      for (size_t n = begin; n < end; n++) {
+        const size_t i = indices[n];
+        if (i >= images.size()) {
+          throw std::runtime_error("GltfFile: image " + std::to_string(i) + " does not exist");
+        }
+        const JsonValue & image = images[i];
+        const std::string name = this->filename + " image " + std::to_string(i);
+
+        if (image.has("bufferView")) {
+          const JsonValue & view = this->json["bufferViews"][static_cast<size_t>(image["bufferView"].number())];
+          const size_t buffer = static_cast<size_t>(view["buffer"].number());
+          const size_t offset = static_cast<size_t>(view["byteOffset"].number(0));
+          const size_t length = static_cast<size_t>(view["byteLength"].number());
+          if (buffer >= this->buffers.size() || offset + length > this->buffers[buffer].size) {
+            throw std::runtime_error("GltfFile: " + name + " is outside its buffer");
+          }
+          const auto encoded = reinterpret_cast<const unsigned char *>(this->buffers[buffer].data + offset);
+          result[i] = std::make_shared<GltfTextureImage>(encoded, length, name);
+          continue;
+        }
+
+        const std::string & uri = image["uri"].string();
+        if (uri.empty() || uri.compare(0, 5, "data:") == 0) {
+          throw std::runtime_error("GltfFile: " + name + " has no supported source");
+        }
+        const fs::path path = this->directory / uri;
+        const std::string extension = path.extension().string();
+        if (extension == ".png" || extension == ".jpg" || extension == ".jpeg") {
+          MappedFile file(path.string());
+          result[i] = std::make_shared<GltfTextureImage>(
+            reinterpret_cast<const unsigned char *>(file.data()), file.size(), path.string());
+        }
+        else {
+          result[i] = VulkanImageFactory::Create(path.string());
+        }
+      }
+    });
+    return result;
+  }
+
+  std::string filename;
+  fs::path directory;
+  JsonValue json;
+  std::vector<Buffer> buffers;
+
+private:
+  static constexpr uint32_t glb_magic = 0x46546C67;        // "glTF"
+  static constexpr uint32_t glb_json_chunk = 0x4E4F534A;   // "JSON"
+  static constexpr uint32_t glb_binary_chunk = 0x004E4942; // "BIN"
+
+  std::vector<std::unique_ptr<MappedFile>> files;
+};
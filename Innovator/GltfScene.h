@@ -0,0 +1,386 @@
+#pragma once
+
+#include <Innovator/Nodes.h>
+#include <Innovator/Gltf.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <map>
+#include <string>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+// Expands the nodes, meshes and materials of a glTF file into separators,
+// transforms, buffers, textures and draw commands. Every primitive becomes a
+// separator of its own, so that it is culled by its bounds, with its vertex
+// streams at the locations POSITION = 0, NORMAL = 1 and TEXCOORD_0 = 2, and
+// the descriptors expected by Shaders/gltf.vert and Shaders/gltf.frag:
+// the transforms at binding 0, the base color texture at binding 1 and the
+// base color factor at binding 2. Vertex and index data is copied from the
+// memory mapped file straight into the buffers.
+class GltfScene {
+public:
+  NO_COPY_OR_ASSIGNMENT(GltfScene)
+  GltfScene() = delete;
+  ~GltfScene() = default;
+
+  explicit GltfScene(const std::string & filename) :
+    file(std::make_shared<GltfFile>(filename)),
+    images(file->decode_images(base_color_images(*file)))
+  {}
+
+  // the default scene, or all root nodes if the file has no scenes
+  std::shared_ptr<Node> root()
+  {
+    const JsonValue & json = this->file->json;
+    const JsonValue & nodes = json["nodes"];
+
+    std::vector<size_t> roots;
+    if (json["scenes"].size()) {
+      const JsonValue & scene = json["scenes"][static_cast<size_t>(json["scene"].number(0))];
+      for (size_t i = 0; i < scene["nodes"].size(); i++) {
+        roots.push_back(static_cast<size_t>(scene["nodes"][i].number()));
+      }
+    }
+    else {
+      std::vector<bool> is_child(nodes.size(), false);
+      for (size_t i = 0; i < nodes.size(); i++) {
+        for (size_t c = 0; c < nodes[i]["children"].size(); c++) {
+          is_child.at(static_cast<size_t>(nodes[i]["children"][c].number())) = true;
+        }
+      }
+      for (size_t i = 0; i < nodes.size(); i++) {
+        if (!is_child[i]) {
+          roots.push_back(i);
+        }
+      }
+    }
+
+    std::vector<std::shared_ptr<Node>> children;
+    for (size_t index : roots) {
+      children.push_back(this->node(index, 0));
+    }
+    return std::make_shared<Separator>(children);
+  }
+
+private:
+  std::shared_ptr<Node> node(size_t index, size_t depth)
+  {
+    const JsonValue & nodes = this->file->json["nodes"];
+    if (index >= nodes.size()) {
+      throw std::runtime_error("GltfScene: node " + std::to_string(index) + " does not exist");
+    }
+    if (depth > nodes.size()) {
+      throw std::runtime_error("GltfScene: the node hierarchy has a cycle");
+    }
+    const JsonValue & node = nodes[index];
+
+    std::vector<std::shared_ptr<Node>> children;
+    const glm::dmat4 matrix = this->matrix(node);
+    if (matrix != glm::dmat4(1.0)) {
+      children.push_back(std::make_shared<Transform>(matrix));
+    }
+
+    if (node.has("mesh")) {
+      const JsonValue & mesh = this->file->json["meshes"][static_cast<size_t>(node["mesh"].number())];
+      for (size_t i = 0; i < mesh["primitives"].size(); i++) {
+        auto primitive = this->primitive(mesh["primitives"][i]);
+        if (primitive) {
+          children.push_back(primitive);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < node["children"].size(); i++) {
+      children.push_back(this->node(static_cast<size_t>(node["children"][i].number()), depth + 1));
+    }
+    return std::make_shared<Separator>(children);
+  }
+
+  glm::dmat4 matrix(const JsonValue & node) const
+  {
+    glm::dmat4 matrix(1.0);
+    if (node.has("matrix")) {
+      const JsonValue & m = node["matrix"];
+      for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+          matrix[column][row] = m[column * 4 + row].number(column == row ? 1.0 : 0.0);
+        }
+      }
+      return matrix;
+    }
+    const JsonValue & t = node["translation"];
+    const JsonValue & r = node["rotation"];
+    const JsonValue & s = node["scale"];
+
+    const glm::dvec3 translation(t[0].number(0), t[1].number(0), t[2].number(0));
+    const glm::dquat rotation(r[3].number(1), r[0].number(0), r[1].number(0), r[2].number(0));
+    const glm::dvec3 scale(s[0].number(1), s[1].number(1), s[2].number(1));
+
+    matrix = glm::translate(matrix, translation);
+    matrix *= glm::mat4_cast(rotation);
+    return glm::scale(matrix, scale);
+  }
+
+  // The vertex streams, indices, material and draw command of a primitive,
+  // or nullptr for primitives without positions
+  std::shared_ptr<Node> primitive(const JsonValue & primitive)
+  {
+    const JsonValue & attributes = primitive["attributes"];
+    if (!attributes.has("POSITION")) {
+      return nullptr;
+    }
+
+    // attributes interleaved in one buffer view are copied to one buffer,
+    // the others get a buffer each
+    struct Stream {
+      GltfAccessor first;
+      size_t begin;
+      size_t end;
+      std::vector<std::pair<uint32_t, GltfAccessor>> attributes;
+    };
+    std::map<int64_t, Stream> streams;
+
+    static const std::pair<const char *, uint32_t> semantics[] = {
+      { "POSITION", 0 },
+      { "NORMAL", 1 },
+      { "TEXCOORD_0", 2 },
+    };
+    bool has_normals = false;
+    bool has_texcoords = false;
+    for (auto & semantic : semantics) {
+      if (!attributes.has(semantic.first)) {
+        continue;
+      }
+      const GltfAccessor accessor = this->file->accessor(static_cast<size_t>(attributes[semantic.first].number()));
+      if (accessor.view < 0) {
+        if (semantic.second == 0) {
+          return nullptr;
+        }
+        continue;
+      }
+      has_normals |= semantic.second == 1;
+      has_texcoords |= semantic.second == 2;
+
+      const int64_t key = accessor.interleaved ? accessor.view : -1 - int64_t(semantic.second);
+      auto it = streams.find(key);
+      if (it == streams.end()) {
+        it = streams.insert({ key, { accessor, accessor.offset, accessor.offset + accessor.extent(), {} } }).first;
+      }
+      Stream & stream = it->second;
+      stream.begin = std::min(stream.begin, accessor.offset);
+      stream.end = std::max(stream.end, accessor.offset + accessor.extent());
+      stream.attributes.push_back({ semantic.second, accessor });
+    }
+
+    const size_t vertex_count = this->file->accessor(static_cast<size_t>(attributes["POSITION"].number())).count;
+    if (vertex_count == 0) {
+      return nullptr;
+    }
+    std::vector<std::shared_ptr<Node>> children;
+
+    uint32_t binding = 0;
+    for (auto & it : streams) {
+      const Stream & stream = it.second;
+      auto data = std::make_shared<GltfBufferData>(this->file,
+                                                   stream.first.buffer,
+                                                   stream.begin,
+                                                   stream.end - stream.begin,
+                                                   stream.first.stride);
+      children.push_back(data);
+      children.push_back(std::make_shared<GpuMemoryBuffer>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
+      // the binding precedes its attributes, so the bounds are computed with its stride
+      children.push_back(std::make_shared<VertexInputBindingDescription>(binding, stream.first.stride, VK_VERTEX_INPUT_RATE_VERTEX));
+
+      for (auto & attribute : stream.attributes) {
+        const GltfAccessor & accessor = attribute.second;
+        const VkFormat format = gltf_vertex_format(accessor.component_type, accessor.components, accessor.normalized);
+        if (format == VK_FORMAT_UNDEFINED) {
+          throw std::runtime_error("GltfScene: unsupported vertex format in " + this->file->filename);
+        }
+        const uint32_t offset = static_cast<uint32_t>(accessor.offset - stream.begin);
+        if (attribute.first == 0) {
+          this->set_bounds(*data, attributes["POSITION"], accessor, offset);
+        }
+        children.push_back(std::make_shared<VertexInputAttributeDescription>(attribute.first, binding, format, offset));
+      }
+      binding++;
+    }
+
+    uint32_t index_count = 0;
+    if (primitive.has("indices")) {
+      const GltfAccessor indices = this->file->accessor(static_cast<size_t>(primitive["indices"].number()));
+      if (indices.view < 0 || indices.stride != indices.element_size) {
+        throw std::runtime_error("GltfScene: unsupported index accessor in " + this->file->filename);
+      }
+      index_count = static_cast<uint32_t>(indices.count);
+
+      VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+      switch (indices.component_type) {
+      case GLTF_UNSIGNED_BYTE: {
+        // 8 bit indices require an extension, widen them to 16 bits
+        const auto src = reinterpret_cast<const uint8_t *>(this->file->data(indices));
+        children.push_back(std::make_shared<InlineBufferData<uint16_t>>(std::vector<uint16_t>(src, src + indices.count)));
+        index_type = VK_INDEX_TYPE_UINT16;
+        break;
+      }
+      case GLTF_UNSIGNED_SHORT:
+      case GLTF_UNSIGNED_INT:
+        children.push_back(std::make_shared<GltfBufferData>(this->file,
+                                                            indices.buffer,
+                                                            indices.offset,
+                                                            indices.extent(),
+                                                            indices.element_size));
+        index_type = indices.component_type == GLTF_UNSIGNED_SHORT ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        break;
+      default:
+        throw std::runtime_error("GltfScene: unsupported index type in " + this->file->filename);
+      }
+      children.push_back(std::make_shared<GpuMemoryBuffer>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT));
+      children.push_back(std::make_shared<IndexBufferDescription>(index_type));
+    }
+
+    children.push_back(std::make_shared<TransformBuffer>());
+    children.push_back(std::make_shared<DescriptorSetLayoutBinding>(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT));
+
+    const bool has_texture = this->material(primitive, has_texcoords, children);
+
+    auto & shaders = this->shaders[{ has_normals, has_texture }];
+    if (!shaders.first) {
+      Shader::MacroDefinitions macros;
+      if (has_normals) {
+        macros.push_back({ "HAS_NORMALS", "1" });
+      }
+      if (has_texture) {
+        macros.push_back({ "HAS_TEXTURE", "1" });
+      }
+      shaders.first = std::make_shared<Shader>("Shaders/gltf.vert", VK_SHADER_STAGE_VERTEX_BIT, shaderc_optimization_level_performance, macros);
+      shaders.second = std::make_shared<Shader>("Shaders/gltf.frag", VK_SHADER_STAGE_FRAGMENT_BIT, shaderc_optimization_level_performance, macros);
+    }
+    children.push_back(shaders.first);
+    children.push_back(shaders.second);
+
+    const VkPrimitiveTopology topology = gltf_topology(static_cast<uint32_t>(primitive["mode"].number(4)));
+    if (primitive.has("indices")) {
+      children.push_back(std::make_shared<IndexedDrawCommand>(index_count, 1, 0, 0, 0, topology));
+    }
+    else {
+      children.push_back(std::make_shared<DrawCommand>(static_cast<uint32_t>(vertex_count), 1, 0, 0, topology));
+    }
+    return std::make_shared<Separator>(children);
+  }
+
+  // the min and max of position accessors are required, and bound the
+  // positions without reading them
+  void set_bounds(BufferData & data, const JsonValue & position, const GltfAccessor & accessor, uint32_t offset)
+  {
+    const JsonValue & json = this->file->json["accessors"][position];
+    const JsonValue & min = json["min"];
+    const JsonValue & max = json["max"];
+    if (accessor.component_type != GLTF_FLOAT || accessor.components != 3 || min.size() != 3 || max.size() != 3) {
+      return;
+    }
+    Box3 box;
+    box.extend(glm::vec3(min[0].number(), min[1].number(), min[2].number()));
+    box.extend(glm::vec3(max[0].number(), max[1].number(), max[2].number()));
+    data.set_bounds(3, offset, accessor.stride, box);
+  }
+
+  // Appends the base color of the material of a primitive, and returns
+  // whether it has a base color texture
+  bool material(const JsonValue & primitive, bool has_texcoords, std::vector<std::shared_ptr<Node>> & children)
+  {
+    const JsonValue & material = this->file->json["materials"][primitive["material"]];
+    const JsonValue & pbr = material["pbrMetallicRoughness"];
+    const JsonValue & texture_info = pbr["baseColorTexture"];
+
+    // only textures sampled with the first set of texture coordinates
+    bool has_texture = false;
+    if (has_texcoords && texture_info.has("index") && texture_info["texCoord"].number(0) == 0) {
+      const JsonValue & texture = this->file->json["textures"][static_cast<size_t>(texture_info["index"].number())];
+      const size_t source = static_cast<size_t>(texture["source"].number(0));
+      if (texture.has("source") && source < this->images.size() && this->images[source]) {
+        const JsonValue & sampler = this->file->json["samplers"][texture["sampler"]];
+        children.push_back(this->sampler(sampler));
+        children.push_back(std::make_shared<TextureImage>(this->images[source]));
+        children.push_back(std::make_shared<Image>(VK_SAMPLE_COUNT_1_BIT,
+                                                   VK_IMAGE_TILING_OPTIMAL,
+                                                   VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                   VK_SHARING_MODE_EXCLUSIVE,
+                                                   0,
+                                                   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+        children.push_back(std::make_shared<ImageView>(VK_COMPONENT_SWIZZLE_R,
+                                                       VK_COMPONENT_SWIZZLE_G,
+                                                       VK_COMPONENT_SWIZZLE_B,
+                                                       VK_COMPONENT_SWIZZLE_A));
+        children.push_back(std::make_shared<DescriptorSetLayoutBinding>(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT));
+        has_texture = true;
+      }
+    }
+
+    const JsonValue & factor = pbr["baseColorFactor"];
+    std::vector<float> base_color{
+      static_cast<float>(factor[0].number(1)),
+      static_cast<float>(factor[1].number(1)),
+      static_cast<float>(factor[2].number(1)),
+      static_cast<float>(factor[3].number(1)),
+    };
+    children.push_back(std::make_shared<InlineBufferData<float>>(base_color));
+    children.push_back(std::make_shared<CpuMemoryBuffer>(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT));
+    children.push_back(std::make_shared<DescriptorSetLayoutBinding>(2, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT));
+
+    if (material["doubleSided"].boolean(false)) {
+      children.push_back(std::make_shared<CullMode>(VK_CULL_MODE_NONE));
+    }
+    return has_texture;
+  }
+
+  // the images of the base color textures, the only ones used
+  static std::vector<size_t> base_color_images(const GltfFile & file)
+  {
+    const JsonValue & materials = file.json["materials"];
+    std::vector<size_t> indices;
+    for (size_t i = 0; i < materials.size(); i++) {
+      const JsonValue & texture_info = materials[i]["pbrMetallicRoughness"]["baseColorTexture"];
+      if (texture_info.has("index")) {
+        const JsonValue & texture = file.json["textures"][static_cast<size_t>(texture_info["index"].number())];
+        if (texture.has("source")) {
+          indices.push_back(static_cast<size_t>(texture["source"].number()));
+        }
+      }
+    }
+    std::sort(indices.begin(), indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    return indices;
+  }
+
+  static std::shared_ptr<Node> sampler(const JsonValue & sampler)
+  {
+    const auto address_mode = [](double wrap) {
+      switch (static_cast<int>(wrap)) {
+      case 33071: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+      case 33648: return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+      default: return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+      }
+    };
+    const int mag_filter = static_cast<int>(sampler["magFilter"].number(9729));
+    const int min_filter = static_cast<int>(sampler["minFilter"].number(9987));
+
+    return std::make_shared<Sampler>(
+      mag_filter == 9728 ? VK_FILTER_NEAREST : VK_FILTER_LINEAR,
+      (min_filter == 9728 || min_filter == 9984 || min_filter == 9986) ? VK_FILTER_NEAREST : VK_FILTER_LINEAR,
+      (min_filter == 9986 || min_filter == 9987) ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST,
+      address_mode(sampler["wrapS"].number(10497)),
+      address_mode(sampler["wrapT"].number(10497)),
+      VK_SAMPLER_ADDRESS_MODE_REPEAT);
+  }
+
+  std::shared_ptr<GltfFile> file;
+  std::vector<std::shared_ptr<VulkanTextureImage>> images;
+  // the shaders have no per use state, so primitives of the same kind share them
+  std::map<std::pair<bool, bool>, std::pair<std::shared_ptr<Node>, std::shared_ptr<Node>>> shaders;
+};
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <charconv>
+#include <stdexcept>
+#include <string_view>
+
+// A parsed JSON value. Lookups of missing members or elements return a null
+// value, so optional properties are read with a default, as in
+// json["byteOffset"].number(0).
+class JsonValue {
+public:
+  enum class Type { Null, Boolean, Number, String, Array, Object };
+
+  JsonValue() = default;
+  ~JsonValue() = default;
+
+  explicit JsonValue(Type type) :
+    type(type)
+  {}
+
+  bool is_null() const { return this->type == Type::Null; }
+  bool is_number() const { return this->type == Type::Number; }
+  bool is_string() const { return this->type == Type::String; }
+  bool is_array() const { return this->type == Type::Array; }
+  bool is_object() const { return this->type == Type::Object; }
+
+  bool has(const std::string & key) const
+  {
+    return this->object.find(key) != this->object.end();
+  }
+
+  const JsonValue & operator[](const std::string & key) const
+  {
+    auto it = this->object.find(key);
+    return it != this->object.end() ? it->second : null();
+  }
+
+  const JsonValue & operator[](size_t index) const
+  {
+    return index < this->array.size() ? this->array[index] : null();
+  }
+
+  // the element at an index held by another value, such as the material of
+  // a glTF primitive, or a null value if there is no such index
+  const JsonValue & operator[](const JsonValue & index) const
+  {
+    if (index.type != Type::Number || index.number_value < 0) {
+      return null();
+    }
+    return (*this)[static_cast<size_t>(index.number_value)];
+  }
+
+  // number of elements of an array, or members of an object
+  size_t size() const
+  {
+    return this->type == Type::Object ? this->object.size() : this->array.size();
+  }
+
+  double number(double fallback) const
+  {
+    return this->type == Type::Number ? this->number_value : fallback;
+  }
+
+  // a number that must be present, such as an index into another array
+  double number() const
+  {
+    if (this->type != Type::Number) {
+      throw std::runtime_error("JsonValue: expected a number");
+    }
+    return this->number_value;
+  }
+
+  // the string, or an empty string if this is not a string
+  const std::string & string() const
+  {
+    static const std::string empty;
+    return this->type == Type::String ? this->string_value : empty;
+  }
+
+  bool boolean(bool fallback) const
+  {
+    return this->type == Type::Boolean ? this->boolean_value : fallback;
+  }
+
+  static const JsonValue & null()
+  {
+    static const JsonValue value;
+    return value;
+  }
+
+  Type type{ Type::Null };
+  bool boolean_value{ false };
+  double number_value{ 0.0 };
+  std::string string_value;
+  std::vector<JsonValue> array;
+  std::map<std::string, JsonValue> object;
+};
+
+// Recursive descent parser of RFC 8259 JSON text
+class JsonParser {
+public:
+  JsonParser() = delete;
+  ~JsonParser() = default;
+
+  static JsonValue parse(std::string_view text)
+  {
+    JsonParser parser(text);
+    JsonValue value = parser.value(0);
+    parser.whitespace();
+    if (parser.pos != text.size()) {
+      parser.error("unexpected trailing characters");
+    }
+    return value;
+  }
+
+private:
+  explicit JsonParser(std::string_view text) :
+    text(text)
+  {}
+
+  static constexpr int max_depth = 256;
+
+  [[noreturn]] void error(const std::string & message) const
+  {
+    throw std::runtime_error("JsonParser: " + message + " at offset " + std::to_string(this->pos));
+  }
+
+  void whitespace()
+  {
+    while (this->pos < this->text.size()) {
+      const char c = this->text[this->pos];
+      if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+        break;
+      }
+      this->pos++;
+    }
+  }
+
+  char peek()
+  {
+    this->whitespace();
+    if (this->pos == this->text.size()) {
+      this->error("unexpected end of input");
+    }
+    return this->text[this->pos];
+  }
+
+  void expect(char c)
+  {
+    if (this->peek() != c) {
+      this->error(std::string("expected '") + c + "'");
+    }
+    this->pos++;
+  }
+
+  void literal(std::string_view word)
+  {
+    if (this->text.substr(this->pos, word.size()) != word) {
+      this->error("invalid literal");
+    }
+    this->pos += word.size();
+  }
+
+  JsonValue value(int depth)
+  {
+    if (depth > max_depth) {
+      this->error("nesting too deep");
+    }
+    JsonValue result;
+    switch (this->peek()) {
+    case '{':
+      result.type = JsonValue::Type::Object;
+      this->pos++;
+      if (this->peek() == '}') {
+        this->pos++;
+        return result;
+      }
+      while (true) {
+        if (this->peek() != '"') {
+          this->error("expected a member name");
+        }
+        std::string key = this->string();
+        this->expect(':');
+        result.object[std::move(key)] = this->value(depth + 1);
+        if (this->peek() == ',') {
+          this->pos++;
+          continue;
+        }
+        this->expect('}');
+        return result;
+      }
+    case '[':
+      result.type = JsonValue::Type::Array;
+      this->pos++;
+      if (this->peek() == ']') {
+        this->pos++;
+        return result;
+      }
+      while (true) {
+        result.array.push_back(this->value(depth + 1));
+        if (this->peek() == ',') {
+          this->pos++;
+          continue;
+        }
+        this->expect(']');
+        return result;
+      }
+    case '"':
+      result.type = JsonValue::Type::String;
+      result.string_value = this->string();
+      return result;
+    case 't':
+      this->literal("true");
+      result.type = JsonValue::Type::Boolean;
+      result.boolean_value = true;
+      return result;
+    case 'f':
+      this->literal("false");
+      result.type = JsonValue::Type::Boolean;
+      return result;
+    case 'n':
+      this->literal("null");
+      return result;
+    default:
+      result.type = JsonValue::Type::Number;
+      result.number_value = this->number();
+      return result;
+    }
+  }
+
+  double number()
+  {
+    const char * begin = this->text.data() + this->pos;
+    const char * end = this->text.data() + this->text.size();
+    // from_chars is locale independent, and a little more lenient than
+    // JSON, e.g. it accepts leading zeros
+    double value;
+    const std::from_chars_result result = std::from_chars(begin, end, value);
+    if (result.ec != std::errc() || result.ptr == begin) {
+      this->error("invalid number");
+    }
+    this->pos += static_cast<size_t>(result.ptr - begin);
+    return value;
+  }
+
+  uint32_t hex4()
+  {
+    if (this->pos + 4 > this->text.size()) {
+      this->error("truncated escape sequence");
+    }
+    uint32_t code = 0;
+    for (int i = 0; i < 4; i++) {
+      const char c = this->text[this->pos++];
+      code <<= 4;
+      if (c >= '0' && c <= '9') code |= uint32_t(c - '0');
+      else if (c >= 'a' && c <= 'f') code |= uint32_t(c - 'a' + 10);
+      else if (c >= 'A' && c <= 'F') code |= uint32_t(c - 'A' + 10);
+      else this->error("invalid escape sequence");
+    }
+    return code;
+  }
+
+  static void append_utf8(std::string & out, uint32_t code)
+  {
+    if (code < 0x80) {
+      out += static_cast<char>(code);
+    }
+    else if (code < 0x800) {
+      out += static_cast<char>(0xC0 | (code >> 6));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000) {
+      out += static_cast<char>(0xE0 | (code >> 12));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else {
+      out += static_cast<char>(0xF0 | (code >> 18));
+      out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+  }
+
+  std::string string()
+  {
+    this->expect('"');
+    std::string out;
+    while (true) {
+      if (this->pos == this->text.size()) {
+        this->error("unterminated string");
+      }
+      const char c = this->text[this->pos++];
+      if (c == '"') {
+        return out;
+      }
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (this->pos == this->text.size()) {
+        this->error("unterminated string");
+      }
+      switch (this->text[this->pos++]) {
+      case '"': out += '"'; break;
+      case '\\': out += '\\'; break;
+      case '/': out += '/'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'n': out += '\n'; break;
+      case 'r': out += '\r'; break;
+      case 't': out += '\t'; break;
+      case 'u': {
+        uint32_t code = this->hex4();
+        // characters outside the basic plane are escaped as surrogate pairs
+        if (code >= 0xD800 && code < 0xDC00 &&
+            this->text.substr(this->pos, 2) == "\\u") {
+          this->pos += 2;
+          const uint32_t low = this->hex4();
+          if (low < 0xDC00 || low >= 0xE000) {
+            this->error("invalid surrogate pair");
+          }
+          code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        }
+        append_utf8(out, code);
+        break;
+      }
+      default:
+        this->error("invalid escape sequence");
+      }
+    }
+  }
+
+  std::string_view text;
+  size_t pos{ 0 };
+};
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <Innovator/Cache.h>
+#include <Innovator/Defines.h>
+#include <Innovator/Factory.h>
+#include <Innovator/MappedFile.h>
+#include <Innovator/ThreadPool.h>
+
+#include <vulkan/vulkan.h>
+#include <basisu_transcoder.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+// Textures in KTX2 files supercompressed with Basis Universal, ETC1S or
+// UASTC. They are transcoded to the first format in a list of formats that
+// the device can sample, see VulkanImageFactory::Supports(). The levels are
+// transcoded in parallel, and so are the faces and layers of a level unless
+// the level is zstd compressed as a whole. The results
+// are kept in the texturecache directory, keyed by the contents of the file
+// and the format, so later loads of the texture only read the cache.
+class Ktx2TextureImage : public VulkanTextureImage {
+public:
+  NO_COPY_OR_ASSIGNMENT(Ktx2TextureImage)
+  Ktx2TextureImage() = delete;
+  virtual ~Ktx2TextureImage() = default;
+
+  explicit Ktx2TextureImage(const std::string & filename)
+  {
+    static const bool initialized = (basist::basisu_transcoder_init(), true);
+    (void)initialized;
+
+    MappedFile file(filename);
+    basist::ktx2_transcoder transcoder;
+    if (!transcoder.init(file.data(), static_cast<uint32_t>(file.size()))) {
+      throw std::runtime_error("Ktx2TextureImage: " + filename + " is not a Basis Universal KTX2 file");
+    }
+
+    this->width = transcoder.get_width();
+    this->height = transcoder.get_height();
+    this->level_count = std::max(transcoder.get_levels(), 1u);
+    this->layer_count = std::max(transcoder.get_layers(), 1u);
+    this->face_count = transcoder.get_faces();
+    this->array = transcoder.get_layers() > 0;
+
+    const Target & target = select(transcoder.is_etc1s(), transcoder.get_has_alpha());
+    const bool srgb = transcoder.get_dfd_transfer_func() == basist::KTX2_KHR_DF_TRANSFER_SRGB;
+    this->transcoder_format = target.format;
+    this->vkformat = srgb ? target.srgb : target.unorm;
+    this->block_width = basist::basis_get_block_width(target.format);
+    this->block_height = basist::basis_get_block_height(target.format);
+    this->block_size = basist::basis_get_bytes_per_block_or_pixel(target.format);
+
+    size_t total_size = 0;
+    for (uint32_t level = 0; level < this->level_count; level++) {
+      total_size += this->size(level);
+    }
+
+    const uint32_t version = 1;
+    uint64_t hash = fnv1a(file.data(), file.size());
+    const uint32_t key[] = {
+      version,
+      static_cast<uint32_t>(this->transcoder_format),
+      static_cast<uint32_t>(this->vkformat)
+    };
+    hash = fnv1a(key, sizeof(key), hash);
+
+    const fs::path cache_path = fs::path("texturecache") / (to_hex(hash) + ".tex");
+    this->texels = read_file(cache_path);
+    if (this->texels.size() == total_size) {
+      return;
+    }
+
+    this->texels.resize(total_size);
+    this->transcode(transcoder, filename);
+
+    try {
+      std::error_code error;
+      fs::create_directories(cache_path.parent_path(), error);
+      write_file(cache_path, this->texels);
+    }
+    catch (std::exception & e) {
+      // a cache that can not be written only costs transcoding time
+      std::cerr << e.what() << std::endl;
+    }
+  }
+
+  VkExtent3D extent(size_t level) const override
+  {
+    return {
+      std::max(this->width >> level, 1u),
+      std::max(this->height >> level, 1u),
+      1
+    };
+  }
+
+  uint32_t base_level() const override
+  {
+    return 0;
+  }
+
+  uint32_t levels() const override
+  {
+    return this->level_count;
+  }
+
+  uint32_t base_layer() const override
+  {
+    return 0;
+  }
+
+  // cube map faces are array layers, 6 per cube
+  uint32_t layers() const override
+  {
+    return this->layer_count * this->face_count;
+  }
+
+  size_t size() const override
+  {
+    return this->texels.size();
+  }
+
+  size_t size(size_t level) const override
+  {
+    const VkExtent3D extent = this->extent(level);
+    const size_t blocks_x = (extent.width + this->block_width - 1) / this->block_width;
+    const size_t blocks_y = (extent.height + this->block_height - 1) / this->block_height;
+    return blocks_x * blocks_y * this->block_size * this->layers();
+  }
+
+  const unsigned char * data() const override
+  {
+    return reinterpret_cast<const unsigned char *>(this->texels.data());
+  }
+
+  VkFormat format() const override
+  {
+    return this->vkformat;
+  }
+
+  VkExtent3D block_extent() const override
+  {
+    return { this->block_width, this->block_height, 1 };
+  }
+
+  VkImageType image_type() const override
+  {
+    return VK_IMAGE_TYPE_2D;
+  }
+
+  VkImageViewType image_view_type() const override
+  {
+    if (this->face_count == 6) {
+      return this->array ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE;
+    }
+    return this->array ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+  }
+
+  VkImageSubresourceRange subresource_range() const override
+  {
+    return {
+      VK_IMAGE_ASPECT_COLOR_BIT,  // aspectMask
+      this->base_level(),         // baseMipLevel
+      this->levels(),             // levelCount
+      this->base_layer(),         // baseArrayLayer
+      this->layers()              // layerCount
+    };
+  }
+
+private:
+  struct Target {
+    basist::transcoder_texture_format format;
+    VkFormat unorm;
+    VkFormat srgb;
+    bool alpha;
+  };
+
+  // The formats to transcode to, best first. UASTC transcodes to ASTC
+  // without loss, ETC1S to ETC1, a subset of ETC2. Uncompressed RGBA is
+  // the last resort, every device can sample it.
+  static const Target & select(bool etc1s, bool alpha)
+  {
+    using texture_format = basist::transcoder_texture_format;
+
+    static const Target uastc_targets[] = {
+      { texture_format::cTFASTC_4x4_RGBA, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, VK_FORMAT_ASTC_4x4_SRGB_BLOCK, true },
+      { texture_format::cTFBC7_RGBA, VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK, true },
+      { texture_format::cTFETC2_RGBA, VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, true },
+      { texture_format::cTFETC1_RGB, VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, false },
+      { texture_format::cTFBC3_RGBA, VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK, true },
+      { texture_format::cTFBC1_RGB, VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK, false },
+      { texture_format::cTFRGBA32, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB, true },
+    };
+
+    static const Target etc1s_targets[] = {
+      { texture_format::cTFETC1_RGB, VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK, false },
+      { texture_format::cTFETC2_RGBA, VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK, VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK, true },
+      { texture_format::cTFBC7_RGBA, VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK, true },
+      { texture_format::cTFASTC_4x4_RGBA, VK_FORMAT_ASTC_4x4_UNORM_BLOCK, VK_FORMAT_ASTC_4x4_SRGB_BLOCK, true },
+      { texture_format::cTFBC1_RGB, VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK, false },
+      { texture_format::cTFBC3_RGBA, VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK, true },
+      { texture_format::cTFRGBA32, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8G8B8A8_SRGB, true },
+    };
+
+    const Target * begin = etc1s ? std::begin(etc1s_targets) : std::begin(uastc_targets);
+    const Target * end = etc1s ? std::end(etc1s_targets) : std::end(uastc_targets);
+
+    for (const Target * target = begin; target != end - 1; target++) {
+      if ((target->alpha || !alpha) &&
+          VulkanImageFactory::Supports(target->unorm) &&
+          VulkanImageFactory::Supports(target->srgb)) {
+        return *target;
+      }
+    }
+    return *(end - 1);
+  }
+
+  // Textures are also created from tasks on the shared pool, such as the
+  // images of glTF files, which must not wait for tasks on the same pool.
+  static ThreadPool & pool()
+  {
+    static ThreadPool pool(ThreadPool::default_thread_count());
+    return pool;
+  }
+
+  void transcode(basist::ktx2_transcoder & transcoder, const std::string & filename)
+  {
+    if (!transcoder.start_transcoding()) {
+      throw std::runtime_error("Ktx2TextureImage: failed to start transcoding " + filename);
+    }
+
+    // A zstd compressed level is decompressed into the state of the first
+    // transcode of one of its images, and reused by later transcodes of the
+    // level with the same state. Such levels are one task, with one state,
+    // so that a level is decompressed once, not once per face and layer.
+    const bool zstd = static_cast<uint32_t>(transcoder.get_header().m_supercompression_scheme) == basist::KTX2_SS_ZSTANDARD;
+    const uint32_t images = this->layers();
+    const uint32_t images_per_task = zstd ? images : 1;
+    const uint32_t tasks_per_level = images / images_per_task;
+
+    pool().parallel_for(this->level_count * tasks_per_level, 1, [&](size_t begin, size_t end) {
+      for (size_t task = begin; task < end; task++) {
+        const uint32_t level = static_cast<uint32_t>(task / tasks_per_level);
+        const uint32_t first = static_cast<uint32_t>(task % tasks_per_level) * images_per_task;
+        const size_t image_size = this->size(level) / images;
+
+        // the transcoder is shared, the state of a transcode is per task
+        basist::ktx2_transcoder_state state;
+        for (uint32_t image = first; image < first + images_per_task; image++) {
+          const bool transcoded = transcoder.transcode_image_level(
+            level,
+            image / this->face_count,
+            image % this->face_count,
+            this->texels.data() + this->offset(level, image),
+            static_cast<uint32_t>(image_size / this->block_size),
+            this->transcoder_format,
+            0, 0, 0, -1, -1,
+            &state);
+
+          if (!transcoded) {
+            throw std::runtime_error("Ktx2TextureImage: failed to transcode level " + std::to_string(level) + " of " + filename);
+          }
+        }
+      }
+    });
+  }
+
+  std::vector<char> texels;
+  uint32_t width{ 0 };
+  uint32_t height{ 0 };
+  uint32_t level_count{ 1 };
+  uint32_t layer_count{ 1 };
+  uint32_t face_count{ 1 };
+  bool array{ false };
+  basist::transcoder_texture_format transcoder_format{ basist::transcoder_texture_format::cTFRGBA32 };
+  VkFormat vkformat{ VK_FORMAT_UNDEFINED };
+  uint32_t block_width{ 1 };
+  uint32_t block_height{ 1 };
+  uint32_t block_size{ 4 };
+};
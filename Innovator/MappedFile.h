@@ -0,0 +1,114 @@
+#pragma once
+
+#include <Innovator/Defines.h>
+
+#include <string>
+#include <cstddef>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Read only view of a whole file mapped into memory. Pages are read from
+// disk when they are first touched, so mapping a file is cheap regardless
+// of its size, and the contents can be decoded by several threads at once.
+class MappedFile {
+public:
+  NO_COPY_OR_ASSIGNMENT(MappedFile)
+  MappedFile() = delete;
+
+  explicit MappedFile(const std::string & filename)
+  {
+#if defined(_WIN32)
+    this->file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (this->file == INVALID_HANDLE_VALUE) {
+      throw std::runtime_error("MappedFile: could not open " + filename);
+    }
+    LARGE_INTEGER file_size;
+    GetFileSizeEx(this->file, &file_size);
+    this->mapped_size = static_cast<size_t>(file_size.QuadPart);
+    if (this->mapped_size == 0) {
+      return;
+    }
+    this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!this->mapping) {
+      CloseHandle(this->file);
+      throw std::runtime_error("MappedFile: could not map " + filename);
+    }
+    this->mapped_data = static_cast<const char *>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!this->mapped_data) {
+      CloseHandle(this->mapping);
+      CloseHandle(this->file);
+      throw std::runtime_error("MappedFile: could not map " + filename);
+    }
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+      throw std::runtime_error("MappedFile: could not open " + filename);
+    }
+    struct stat status;
+    if (fstat(fd, &status) == -1) {
+      close(fd);
+      throw std::runtime_error("MappedFile: could not stat " + filename);
+    }
+    this->mapped_size = static_cast<size_t>(status.st_size);
+    if (this->mapped_size == 0) {
+      close(fd);
+      return;
+    }
+    void * data = mmap(nullptr, this->mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (data == MAP_FAILED) {
+      throw std::runtime_error("MappedFile: could not map " + filename);
+    }
+    madvise(data, this->mapped_size, MADV_SEQUENTIAL);
+    this->mapped_data = static_cast<const char *>(data);
+#endif
+  }
+
+  ~MappedFile()
+  {
+#if defined(_WIN32)
+    if (this->mapped_data) {
+      UnmapViewOfFile(this->mapped_data);
+    }
+    if (this->mapping) {
+      CloseHandle(this->mapping);
+    }
+    CloseHandle(this->file);
+#else
+    if (this->mapped_data) {
+      munmap(const_cast<char *>(this->mapped_data), this->mapped_size);
+    }
+#endif
+  }
+
+  const char * data() const
+  {
+    return this->mapped_data;
+  }
+
+  size_t size() const
+  {
+    return this->mapped_size;
+  }
+
+private:
+#if defined(_WIN32)
+  HANDLE file{ INVALID_HANDLE_VALUE };
+  HANDLE mapping{ nullptr };
+#endif
+  const char * mapped_data{ nullptr };
+  size_t mapped_size{ 0 };
+};
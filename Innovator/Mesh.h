@@ -0,0 +1,1086 @@
+#pragma once
+
+#include <Innovator/Cache.h>
+#include <Innovator/Bounds.h>
+#include <Innovator/ThreadPool.h>
+
+#include <glm/glm.hpp>
+
+#include <queue>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <future>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <unordered_map>
+
+// Indexed triangle list
+struct Mesh {
+  std::vector<glm::vec3> positions;
+  std::vector<uint32_t> indices;
+};
+
+// Indexes a triangle soup by welding positions that are bitwise equal. The
+// positions are hashed in parallel, then inserted into an open addressing
+// table, which only compares positions whose hashes collide.
+inline Mesh index_positions(const float * data, size_t vertex_count)
+{
+  std::vector<uint64_t> hashes(vertex_count);
+  ThreadPool::shared().parallel_for(vertex_count, 1 << 16, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      hashes[i] = fnv1a(data + i * 3, 3 * sizeof(float));
+    }
+  });
+
+  size_t table_size = 1;
+  while (table_size < vertex_count * 2) {
+    table_size *= 2;
+  }
+  const uint32_t empty = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> table(table_size, empty);
+
+  Mesh mesh;
+  mesh.indices.resize(vertex_count);
+  std::vector<uint32_t> first;  // the soup vertex each position was taken from
+
+  for (size_t i = 0; i < vertex_count; i++) {
+    size_t slot = hashes[i] & (table_size - 1);
+    while (table[slot] != empty &&
+           std::memcmp(data + first[table[slot]] * 3, data + i * 3, 3 * sizeof(float)) != 0) {
+      slot = (slot + 1) & (table_size - 1);
+    }
+    if (table[slot] == empty) {
+      table[slot] = static_cast<uint32_t>(mesh.positions.size());
+      first.push_back(static_cast<uint32_t>(i));
+      mesh.positions.emplace_back(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]);
+    }
+    mesh.indices[i] = table[slot];
+  }
+  return mesh;
+}
+
+// Average cache miss ratio, the number of vertices transformed per
+// triangle with a FIFO post-transform cache of cache_size vertices. 0.5 is
+// about the best possible for large regular meshes, 3 the worst.
+inline float acmr(const std::vector<uint32_t> & indices, size_t vertex_count, size_t cache_size = 16)
+{
+  if (indices.empty()) {
+    return 0.0f;
+  }
+  std::vector<size_t> timestamp(vertex_count, 0);
+  size_t time = cache_size + 1;
+  size_t misses = 0;
+  for (uint32_t index : indices) {
+    if (time - timestamp[index] > cache_size) {
+      timestamp[index] = time++;
+      misses++;
+    }
+  }
+  return float(misses) / float(indices.size() / 3);
+}
+
+// Reorders triangles for the post-transform vertex cache (T. Forsyth,
+// Linear-Speed Vertex Cache Optimisation, 2006).
+inline std::vector<uint32_t> optimize_vertex_cache(const std::vector<uint32_t> & indices, size_t vertex_count)
+{
+  const int cache_size = 32;
+  const size_t triangle_count = indices.size() / 3;
+
+  const auto vertex_score = [](int cache_position, uint32_t remaining) {
+    if (remaining == 0) {
+      return -1.0f;
+    }
+    float score = 0.0f;
+    if (cache_position >= 0) {
+      // the vertices of the last triangle get a fixed score, so that its
+      // neighbours are not preferred over other triangles using them
+      score = cache_position < 3 ?
+        0.75f :
+        std::pow(1.0f - float(cache_position - 3) / float(cache_size - 3), 1.5f);
+    }
+    return score + 2.0f / std::sqrt(float(remaining));
+  };
+
+  // triangles of each vertex, as ranges in one array
+  std::vector<uint32_t> offsets(vertex_count + 1, 0);
+  for (uint32_t index : indices) {
+    offsets[index + 1]++;
+  }
+  for (size_t v = 0; v < vertex_count; v++) {
+    offsets[v + 1] += offsets[v];
+  }
+  std::vector<uint32_t> remaining(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++) {
+    remaining[v] = offsets[v + 1] - offsets[v];
+  }
+  std::vector<uint32_t> triangles(indices.size());
+  {
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+      triangles[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> score(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++) {
+    score[v] = vertex_score(-1, remaining[v]);
+  }
+  std::vector<float> triangle_score(triangle_count);
+  for (size_t t = 0; t < triangle_count; t++) {
+    triangle_score[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+  }
+  std::vector<uint8_t> emitted(triangle_count, 0);
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> next_cache;
+  std::vector<uint32_t> evicted;
+  size_t cursor = 0;  // triangles before cursor have all been emitted
+
+  for (size_t count = 0; count < triangle_count; count++) {
+    // the best triangle using a vertex in the cache
+    int64_t best = -1;
+    float best_score = -1.0f;
+    for (uint32_t v : cache) {
+      for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+        const uint32_t t = triangles[i];
+        if (!emitted[t] && triangle_score[t] > best_score) {
+          best = t;
+          best_score = triangle_score[t];
+        }
+      }
+    }
+    if (best < 0) {
+      while (emitted[cursor]) {
+        cursor++;
+      }
+      best = static_cast<int64_t>(cursor);
+    }
+
+    emitted[best] = 1;
+    next_cache.clear();
+    for (int k = 0; k < 3; k++) {
+      const uint32_t v = indices[best * 3 + k];
+      result.push_back(v);
+      next_cache.push_back(v);
+      remaining[v]--;
+    }
+    for (uint32_t v : cache) {
+      if (v != next_cache[0] && v != next_cache[1] && v != next_cache[2]) {
+        next_cache.push_back(v);
+      }
+    }
+    // the vertices pushed out of the cache
+    const size_t kept = std::min(next_cache.size(), size_t(cache_size));
+    evicted.assign(next_cache.begin() + kept, next_cache.end());
+    next_cache.resize(kept);
+    std::swap(cache, next_cache);
+
+    // rescore the triangles around the vertices in the cache, and the ones
+    // that just dropped out of it
+    for (uint32_t v : evicted) {
+      cache_position[v] = -1;
+    }
+    for (int i = 0; i < int(cache.size()); i++) {
+      cache_position[cache[i]] = i;
+    }
+    const auto rescore = [&](uint32_t v) {
+      const float new_score = vertex_score(cache_position[v], remaining[v]);
+      const float delta = new_score - score[v];
+      score[v] = new_score;
+      for (uint32_t i = offsets[v]; i < offsets[v + 1]; i++) {
+        triangle_score[triangles[i]] += delta;
+      }
+    };
+    for (uint32_t v : cache) {
+      rescore(v);
+    }
+    for (uint32_t v : evicted) {
+      rescore(v);
+    }
+  }
+  return result;
+}
+
+// Reorders clusters of a cache optimized triangle sequence so that the
+// outward facing ones are drawn first, which lets early depth testing
+// reject more of the others (P. Sander, D. Nehab and J. Barczak, Fast
+// Triangle Reordering for Vertex Locality and Reduced Overdraw, 2007).
+// Clusters start where the cache would miss on all three vertices, so the
+// reordering costs little vertex locality. The order is kept if the cache
+// miss ratio would grow by more than threshold.
+inline std::vector<uint32_t> optimize_overdraw(const std::vector<glm::vec3> & positions,
+                                               const std::vector<uint32_t> & indices,
+                                               float threshold = 1.05f)
+{
+  const size_t cache_size = 16;
+  std::vector<size_t> timestamp(positions.size(), 0);
+  size_t time = cache_size + 1;
+
+  std::vector<size_t> cluster_begin;
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    int misses = 0;
+    for (int k = 0; k < 3; k++) {
+      const uint32_t index = indices[i + k];
+      if (time - timestamp[index] > cache_size) {
+        timestamp[index] = time++;
+        misses++;
+      }
+    }
+    if (misses == 3 || i == 0) {
+      cluster_begin.push_back(i);
+    }
+  }
+  cluster_begin.push_back(indices.size());
+
+  glm::dvec3 mesh_center(0.0);
+  for (auto & position : positions) {
+    mesh_center = mesh_center + glm::dvec3(position);
+  }
+  mesh_center = mesh_center / double(std::max<size_t>(positions.size(), 1));
+
+  struct Cluster {
+    size_t begin;
+    size_t end;
+    double sort_key;
+  };
+  std::vector<Cluster> clusters;
+  for (size_t c = 0; c + 1 < cluster_begin.size(); c++) {
+    glm::dvec3 center(0.0);
+    glm::dvec3 normal(0.0);
+    double area = 0.0;
+    for (size_t i = cluster_begin[c]; i < cluster_begin[c + 1]; i += 3) {
+      const glm::dvec3 p0(positions[indices[i]]);
+      const glm::dvec3 p1(positions[indices[i + 1]]);
+      const glm::dvec3 p2(positions[indices[i + 2]]);
+      const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+      const double triangle_area = glm::length(cross) * 0.5;
+      center = center + (p0 + p1 + p2) * (triangle_area / 3.0);
+      normal = normal + cross;
+      area += triangle_area;
+    }
+    double sort_key = 0.0;
+    const double length = glm::length(normal);
+    if (area > 0.0 && length > 0.0) {
+      sort_key = glm::dot(center / area - mesh_center, normal / length);
+    }
+    clusters.push_back({ cluster_begin[c], cluster_begin[c + 1], sort_key });
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster & a, const Cluster & b) {
+    return a.sort_key > b.sort_key;
+  });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (auto & cluster : clusters) {
+    result.insert(result.end(), indices.begin() + cluster.begin, indices.begin() + cluster.end);
+  }
+  if (acmr(result, positions.size()) > acmr(indices, positions.size()) * threshold) {
+    return indices;
+  }
+  return result;
+}
+
+// Renumbers vertices in the order they are first used, so vertex fetches
+// follow the index buffer through memory. Returns the old index of each
+// new vertex; unused vertices are dropped.
+inline std::vector<uint32_t> optimize_vertex_fetch(std::vector<uint32_t> & indices, size_t vertex_count)
+{
+  const uint32_t unused = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> remap(vertex_count, unused);
+  std::vector<uint32_t> order;
+  for (uint32_t & index : indices) {
+    if (remap[index] == unused) {
+      remap[index] = static_cast<uint32_t>(order.size());
+      order.push_back(index);
+    }
+    index = remap[index];
+  }
+  return order;
+}
+
+// Area weighted vertex normals.
+inline std::vector<glm::vec3> smooth_normals(const std::vector<glm::vec3> & positions,
+                                             const std::vector<uint32_t> & indices)
+{
+  std::vector<glm::dvec3> sums(positions.size(), glm::dvec3(0.0));
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    const glm::dvec3 p0(positions[indices[i]]);
+    const glm::dvec3 p1(positions[indices[i + 1]]);
+    const glm::dvec3 p2(positions[indices[i + 2]]);
+    const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+    for (int k = 0; k < 3; k++) {
+      sums[indices[i + k]] = sums[indices[i + k]] + cross;
+    }
+  }
+  std::vector<glm::vec3> normals(positions.size());
+  for (size_t v = 0; v < positions.size(); v++) {
+    const double length = glm::length(sums[v]);
+    normals[v] = length > 0.0 ? glm::vec3(sums[v] / length) : glm::vec3(0.0f, 0.0f, 1.0f);
+  }
+  return normals;
+}
+
+// Symmetric 4x4 matrix measuring the sum of squared distances to a set of
+// planes (M. Garland and P. Heckbert, Surface Simplification Using Quadric
+// Error Metrics, 1997). Stores the upper triangle, row by row.
+struct Quadric {
+  double a[10]{};
+
+  static Quadric plane(const glm::dvec3 & normal, double d, double weight)
+  {
+    const double p[4] = { normal.x, normal.y, normal.z, d };
+    Quadric quadric;
+    for (int row = 0, i = 0; row < 4; row++) {
+      for (int col = row; col < 4; col++, i++) {
+        quadric.a[i] = p[row] * p[col] * weight;
+      }
+    }
+    return quadric;
+  }
+
+  Quadric & operator+=(const Quadric & other)
+  {
+    for (int i = 0; i < 10; i++) {
+      this->a[i] += other.a[i];
+    }
+    return *this;
+  }
+
+  double error(const glm::dvec3 & v) const
+  {
+    const double * q = this->a;
+    return q[0] * v.x * v.x + 2.0 * q[1] * v.x * v.y + 2.0 * q[2] * v.x * v.z + 2.0 * q[3] * v.x +
+           q[4] * v.y * v.y + 2.0 * q[5] * v.y * v.z + 2.0 * q[6] * v.y +
+           q[7] * v.z * v.z + 2.0 * q[8] * v.z +
+           q[9];
+  }
+};
+
+namespace detail {
+
+  // the area weighted plane quadrics of the triangles around each vertex,
+  // plus planes perpendicular to open edges that keep the borders in place
+  inline std::vector<Quadric> compute_quadrics(const std::vector<glm::vec3> & positions,
+                                               const std::vector<uint32_t> & indices)
+  {
+    std::vector<Quadric> quadrics(positions.size());
+    std::unordered_map<uint64_t, int> edges;
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      const glm::dvec3 p0(positions[indices[i + 0]]);
+      const glm::dvec3 p1(positions[indices[i + 1]]);
+      const glm::dvec3 p2(positions[indices[i + 2]]);
+      const glm::dvec3 cross = glm::cross(p1 - p0, p2 - p0);
+      const double length = glm::length(cross);
+      if (length == 0.0) {
+        continue;
+      }
+      const glm::dvec3 normal = cross / length;
+      const Quadric quadric = Quadric::plane(normal, -glm::dot(normal, p0), length * 0.5);
+      for (int k = 0; k < 3; k++) {
+        quadrics[indices[i + k]] += quadric;
+
+        const uint64_t a = indices[i + k];
+        const uint64_t b = indices[i + (k + 1) % 3];
+        edges[std::min(a, b) << 32 | std::max(a, b)]++;
+      }
+    }
+
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      const glm::dvec3 p0(positions[indices[i + 0]]);
+      const glm::dvec3 p1(positions[indices[i + 1]]);
+      const glm::dvec3 p2(positions[indices[i + 2]]);
+      const glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+      for (int k = 0; k < 3; k++) {
+        const uint32_t a = indices[i + k];
+        const uint32_t b = indices[i + (k + 1) % 3];
+        if (edges[uint64_t(std::min(a, b)) << 32 | std::max(a, b)] != 1) {
+          continue;
+        }
+        const glm::dvec3 pa(positions[a]);
+        const glm::dvec3 edge = glm::dvec3(positions[b]) - pa;
+        const glm::dvec3 border = glm::cross(edge, normal);
+        const double length = glm::length(border);
+        if (length == 0.0) {
+          continue;
+        }
+        const glm::dvec3 border_normal = border / length;
+        const double weight = glm::dot(edge, edge) * 1000.0;
+        const Quadric quadric = Quadric::plane(border_normal, -glm::dot(border_normal, pa), weight);
+        quadrics[a] += quadric;
+        quadrics[b] += quadric;
+      }
+    }
+    return quadrics;
+  }
+
+  // Collapses edges of a cluster of triangles until target triangles remain.
+  // Vertices are only ever moved onto other vertices, so the result indexes
+  // the same positions, and locked vertices, shared with other clusters,
+  // never move.
+  inline std::vector<uint32_t> simplify_cluster(const std::vector<glm::vec3> & positions,
+                                                const std::vector<Quadric> & quadrics,
+                                                const std::vector<uint8_t> & locked,
+                                                const std::vector<uint32_t> & triangles,
+                                                size_t target)
+  {
+    std::unordered_map<uint32_t, uint32_t> local_index;
+    std::vector<uint32_t> vertices;
+    std::vector<uint32_t> corners(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+      auto it = local_index.emplace(triangles[i], static_cast<uint32_t>(vertices.size()));
+      if (it.second) {
+        vertices.push_back(triangles[i]);
+      }
+      corners[i] = it.first->second;
+    }
+
+    const size_t vertex_count = vertices.size();
+    std::vector<Quadric> quadric(vertex_count);
+    std::vector<uint32_t> version(vertex_count, 0);
+    std::vector<uint8_t> removed(vertex_count, 0);
+    std::vector<std::vector<uint32_t>> adjacent(vertex_count);
+    for (uint32_t v = 0; v < vertex_count; v++) {
+      quadric[v] = quadrics[vertices[v]];
+    }
+    for (uint32_t i = 0; i < corners.size(); i++) {
+      adjacent[corners[i]].push_back(i / 3);
+    }
+
+    const size_t triangle_count = corners.size() / 3;
+    std::vector<uint8_t> dead(triangle_count, 0);
+    size_t alive = triangle_count;
+
+    struct Collapse {
+      double cost;
+      uint32_t from;
+      uint32_t to;
+      uint32_t from_version;
+      uint32_t to_version;
+      bool operator<(const Collapse & other) const { return this->cost > other.cost; }
+    };
+    std::priority_queue<Collapse> heap;
+
+    const auto position = [&](uint32_t v) { return glm::dvec3(positions[vertices[v]]); };
+
+    const auto push = [&](uint32_t a, uint32_t b) {
+      Quadric sum = quadric[a];
+      sum += quadric[b];
+      const bool a_locked = locked[vertices[a]] != 0;
+      const bool b_locked = locked[vertices[b]] != 0;
+      if (a_locked && b_locked) {
+        return;
+      }
+      const double to_b = a_locked ? std::numeric_limits<double>::max() : sum.error(position(b));
+      const double to_a = b_locked ? std::numeric_limits<double>::max() : sum.error(position(a));
+      if (to_b <= to_a) {
+        heap.push({ to_b, a, b, version[a], version[b] });
+      }
+      else {
+        heap.push({ to_a, b, a, version[b], version[a] });
+      }
+    };
+
+    for (size_t t = 0; t < triangle_count; t++) {
+      for (int k = 0; k < 3; k++) {
+        const uint32_t a = corners[t * 3 + k];
+        const uint32_t b = corners[t * 3 + (k + 1) % 3];
+        if (a < b) {
+          push(a, b);
+        }
+      }
+    }
+
+    // moving from onto to must not flip any of the remaining triangles
+    const auto flips = [&](uint32_t from, uint32_t to) {
+      for (uint32_t t : adjacent[from]) {
+        if (dead[t]) {
+          continue;
+        }
+        const uint32_t * c = &corners[t * 3];
+        if (c[0] == to || c[1] == to || c[2] == to) {
+          continue;
+        }
+        glm::dvec3 p[3] = { position(c[0]), position(c[1]), position(c[2]) };
+        const glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+        for (int k = 0; k < 3; k++) {
+          if (c[k] == from) {
+            p[k] = position(to);
+          }
+        }
+        const glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+        if (glm::dot(before, after) <= 0.0) {
+          return true;
+        }
+      }
+      return false;
+    };
+
+    while (alive > target && !heap.empty()) {
+      const Collapse collapse = heap.top();
+      heap.pop();
+      if (removed[collapse.from] || removed[collapse.to] ||
+          version[collapse.from] != collapse.from_version ||
+          version[collapse.to] != collapse.to_version) {
+        continue;
+      }
+      if (flips(collapse.from, collapse.to)) {
+        continue;
+      }
+
+      const uint32_t from = collapse.from;
+      const uint32_t to = collapse.to;
+      removed[from] = 1;
+      quadric[to] += quadric[from];
+      version[to]++;
+
+      for (uint32_t t : adjacent[from]) {
+        if (dead[t]) {
+          continue;
+        }
+        uint32_t * c = &corners[t * 3];
+        for (int k = 0; k < 3; k++) {
+          if (c[k] == from) {
+            c[k] = to;
+          }
+        }
+        if (c[0] == c[1] || c[1] == c[2] || c[2] == c[0]) {
+          dead[t] = 1;
+          alive--;
+        }
+        else {
+          adjacent[to].push_back(t);
+        }
+      }
+      adjacent[from].clear();
+
+      for (uint32_t t : adjacent[to]) {
+        if (dead[t]) {
+          continue;
+        }
+        for (int k = 0; k < 3; k++) {
+          const uint32_t other = corners[t * 3 + k];
+          if (other != to) {
+            push(to, other);
+          }
+        }
+      }
+    }
+
+    std::vector<uint32_t> result;
+    result.reserve(alive * 3);
+    for (size_t t = 0; t < triangle_count; t++) {
+      if (!dead[t]) {
+        for (int k = 0; k < 3; k++) {
+          result.push_back(vertices[corners[t * 3 + k]]);
+        }
+      }
+    }
+    return result;
+  }
+
+}
+
+// Reduces the triangles of an indexed mesh to about target_count. The mesh
+// is split into clusters of cells in a grid, which are simplified in
+// parallel with the vertices on the cluster borders locked. Odd passes
+// shift the grid by half a cell, so the borders of one level are
+// simplified in the next. The result indexes the same positions.
+inline std::vector<uint32_t> simplify(const std::vector<glm::vec3> & positions,
+                                      const std::vector<uint32_t> & indices,
+                                      size_t target_count,
+                                      size_t pass = 0)
+{
+  const size_t triangle_count = indices.size() / 3;
+  if (target_count >= triangle_count) {
+    return indices;
+  }
+
+  Box3 bounds;
+  for (uint32_t index : indices) {
+    bounds.extend(positions[index]);
+  }
+
+  const size_t cluster_triangles = 8192;
+  const size_t cells = std::max<size_t>(1, static_cast<size_t>(std::cbrt(double(triangle_count) / cluster_triangles)));
+  const float offset = (pass % 2) ? 0.5f : 0.0f;
+  const size_t side = cells + ((pass % 2) ? 1 : 0);
+  const glm::vec3 cell_size = glm::max((bounds.upper - bounds.lower) / float(cells), glm::vec3(1e-30f));
+
+  std::vector<std::vector<uint32_t>> clusters(side * side * side);
+  for (size_t i = 0; i < indices.size(); i += 3) {
+    const glm::vec3 centroid = (positions[indices[i]] + positions[indices[i + 1]] + positions[indices[i + 2]]) / 3.0f;
+    const glm::vec3 cell = (centroid - bounds.lower) / cell_size + offset;
+    const auto coordinate = [side](float value) {
+      return std::min(static_cast<size_t>(std::max(value, 0.0f)), side - 1);
+    };
+    auto & cluster = clusters[(coordinate(cell.z) * side + coordinate(cell.y)) * side + coordinate(cell.x)];
+    cluster.insert(cluster.end(), indices.begin() + i, indices.begin() + i + 3);
+  }
+
+  const uint32_t unused = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> owner(positions.size(), unused);
+  std::vector<uint8_t> locked(positions.size(), 0);
+  for (uint32_t c = 0; c < clusters.size(); c++) {
+    for (uint32_t index : clusters[c]) {
+      if (owner[index] != unused && owner[index] != c) {
+        locked[index] = 1;
+      }
+      owner[index] = c;
+    }
+  }
+
+  const std::vector<Quadric> quadrics = detail::compute_quadrics(positions, indices);
+  const double ratio = double(target_count) / double(triangle_count);
+
+  std::vector<std::future<std::vector<uint32_t>>> results;
+  for (auto & cluster : clusters) {
+    if (cluster.empty()) {
+      continue;
+    }
+    results.push_back(ThreadPool::shared().submit([&, ratio]() {
+      const size_t target = static_cast<size_t>(double(cluster.size() / 3) * ratio);
+      return detail::simplify_cluster(positions, quadrics, locked, cluster, target);
+    }));
+  }
+
+  // the tasks reference the clusters, so wait for every one before rethrowing
+  for (auto & result : results) {
+    result.wait();
+  }
+  std::vector<uint32_t> simplified;
+  for (auto & result : results) {
+    const std::vector<uint32_t> triangles = result.get();
+    simplified.insert(simplified.end(), triangles.begin(), triangles.end());
+  }
+  return simplified;
+}
+
+// Chain of levels of detail that share the vertices of the full mesh.
+// Level 0 is the full mesh, each next level has about ratio times the
+// triangles of the previous one. Normals are optional.
+struct MeshLevels {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<std::vector<uint32_t>> levels;
+};
+
+// Welds, reorders and renumbers a mesh for the vertex cache, overdraw and
+// vertex fetch, in that order, and reports the cache miss ratio.
+inline MeshLevels optimize_mesh(Mesh mesh, bool normals)
+{
+  const float before = acmr(mesh.indices, mesh.positions.size());
+  std::vector<uint32_t> indices = optimize_vertex_cache(mesh.indices, mesh.positions.size());
+  indices = optimize_overdraw(mesh.positions, indices);
+  const float after = acmr(indices, mesh.positions.size());
+
+  const std::vector<uint32_t> order = optimize_vertex_fetch(indices, mesh.positions.size());
+
+  MeshLevels optimized;
+  optimized.positions.reserve(order.size());
+  for (uint32_t index : order) {
+    optimized.positions.push_back(mesh.positions[index]);
+  }
+  if (normals) {
+    optimized.normals = smooth_normals(optimized.positions, indices);
+  }
+  optimized.levels.push_back(std::move(indices));
+
+  std::cout << "optimize_mesh: " << optimized.positions.size() << " vertices, "
+            << optimized.levels[0].size() / 3 << " triangles, ACMR "
+            << before << " -> " << after << std::endl;
+
+  return optimized;
+}
+
+// Optimizes the mesh with optimize_mesh, since the full mesh is the level
+// drawn up close, then simplifies it into the levels after the first.
+inline MeshLevels build_mesh_levels(Mesh mesh, size_t level_count, float ratio, bool normals = false)
+{
+  MeshLevels chain = optimize_mesh(std::move(mesh), normals);
+
+  for (size_t level = 1; level < level_count; level++) {
+    const std::vector<uint32_t> & previous = chain.levels.back();
+    const size_t target = static_cast<size_t>(double(previous.size() / 3) * ratio);
+    std::vector<uint32_t> next = simplify(chain.positions, previous, target, level);
+    if (next.empty() || next.size() >= previous.size()) {
+      break;
+    }
+    chain.levels.push_back(std::move(next));
+  }
+
+  // simplification leaves the triangles in cluster order
+  for (size_t level = 1; level < chain.levels.size(); level++) {
+    chain.levels[level] = optimize_vertex_cache(chain.levels[level], chain.positions.size());
+  }
+  return chain;
+}
+
+// Like build_mesh_levels, but keeps the generated levels in the meshcache
+// directory, keyed by the mesh and the parameters of the chain.
+inline MeshLevels load_mesh_levels(Mesh mesh, size_t level_count, float ratio, bool normals = false)
+{
+  const uint32_t version = 3;
+  uint64_t hash = fnv1a(mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3));
+  hash = fnv1a(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t), hash);
+  const uint32_t key[] = { version, static_cast<uint32_t>(level_count), normals };
+  hash = fnv1a(key, sizeof(key), hash);
+  hash = fnv1a(&ratio, sizeof(ratio), hash);
+
+  const fs::path cache_path = fs::path("meshcache") / (to_hex(hash) + ".lod");
+  const std::vector<char> cached = read_file(cache_path);
+
+  // vertex count, the optimized positions and, if requested, the normals,
+  // then the level count and the index count and indices of each level.
+  // The file is not trusted: a corrupt or stale file is rejected and the
+  // chain built again, rather than drawing indices past the vertices.
+  const size_t input_vertex_count = mesh.positions.size();
+  const auto parse = [&cached, level_count, input_vertex_count, normals](MeshLevels & chain) {
+    const char * data = cached.data();
+    const char * end = data + cached.size();
+    uint32_t vertex_count;
+    if (size_t(end - data) < sizeof(vertex_count)) {
+      return false;
+    }
+    std::memcpy(&vertex_count, data, sizeof(vertex_count));
+    data += sizeof(vertex_count);
+    // welding and reordering never adds vertices
+    const size_t vertex_size = (normals ? 2 : 1) * sizeof(glm::vec3);
+    if (vertex_count > input_vertex_count || size_t(end - data) < vertex_count * vertex_size) {
+      return false;
+    }
+    chain.positions.resize(vertex_count);
+    std::memcpy(chain.positions.data(), data, vertex_count * sizeof(glm::vec3));
+    data += vertex_count * sizeof(glm::vec3);
+    if (normals) {
+      chain.normals.resize(vertex_count);
+      std::memcpy(chain.normals.data(), data, vertex_count * sizeof(glm::vec3));
+      data += vertex_count * sizeof(glm::vec3);
+    }
+
+    uint32_t count;
+    if (size_t(end - data) < sizeof(count)) {
+      return false;
+    }
+    std::memcpy(&count, data, sizeof(count));
+    data += sizeof(count);
+    if (count == 0 || count > std::max<size_t>(level_count, 1)) {
+      return false;
+    }
+    chain.levels.resize(count);
+    for (uint32_t level = 0; level < count; level++) {
+      uint32_t index_count;
+      if (size_t(end - data) < sizeof(index_count)) {
+        return false;
+      }
+      std::memcpy(&index_count, data, sizeof(index_count));
+      data += sizeof(index_count);
+      if (size_t(end - data) < index_count * sizeof(uint32_t)) {
+        return false;
+      }
+      chain.levels[level].resize(index_count);
+      std::memcpy(chain.levels[level].data(), data, index_count * sizeof(uint32_t));
+      data += index_count * sizeof(uint32_t);
+
+      const std::vector<uint32_t> & indices = chain.levels[level];
+      if (index_count % 3 != 0 || std::any_of(indices.begin(), indices.end(), [vertex_count](uint32_t index) {
+        return index >= vertex_count;
+      })) {
+        return false;
+      }
+    }
+    return data == end;
+  };
+
+  MeshLevels cached_chain;
+  if (parse(cached_chain)) {
+    return cached_chain;
+  }
+
+  MeshLevels chain = build_mesh_levels(std::move(mesh), level_count, ratio, normals);
+
+  std::vector<char> data;
+  const auto append = [&data](const void * bytes, size_t size) {
+    data.insert(data.end(), static_cast<const char *>(bytes), static_cast<const char *>(bytes) + size);
+  };
+  const uint32_t vertex_count = static_cast<uint32_t>(chain.positions.size());
+  append(&vertex_count, sizeof(vertex_count));
+  append(chain.positions.data(), chain.positions.size() * sizeof(glm::vec3));
+  append(chain.normals.data(), chain.normals.size() * sizeof(glm::vec3));
+  const uint32_t count = static_cast<uint32_t>(chain.levels.size());
+  append(&count, sizeof(count));
+  for (size_t level = 0; level < chain.levels.size(); level++) {
+    const uint32_t index_count = static_cast<uint32_t>(chain.levels[level].size());
+    append(&index_count, sizeof(index_count));
+    append(chain.levels[level].data(), index_count * sizeof(uint32_t));
+  }
+
+  try {
+    std::error_code error;
+    fs::create_directories(cache_path.parent_path(), error);
+    write_file(cache_path, data);
+  }
+  catch (std::exception & e) {
+    // a cache that can not be written only costs simplification time
+    std::cerr << e.what() << std::endl;
+  }
+  return chain;
+}
+
+// A cluster of consecutive triangles of an index buffer, drawn as a range
+// of it, with a bounding sphere and a cone bounding the normals of its
+// triangles. The meshlet faces away from a camera at e, and can be culled,
+// if dot(center - e, cone_axis) >= cone_cutoff * length(center - e) + radius.
+// Laid out as the Meshlet struct of Shaders/meshletcull.comp (std430).
+struct Meshlet {
+  float center[3];
+  float radius;
+  float cone_axis[3];
+  float cone_cutoff;            // sine of the cone's half angle, 1 if never culled
+  uint32_t first_index;
+  uint32_t index_count;
+  uint32_t vertex_count;
+  uint32_t padding;
+};
+
+// The bounds of the triangles from index begin to end, which use vertices
+inline Meshlet meshlet_bounds(const std::vector<glm::vec3> & positions,
+                              const std::vector<uint32_t> & indices,
+                              size_t begin,
+                              size_t end,
+                              const std::vector<uint32_t> & vertices)
+{
+  Box3 box;
+  for (uint32_t vertex : vertices) {
+    box.extend(positions[vertex]);
+  }
+  const glm::vec3 center = box.center();
+  float radius = 0.0f;
+  for (uint32_t vertex : vertices) {
+    radius = std::max(radius, glm::length(positions[vertex] - center));
+  }
+
+  // the cone axis is the average direction of the triangles, degenerate
+  // triangles face no direction
+  std::vector<glm::vec3> normals;
+  glm::vec3 axis(0.0f);
+  for (size_t i = begin; i < end; i += 3) {
+    const glm::vec3 & p0 = positions[indices[i + 0]];
+    const glm::vec3 normal = glm::cross(positions[indices[i + 1]] - p0, positions[indices[i + 2]] - p0);
+    const float length = glm::length(normal);
+    if (length > 0.0f) {
+      normals.push_back(normal / length);
+      axis += normals.back();
+    }
+  }
+
+  float cutoff = 1.0f;
+  const float axis_length = glm::length(axis);
+  if (axis_length > 0.0f) {
+    axis /= axis_length;
+    float min_dot = 1.0f;
+    for (auto & normal : normals) {
+      min_dot = std::min(min_dot, glm::dot(axis, normal));
+    }
+    // a cone of 90 degrees or more faces the camera from any point
+    if (min_dot > 0.0f) {
+      cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    }
+  }
+  if (cutoff >= 1.0f) {
+    axis = glm::vec3(0.0f);
+  }
+
+  return {
+    { center.x, center.y, center.z },
+    radius,
+    { axis.x, axis.y, axis.z },
+    cutoff,
+    static_cast<uint32_t>(begin),
+    static_cast<uint32_t>(end - begin),
+    static_cast<uint32_t>(vertices.size()),
+    0
+  };
+}
+
+// Splits the triangles of an index buffer into meshlets of consecutive
+// triangles, so that the triangle order of optimize_mesh is kept, and each
+// meshlet is a range of the index buffer that the existing pipelines can
+// draw. A meshlet ends before the triangle that would exceed max_vertices
+// distinct vertices or max_triangles triangles.
+inline std::vector<Meshlet> build_meshlets(const std::vector<glm::vec3> & positions,
+                                           const std::vector<uint32_t> & indices,
+                                           size_t max_vertices = 64,
+                                           size_t max_triangles = 124)
+{
+  if (max_vertices < 3 || max_triangles < 1) {
+    throw std::invalid_argument("build_meshlets: a meshlet must hold at least one triangle");
+  }
+  for (uint32_t index : indices) {
+    if (index >= positions.size()) {
+      throw std::invalid_argument("build_meshlets: index out of range");
+    }
+  }
+
+  std::vector<Meshlet> meshlets;
+  // the number of the meshlet that last used each vertex, counting from 1
+  std::vector<uint32_t> meshlet_of(positions.size(), 0);
+  std::vector<uint32_t> vertices;
+  size_t begin = 0;
+  const size_t end = indices.size() - indices.size() % 3;
+
+  for (size_t i = 0; i < end; i += 3) {
+    uint32_t current = static_cast<uint32_t>(meshlets.size() + 1);
+    size_t added = 0;
+    for (size_t k = 0; k < 3; k++) {
+      added += meshlet_of[indices[i + k]] != current ? 1 : 0;
+    }
+    if (vertices.size() + added > max_vertices || (i - begin) / 3 == max_triangles) {
+      meshlets.push_back(meshlet_bounds(positions, indices, begin, i, vertices));
+      vertices.clear();
+      begin = i;
+      current++;
+    }
+    for (size_t k = 0; k < 3; k++) {
+      const uint32_t index = indices[i + k];
+      if (meshlet_of[index] != current) {
+        meshlet_of[index] = current;
+        vertices.push_back(index);
+      }
+    }
+  }
+  if (begin < end) {
+    meshlets.push_back(meshlet_bounds(positions, indices, begin, end, vertices));
+  }
+  return meshlets;
+}
+
+// IEEE 754 half precision, rounded to nearest even
+inline uint16_t float_to_half(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  const uint32_t exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (exponent == 0xff) {
+    // infinity, or a quiet nan
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+  const int half_exponent = int(exponent) - 127 + 15;
+  if (half_exponent >= 0x1f) {
+    return sign | 0x7c00;
+  }
+  if (half_exponent <= 0) {
+    if (half_exponent < -10) {
+      return sign;
+    }
+    // subnormal, shift in the implicit leading one
+    mantissa |= 0x800000;
+    const uint32_t shift = 14 - half_exponent;
+    uint32_t half = mantissa >> shift;
+    const uint32_t rest = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (rest > halfway || (rest == halfway && (half & 1))) {
+      half++;
+    }
+    return sign | static_cast<uint16_t>(half);
+  }
+  uint32_t half = (uint32_t(half_exponent) << 10) | (mantissa >> 13);
+  const uint32_t rest = mantissa & 0x1fff;
+  if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+    // may carry into the exponent, which rounds up to the next power of two
+    half++;
+  }
+  return sign | static_cast<uint16_t>(half);
+}
+
+// Maps a unit vector onto the octahedron, unfolded onto the [-1, 1] square
+// (Q. Meyer et al., On Floating-Point Normal Vectors, 2010).
+inline glm::vec2 octahedral_encode(const glm::vec3 & normal)
+{
+  const float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  glm::vec2 e(normal.x / sum, normal.y / sum);
+  if (normal.z < 0.0f) {
+    e = glm::vec2((1.0f - std::abs(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f),
+                  (1.0f - std::abs(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f));
+  }
+  return e;
+}
+
+// Vertex streams with positions as 16 bit unsigned normalized values
+// relative to the bounds of the mesh, 4 components for alignment, and
+// optionally octahedral normals as two 8 or 16 bit signed normalized
+// values. A position p is restored as offset + scale * p.
+struct QuantizedVertices {
+  std::vector<uint16_t> positions;
+  std::vector<uint8_t> normals;
+  uint32_t normal_bits{ 0 };
+  glm::vec3 offset{ 0.0f };
+  glm::vec3 scale{ 1.0f };
+};
+
+inline QuantizedVertices quantize_vertices(const std::vector<glm::vec3> & positions,
+                                           const std::vector<glm::vec3> & normals,
+                                           uint32_t normal_bits)
+{
+  if (normal_bits != 8 && normal_bits != 16) {
+    throw std::invalid_argument("quantize_vertices: normals take 8 or 16 bits");
+  }
+  Box3 bounds;
+  for (auto & position : positions) {
+    bounds.extend(position);
+  }
+
+  QuantizedVertices quantized;
+  if (!bounds.empty()) {
+    quantized.offset = bounds.lower;
+    quantized.scale = bounds.upper - bounds.lower;
+    for (int i = 0; i < 3; i++) {
+      if (quantized.scale[i] <= 0.0f) {
+        quantized.scale[i] = 1.0f;
+      }
+    }
+  }
+
+  const auto unorm16 = [](float value) {
+    return static_cast<uint16_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+  };
+  quantized.positions.reserve(positions.size() * 4);
+  for (auto & position : positions) {
+    for (int i = 0; i < 3; i++) {
+      quantized.positions.push_back(unorm16((position[i] - quantized.offset[i]) / quantized.scale[i]));
+    }
+    quantized.positions.push_back(65535);
+  }
+
+  if (!normals.empty()) {
+    quantized.normal_bits = normal_bits;
+    const float max = normal_bits == 8 ? 127.0f : 32767.0f;
+    quantized.normals.reserve(normals.size() * normal_bits / 4);
+    for (auto & normal : normals) {
+      const glm::vec2 e = octahedral_encode(normal);
+      for (float value : { e.x, e.y }) {
+        const long snorm = std::lround(std::min(std::max(value, -1.0f), 1.0f) * max);
+        if (normal_bits == 8) {
+          quantized.normals.push_back(static_cast<uint8_t>(static_cast<int8_t>(snorm)));
+        }
+        else {
+          const uint16_t bits = static_cast<uint16_t>(static_cast<int16_t>(snorm));
+          quantized.normals.push_back(static_cast<uint8_t>(bits & 0xff));
+          quantized.normals.push_back(static_cast<uint8_t>(bits >> 8));
+        }
+      }
+    }
+  }
+  return quantized;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <Innovator/Cache.h>
+#include <Innovator/Defines.h>
+#include <Innovator/MappedFile.h>
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// A mesh file holds a header, a table of sections and a table of vertex
+// attributes, followed by the section data. Each section starts at a
+// multiple of mesh_file_alignment, so it can be copied straight out of a
+// memory mapping into staging memory, without any parsing.
+const char mesh_file_magic[8] = { 'I', 'N', 'N', 'O', 'M', 'E', 'S', 'H' };
+const uint32_t mesh_file_version = 1;
+const uint64_t mesh_file_alignment = 64;
+
+enum class MeshFileSectionType : uint32_t {
+  Vertices = 1,           // one vertex stream, with one or more attributes
+  Indices = 2,            // the triangles of one level of detail
+  Meshlets = 3,           // the Meshlet bounds and index ranges of level 0
+  MeshletVertices = 4,    // reserved for mesh shader vertex and triangle lists
+  MeshletTriangles = 5,
+};
+
+struct MeshFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t section_count;
+  uint32_t attribute_count;
+  uint32_t level_count;
+  float bounds[6];            // lower and upper corner of the positions
+  float position_offset[3];   // positions are restored as offset + scale * p
+  float position_scale[3];
+};
+
+struct MeshFileSection {
+  uint32_t type;              // MeshFileSectionType
+  uint32_t format;            // VkIndexType of index sections
+  uint32_t stride;            // bytes per element
+  uint32_t level;             // level of detail of index sections
+  uint64_t offset;            // from the start of the file
+  uint64_t size;              // in bytes
+};
+
+struct MeshFileAttribute {
+  uint32_t location;
+  uint32_t section;           // index of the vertex section holding the attribute
+  uint32_t format;            // VkFormat
+  uint32_t offset;            // within a vertex
+};
+
+// The contents of a mesh file to be written
+struct MeshFileContents {
+  MeshFileHeader header{};
+  std::vector<MeshFileSection> sections;
+  std::vector<std::vector<char>> section_data;
+  std::vector<MeshFileAttribute> attributes;
+
+  // adds a section, returning its index
+  uint32_t add(MeshFileSectionType type, uint32_t format, uint32_t stride, uint32_t level, std::vector<char> data)
+  {
+    this->sections.push_back({ static_cast<uint32_t>(type), format, stride, level, 0, data.size() });
+    this->section_data.push_back(std::move(data));
+    return static_cast<uint32_t>(this->sections.size() - 1);
+  }
+};
+
+inline void write_mesh_file(const fs::path & path, MeshFileContents contents)
+{
+  const auto align = [](uint64_t offset) {
+    return (offset + mesh_file_alignment - 1) / mesh_file_alignment * mesh_file_alignment;
+  };
+
+  MeshFileHeader & header = contents.header;
+  std::memcpy(header.magic, mesh_file_magic, sizeof(header.magic));
+  header.version = mesh_file_version;
+  header.section_count = static_cast<uint32_t>(contents.sections.size());
+  header.attribute_count = static_cast<uint32_t>(contents.attributes.size());
+
+  uint64_t offset = sizeof(MeshFileHeader) +
+                    contents.sections.size() * sizeof(MeshFileSection) +
+                    contents.attributes.size() * sizeof(MeshFileAttribute);
+
+  for (auto & section : contents.sections) {
+    section.offset = align(offset);
+    offset = section.offset + section.size;
+  }
+
+  std::vector<char> data(offset, 0);
+  char * dst = data.data();
+  std::memcpy(dst, &header, sizeof(header));
+  dst += sizeof(header);
+  std::memcpy(dst, contents.sections.data(), contents.sections.size() * sizeof(MeshFileSection));
+  dst += contents.sections.size() * sizeof(MeshFileSection);
+  std::memcpy(dst, contents.attributes.data(), contents.attributes.size() * sizeof(MeshFileAttribute));
+
+  for (size_t i = 0; i < contents.sections.size(); i++) {
+    std::memcpy(data.data() + contents.sections[i].offset,
+                contents.section_data[i].data(),
+                contents.section_data[i].size());
+  }
+  write_file(path, data);
+}
+
+// A memory mapped mesh file
+class MeshFile {
+public:
+  NO_COPY_OR_ASSIGNMENT(MeshFile)
+  MeshFile() = delete;
+  ~MeshFile() = default;
+
+  explicit MeshFile(const std::string & filename) :
+    file(filename)
+  {
+    if (this->file.size() < sizeof(MeshFileHeader)) {
+      throw std::runtime_error("MeshFile: " + filename + " is too small to be a mesh file");
+    }
+    std::memcpy(&this->header, this->file.data(), sizeof(MeshFileHeader));
+
+    if (std::memcmp(this->header.magic, mesh_file_magic, sizeof(mesh_file_magic)) != 0) {
+      throw std::runtime_error("MeshFile: " + filename + " is not a mesh file");
+    }
+    if (this->header.version != mesh_file_version) {
+      throw std::runtime_error("MeshFile: " + filename + " has unsupported version " +
+                               std::to_string(this->header.version));
+    }
+
+    const uint64_t tables = sizeof(MeshFileHeader) +
+                            uint64_t(this->header.section_count) * sizeof(MeshFileSection) +
+                            uint64_t(this->header.attribute_count) * sizeof(MeshFileAttribute);
+    if (tables > this->file.size()) {
+      throw std::runtime_error("MeshFile: " + filename + " is truncated");
+    }
+
+    const char * src = this->file.data() + sizeof(MeshFileHeader);
+    this->sections.resize(this->header.section_count);
+    std::memcpy(this->sections.data(), src, this->sections.size() * sizeof(MeshFileSection));
+    src += this->sections.size() * sizeof(MeshFileSection);
+
+    this->attributes.resize(this->header.attribute_count);
+    std::memcpy(this->attributes.data(), src, this->attributes.size() * sizeof(MeshFileAttribute));
+
+    for (auto & section : this->sections) {
+      if (section.offset > this->file.size() || section.size > this->file.size() - section.offset) {
+        throw std::runtime_error("MeshFile: " + filename + " has a section outside the file");
+      }
+    }
+    for (auto & attribute : this->attributes) {
+      if (attribute.section >= this->sections.size()) {
+        throw std::runtime_error("MeshFile: " + filename + " has an attribute without a section");
+      }
+    }
+  }
+
+  // the section of a type and level, or nullptr
+  const MeshFileSection * find(MeshFileSectionType type, uint32_t level = 0) const
+  {
+    for (auto & section : this->sections) {
+      if (section.type == static_cast<uint32_t>(type) && section.level == level) {
+        return &section;
+      }
+    }
+    return nullptr;
+  }
+
+  const char * data(const MeshFileSection & section) const
+  {
+    return this->file.data() + section.offset;
+  }
+
+  MeshFileHeader header{};
+  std::vector<MeshFileSection> sections;
+  std::vector<MeshFileAttribute> attributes;
+
+private:
+  MappedFile file;
+};
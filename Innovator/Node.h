@@ -36,6 +36,11 @@ public:
     this->doRecord(recorder);
   }
 
+  void refresh(class RenderManager * creator)
+  {
+    this->doRefresh(creator);
+  }
+
   void render(class SceneRenderer * renderer)
   {
     this->doRender(renderer);
@@ -52,6 +57,7 @@ private:
   virtual void doStage(class RenderManager *) {}
   virtual void doPipeline(class RenderManager *) {}
   virtual void doRecord(class RenderManager *) {}
+  virtual void doRefresh(class RenderManager *) {}
   virtual void doRender(class SceneRenderer *) {}
   virtual void doPresent(class RenderManager *) {}
 };
@@ -103,6 +109,13 @@ protected:
     }
   }
 
+  void doRefresh(RenderManager * creator) override
+  {
+    for (const auto& node : this->children) {
+      node->refresh(creator);
+    }
+  }
+
   void doRender(class SceneRenderer * renderer) override
   {
     for (const auto& node : this->children) {
@@ -5,6 +5,13 @@
 #include <Innovator/Node.h>
 #include <Innovator/Defines.h>
 #include <Innovator/Factory.h>
+#include <Innovator/Cache.h>
+#include <Innovator/Bounds.h>
+#include <Innovator/MappedFile.h>
+#include <Innovator/STL.h>
+#include <Innovator/MeshFile.h>
+#include <Innovator/Gltf.h>
+#include <Innovator/ThreadPool.h>
 
 #include <vulkan/vulkan.h>
 #include <shaderc/shaderc.hpp>
@@ -12,9 +19,15 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <map>
+#include <tuple>
+#include <limits>
+#include <numeric>
+#include <cstring>
 #include <utility>
 #include <vector>
 #include <memory>
+#include <type_traits>
 #include <experimental/filesystem>
 namespace fs = std::experimental::filesystem;
 
@@ -48,6 +61,20 @@ public:
     Group(std::move(children)) 
   {}
 
+  // Height of bounds projected to the viewport, relative to the viewport
+  // height, or infinity if the camera is inside the bounding sphere.
+  static double projected_size(const Box3 & bounds, const RenderState & state)
+  {
+    const Box3 box = bounds.transform(state.ViewMatrix * state.ModelMatrix);
+    const double radius = glm::length(glm::dvec3(box.extent()));
+    const double distance = box.center().z;
+    if (distance <= radius) {
+      return std::numeric_limits<double>::infinity();
+    }
+    // ProjMatrix[1][1] is the cotangent of half the vertical field of view
+    return radius * state.ProjMatrix[1][1] / distance;
+  }
+
 protected:
   void doAlloc(RenderManager * context) override
   {
@@ -63,8 +90,35 @@ protected:
 
   void doStage(RenderManager * context) override
   {
-    StateScope<RenderManager, State> scope(context);
-    Group::doStage(context);
+    const glm::dmat4 transform = context->state.transform;
+    {
+      StateScope<RenderManager, State> scope(context);
+      context->state.bounds = Box3();
+      context->state.transform = glm::dmat4(1.0);
+
+      this->runs.clear();
+      std::vector<Box3> boxes;
+      for (size_t i = 0; i < this->children.size(); i++) {
+        const glm::dmat4 child_transform = context->state.transform;
+        this->children[i]->stage(context);
+
+        // consecutive separators are culled through a hierarchy of their
+        // bounds, in the coordinate frame of this separator
+        auto separator = dynamic_cast<Separator*>(this->children[i].get());
+        if (separator) {
+          boxes.push_back(separator->bounds.empty() ?
+                          Box3::unbounded() :
+                          separator->bounds.transform(child_transform));
+        }
+        if ((!separator || i + 1 == this->children.size()) && !boxes.empty()) {
+          const size_t end = separator ? i + 1 : i;
+          this->runs.push_back({ end - boxes.size(), end, BoxHierarchy(std::move(boxes)) });
+          boxes.clear();
+        }
+      }
+      this->bounds = context->state.bounds;
+    }
+    context->state.bounds.extend(this->bounds.transform(transform));
   }
 
   void doPipeline(RenderManager * creator) override
@@ -79,10 +133,44 @@ protected:
     Group::doRecord(recorder);
   }
 
+  void doRefresh(RenderManager * creator) override
+  {
+    StateScope<RenderManager, State> scope(creator);
+    Group::doRefresh(creator);
+  }
+
   void doRender(SceneRenderer * renderer) override
   {
     StateScope<SceneRenderer, RenderState> scope(renderer);
-    Group::doRender(renderer);
+    // only the draws are culled, compute work is independent of the view
+    if (renderer->phase != SceneRenderer::Phase::Graphics) {
+      Group::doRender(renderer);
+      return;
+    }
+
+    const Frustum frustum(renderer->state.ProjMatrix *
+                          renderer->state.ViewMatrix *
+                          renderer->state.ModelMatrix);
+
+    if (!this->bounds.empty()) {
+      if (!frustum.intersects(this->bounds)) {
+        return;
+      }
+      renderer->state.bounds = &this->bounds;
+    }
+
+    auto run = this->runs.begin();
+    for (size_t i = 0; i < this->children.size(); i++) {
+      if (run != this->runs.end() && run->begin == i) {
+        run->hierarchy.cull(frustum, [&](uint32_t index) {
+          this->children[run->begin + index]->render(renderer);
+        });
+        i = run->end - 1;
+        run++;
+        continue;
+      }
+      this->children[i]->render(renderer);
+    }
   }
 
   void doPresent(RenderManager * context) override
@@ -90,6 +178,65 @@ protected:
     StateScope<RenderManager, State> scope(context);
     Group::doPresent(context);
   }
+
+  struct SeparatorRun {
+    size_t begin;
+    size_t end;
+    BoxHierarchy hierarchy;
+  };
+
+  // bounds of the geometry below this separator, in its coordinate frame
+  Box3 bounds;
+  std::vector<SeparatorRun> runs;
+};
+
+// Renders one of its children, chosen by the projected height of its bounds
+// relative to the viewport: the first child while the bounds cover at least
+// half of the viewport, the next child down to a quarter, and so on.
+class LevelOfDetail : public Separator {
+public:
+  NO_COPY_OR_ASSIGNMENT(LevelOfDetail)
+  LevelOfDetail() = default;
+  virtual ~LevelOfDetail() = default;
+
+  explicit LevelOfDetail(std::vector<std::shared_ptr<Node>> children) :
+    Separator(std::move(children))
+  {}
+
+  size_t select(const RenderState & state) const
+  {
+    if (this->bounds.empty() || this->children.empty()) {
+      return 0;
+    }
+    double size = projected_size(this->bounds, state);
+    size_t level = 0;
+    while (level + 1 < this->children.size() && size < 0.5) {
+      size *= 2.0;
+      level++;
+    }
+    return level;
+  }
+
+protected:
+  void doStage(RenderManager * context) override
+  {
+    // The levels often share vertex data declared before this node. Without
+    // geometry of their own, the bounds staged so far are used instead.
+    const Box3 staged = context->state.bounds.transform(glm::inverse(context->state.transform));
+    Separator::doStage(context);
+    if (this->bounds.empty()) {
+      this->bounds = staged;
+    }
+  }
+
+  void doRender(SceneRenderer * renderer) override
+  {
+    if (this->children.empty()) {
+      return;
+    }
+    StateScope<SceneRenderer, RenderState> scope(renderer);
+    this->children[this->select(renderer->state)]->render(renderer);
+  }
 };
 
 
@@ -185,7 +332,16 @@ public:
     this->matrix = glm::translate(this->matrix, t);
   }
 
+  explicit Transform(const glm::dmat4 & matrix) :
+    matrix(matrix)
+  {}
+
 private:
+  void doStage(RenderManager * context) override
+  {
+    context->state.transform *= this->matrix;
+  }
+
   void doRender(SceneRenderer * renderer) override
   {
     renderer->state.ModelMatrix *= this->matrix;
@@ -194,6 +350,26 @@ private:
   glm::dmat4 matrix{ 1.0 };
 };
 
+// The transform that restores positions quantized relative to the bounds
+// of a mesh, see meshquantize. Nodes that work in the model space of the
+// mesh, such as MeshletCulling, check that they precede it.
+class DequantizeTransform : public Transform {
+public:
+  NO_COPY_OR_ASSIGNMENT(DequantizeTransform)
+  DequantizeTransform() = delete;
+  virtual ~DequantizeTransform() = default;
+
+  explicit DequantizeTransform(const glm::dvec3 & offset, const glm::dvec3 & scale) :
+    Transform(offset / scale, scale)
+  {}
+
+private:
+  void doRecord(RenderManager * recorder) override
+  {
+    recorder->state.dequantized = true;
+  }
+};
+
 class BufferData : public Node {
 public:
   NO_COPY_OR_ASSIGNMENT(BufferData)
@@ -203,11 +379,61 @@ public:
   virtual void copy(char * dst) const = 0;
   virtual size_t size() const = 0;
   virtual size_t stride() const = 0;
+
+  // copies size bytes starting at offset, used when the data is streamed
+  // through the staging buffer in chunks
+  virtual void copy(char * dst, size_t offset, size_t size) const
+  {
+    if (offset == 0 && size == this->size()) {
+      this->copy(dst);
+      return;
+    }
+    std::vector<char> data(this->size());
+    this->copy(data.data());
+    std::copy(data.begin() + offset, data.begin() + offset + size, dst);
+  }
+
   size_t count() const 
   {
     return this->size() / this->stride();
   }
 
+  // bounds of the positions of 2, 3 or 4 floats starting at offset, computed
+  // once and kept for the frustum culling of the separators using this data
+  Box3 bounds(uint32_t components, size_t offset, size_t stride)
+  {
+    const auto key = std::make_tuple(components, offset, stride);
+    auto it = this->cached_bounds.find(key);
+    if (it != this->cached_bounds.end()) {
+      return it->second;
+    }
+    const size_t position_size = components * sizeof(float);
+    const size_t count = this->size() >= offset + position_size ?
+                         (this->size() - offset - position_size) / stride + 1 : 0;
+
+    // read the positions about a megabyte at a time, so that mapped and
+    // streamed data is never held in memory all at once. compute_bounds
+    // may load four floats of the last position, hence the padding.
+    const size_t chunk_count = std::max<size_t>((1 << 20) / stride, 1);
+    std::vector<char> chunk(std::min(count, chunk_count) * stride + 4 * sizeof(float));
+
+    Box3 box;
+    for (size_t first = 0; first < count; first += chunk_count) {
+      const size_t n = std::min(count - first, chunk_count);
+      this->copy(chunk.data(), offset + first * stride, (n - 1) * stride + position_size);
+      box.extend(compute_bounds(chunk.data(), n, stride, components));
+    }
+    this->cached_bounds[key] = box;
+    return box;
+  }
+
+  // bounds known in advance, such as the min and max of a glTF accessor,
+  // which saves reading the data to compute them
+  void set_bounds(uint32_t components, size_t offset, size_t stride, const Box3 & box)
+  {
+    this->cached_bounds[std::make_tuple(components, offset, stride)] = box;
+  }
+
 private:
   void doAlloc(RenderManager * context) override
   {
@@ -224,10 +450,17 @@ private:
     context->state.bufferdata = this;
   }
 
+  void doRefresh(RenderManager * context) override
+  {
+    this->doPipeline(context);
+  }
+
   void doRecord(RenderManager * context) override
   {
     context->state.bufferdata = this;
   }
+
+  std::map<std::tuple<uint32_t, size_t, size_t>, Box3> cached_bounds;
 };
 
 template <typename T>
@@ -248,6 +481,12 @@ public:
               reinterpret_cast<T*>(dst));
   }
 
+  void copy(char * dst, size_t offset, size_t size) const override
+  {
+    const char * src = reinterpret_cast<const char*>(this->values.data());
+    std::copy(src + offset, src + offset + size, dst);
+  }
+
   size_t size() const override
   {
     return this->values.size() * sizeof(T);
@@ -261,6 +500,89 @@ public:
   std::vector<T> values;
 };
 
+// A section of a mesh file, copied straight out of its memory mapping
+class MeshFileBufferData : public BufferData {
+public:
+  NO_COPY_OR_ASSIGNMENT(MeshFileBufferData)
+  MeshFileBufferData() = delete;
+  virtual ~MeshFileBufferData() = default;
+
+  MeshFileBufferData(std::shared_ptr<MeshFile> file, const MeshFileSection & section) :
+    file(std::move(file)),
+    section(section)
+  {}
+
+  void copy(char * dst) const override
+  {
+    std::memcpy(dst, this->file->data(this->section), this->section.size);
+  }
+
+  void copy(char * dst, size_t offset, size_t size) const override
+  {
+    std::memcpy(dst, this->file->data(this->section) + offset, size);
+  }
+
+  size_t size() const override
+  {
+    return this->section.size;
+  }
+
+  size_t stride() const override
+  {
+    return this->section.stride;
+  }
+
+  std::shared_ptr<MeshFile> file;
+  MeshFileSection section;
+};
+
+// A range of a buffer of a glTF file, copied straight out of its memory mapping
+class GltfBufferData : public BufferData {
+public:
+  NO_COPY_OR_ASSIGNMENT(GltfBufferData)
+  GltfBufferData() = delete;
+  virtual ~GltfBufferData() = default;
+
+  GltfBufferData(std::shared_ptr<GltfFile> file, uint32_t buffer, size_t offset, size_t size, size_t stride) :
+    file(std::move(file)),
+    buffer(buffer),
+    offset(offset),
+    data_size(size),
+    data_stride(stride)
+  {}
+
+  void copy(char * dst) const override
+  {
+    std::memcpy(dst, this->file->buffers[this->buffer].data + this->offset, this->data_size);
+  }
+
+  void copy(char * dst, size_t offset, size_t size) const override
+  {
+    std::memcpy(dst, this->file->buffers[this->buffer].data + this->offset + offset, size);
+  }
+
+  size_t size() const override
+  {
+    return this->data_size;
+  }
+
+  size_t stride() const override
+  {
+    return this->data_stride;
+  }
+
+  std::shared_ptr<GltfFile> file;
+
+private:
+  uint32_t buffer;
+  size_t offset;
+  size_t data_size;
+  size_t data_stride;
+};
+
+// Positions of the triangles in a binary or ASCII STL file. The file is
+// memory mapped, and decoded in parallel chunks straight into the
+// destination, typically mapped staging memory.
 class STLBufferData : public BufferData {
 public:
   NO_COPY_OR_ASSIGNMENT(STLBufferData)
@@ -268,42 +590,35 @@ public:
   virtual ~STLBufferData() = default;
 
   explicit STLBufferData(std::string filename) :
-    filename(std::move(filename))
+    filename(std::move(filename)),
+    file(std::make_unique<MappedFile>(this->filename))
   {
-    std::uintmax_t file_size = fs::file_size(fs::current_path() / this->filename);
-    std::cout << "std::file_size reported size of: " << file_size << std::endl;
-
-    size_t num_triangles = (file_size - 84) / 50;
-    std::cout << "num triangles should be " << num_triangles << std::endl;
-
-    this->values_size = num_triangles * 36;
+    uint32_t num_triangles;
+    if (stl_binary_triangle_count(*this->file, num_triangles)) {
+      this->values_size = size_t(num_triangles) * 36;
+    }
+    else {
+      this->ascii_values = stl_parse_ascii(*this->file);
+      this->values_size = this->ascii_values.size() * sizeof(float);
+      this->file.reset();
+    }
   }
 
   void copy(char * dst) const override
   {
-    std::ifstream input(this->filename, std::ios::binary);
-    // header is first 80 bytes
-    char header[80];
-    input.read(header, 80);
-    std::cout << "header: " << std::string(header) << std::endl;
-
-    // num triangles is next 4 bytes after header
-    uint32_t num_triangles;
-    input.read(reinterpret_cast<char*>(&num_triangles), 4);
-    std::cout << "num triangles: " << num_triangles << std::endl;
+    this->copy(dst, 0, this->values_size);
+  }
 
-    char normal[12];
-    char attrib[2];
-    for (size_t i = 0; i < num_triangles; i++) {
-      input.read(normal, 12); // skip normal
-      input.read(dst + i * 36, 36);
-      input.read(attrib, 2);  // skip attribute
+  void copy(char * dst, size_t offset, size_t size) const override
+  {
+    if (!this->file) {
+      const char * src = reinterpret_cast<const char *>(this->ascii_values.data());
+      std::copy(src + offset, src + offset + size, dst);
+      return;
     }
+    stl_copy_binary(*this->file, dst, offset, size);
   }
 
-  std::string filename;
-  size_t values_size;
-
   size_t size() const override
   {
     return this->values_size;
@@ -313,6 +628,13 @@ public:
   {
     return sizeof(float);
   }
+
+  std::string filename;
+
+private:
+  std::unique_ptr<MappedFile> file;
+  std::vector<float> ascii_values;
+  size_t values_size{ 0 };
 };
 
 class CpuMemoryBuffer : public Node {
@@ -344,6 +666,7 @@ private:
   void doStage(RenderManager * context) override
   {
     context->state.buffer = this->buffer->buffer->buffer;
+    context->state.geometry_allocation = nullptr;
     MemoryMap memmap(this->buffer->memory.get(), context->state.bufferdata->size(), this->buffer->offset);
     context->state.bufferdata->copy(memmap.mem);
   }
@@ -351,11 +674,18 @@ private:
   void doPipeline(RenderManager * creator) override
   {
     creator->state.buffer = this->buffer->buffer->buffer;
+    creator->state.geometry_allocation = nullptr;
+  }
+
+  void doRefresh(RenderManager * creator) override
+  {
+    this->doPipeline(creator);
   }
 
   void doRecord(RenderManager * recorder) override
   {
     recorder->state.buffer = this->buffer->buffer->buffer;
+    recorder->state.geometry_allocation = nullptr;
   }
 
   VkBufferUsageFlags usage_flags;
@@ -363,6 +693,8 @@ private:
   std::shared_ptr<BufferObject> buffer{ nullptr };
 };
 
+// Static vertex and index data is sub-allocated from the geometry pool of
+// the render manager, other buffers get a buffer of their own.
 class GpuMemoryBuffer : public Node {
 public:
   NO_COPY_OR_ASSIGNMENT(GpuMemoryBuffer)
@@ -377,45 +709,100 @@ public:
 private:
   void doAlloc(RenderManager * context) override
   {
+    if (GeometryPool::poolable(this->usage_flags, this->create_flags)) {
+      this->allocation = context->geometry->allocate(this->usage_flags, context->state.bufferdata->size());
+      context->state.geometry_allocation = this->allocation.get();
+      return;
+    }
+    context->state.geometry_allocation = nullptr;
+
+    // write straight into device local memory when the host can see all of it
+    const VkMemoryPropertyFlags preferred_flags = 
+      context->device->physical_device.hasHostVisibleDeviceMemory() ?
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : 0;
+
     this->buffer = std::make_shared<BufferObject>(
       std::make_shared<VulkanBuffer>(context->device,
                                      this->create_flags,
                                      context->state.bufferdata->size(),
                                      this->usage_flags,
                                      VK_SHARING_MODE_EXCLUSIVE),
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+      preferred_flags);
 
     context->bufferobjects.push_back(this->buffer);
   }
 
   void doStage(RenderManager * context) override
   {
-    std::vector<VkBufferCopy> regions = { {
-        0,                                                   // srcOffset
-        0,                                                   // dstOffset
-        context->state.bufferdata->size(),                   // size
-    } };
+    BufferData * bufferdata = context->state.bufferdata;
+    BufferObject * buffer = this->allocation ? this->allocation->buffer.get() : this->buffer.get();
+    const VkDeviceSize buffer_offset = this->allocation ? this->allocation->offset : 0;
+    context->state.geometry_allocation = this->allocation.get();
+
+    if (buffer->host_visible()) {
+      // host writes are made visible to the device by the queue submission
+      MemoryMap memmap(buffer->memory.get(), bufferdata->size(), buffer->offset + buffer_offset);
+      bufferdata->copy(memmap.mem, 0, bufferdata->size());
+      return;
+    }
+
+    UploadQueue * upload = context->upload.get();
+    const size_t chunk_size = upload->staging->size;
+
+    // stream the data through the staging ring, one chunk at a time
+    for (size_t offset = 0; offset < bufferdata->size(); offset += chunk_size) {
+      const size_t size = std::min(chunk_size, bufferdata->size() - offset);
+      const VkDeviceSize staging_offset = upload->reserve(size);
+      bufferdata->copy(upload->staging->data(staging_offset), offset, size);
+
+      const VkBufferCopy region{
+        staging_offset,                                      // srcOffset
+        buffer_offset + offset,                              // dstOffset
+        size,                                                // size
+      };
+
+      vkCmdCopyBuffer(upload->command(),
+                      upload->staging->vkbuffer(),
+                      buffer->buffer->buffer,
+                      1, &region);
+    }
 
-    vkCmdCopyBuffer(context->command->buffer(),
-                    context->state.buffer,
-                    this->buffer->buffer->buffer,
-                    static_cast<uint32_t>(regions.size()),
-                    regions.data());
+    // the pool releases its buffers when all of their ranges are copied
+    if (this->allocation) {
+      context->geometry->stage(buffer->buffer->buffer);
+      return;
+    }
+    upload->release(buffer->buffer->buffer, VK_ACCESS_MEMORY_READ_BIT);
+    upload->acquire(context->command->buffer(), buffer->buffer->buffer, VK_ACCESS_MEMORY_READ_BIT);
   }
 
   void doPipeline(RenderManager * creator) override
   {
-    creator->state.buffer = this->buffer->buffer->buffer;
+    creator->state.buffer = this->vkbuffer();
+    creator->state.geometry_allocation = this->allocation.get();
+  }
+
+  void doRefresh(RenderManager * creator) override
+  {
+    this->doPipeline(creator);
   }
 
   void doRecord(RenderManager * recorder) override
   {
-    recorder->state.buffer = this->buffer->buffer->buffer;
+    recorder->state.buffer = this->vkbuffer();
+    recorder->state.geometry_allocation = this->allocation.get();
+  }
+
+  VkBuffer vkbuffer() const
+  {
+    return this->allocation ? this->allocation->vkbuffer() : this->buffer->buffer->buffer;
   }
 
   VkBufferUsageFlags usage_flags;
   VkBufferCreateFlags create_flags;
   std::shared_ptr<BufferObject> buffer{ nullptr };
+  std::shared_ptr<GeometryAllocation> allocation{ nullptr };
 };
 
 class TransformBuffer : public Node {
@@ -444,6 +831,12 @@ private:
   void doPipeline(RenderManager * creator) override
   {
     creator->state.buffer = this->buffer->buffer->buffer;
+    creator->state.geometry_allocation = nullptr;
+  }
+
+  void doRefresh(RenderManager * creator) override
+  {
+    this->doPipeline(creator);
   }
 
   void doRender(SceneRenderer * renderer) override
@@ -474,15 +867,47 @@ public:
 private:
   void doRecord(RenderManager * recorder) override
   {
+    // pooled indices start at their offset into the pool buffer
+    const GeometryAllocation * allocation = recorder->state.geometry_allocation;
     recorder->state.index_buffer_description = {
       this->type,
-      recorder->state.buffer
+      recorder->state.buffer,
+      allocation ? allocation->offset : 0
     };
   }
 
   VkIndexType type;
 };
 
+// Makes the current buffer the argument buffer of the indirect draw commands
+class IndirectBufferDescription : public Node {
+public:
+  NO_COPY_OR_ASSIGNMENT(IndirectBufferDescription)
+  IndirectBufferDescription() = default;
+  virtual ~IndirectBufferDescription() = default;
+
+private:
+  void doRecord(RenderManager * recorder) override
+  {
+    recorder->state.indirect_buffer = recorder->state.buffer;
+  }
+};
+
+// Makes the current buffer the draw count buffer of the indirect draw
+// commands, a single uint32_t at offset 0, e.g. written by a culling shader
+class IndirectCountBufferDescription : public Node {
+public:
+  NO_COPY_OR_ASSIGNMENT(IndirectCountBufferDescription)
+  IndirectCountBufferDescription() = default;
+  virtual ~IndirectCountBufferDescription() = default;
+
+private:
+  void doRecord(RenderManager * recorder) override
+  {
+    recorder->state.indirect_count_buffer = recorder->state.buffer;
+  }
+};
+
 class VertexInputAttributeDescription : public Node {
 public:
   NO_COPY_OR_ASSIGNMENT(VertexInputAttributeDescription)
@@ -499,6 +924,63 @@ public:
   {}
 
 private:
+  void doAlloc(RenderManager * context) override
+  {
+    // the draw commands align pooled vertex streams to their stride
+    const uint32_t binding = this->vertex_input_attribute_description.binding;
+    auto & allocations = context->state.vertex_allocations;
+    if (allocations.size() <= binding) {
+      allocations.resize(binding + 1, nullptr);
+    }
+    allocations[binding] = context->state.geometry_allocation;
+  }
+
+  void doStage(RenderManager * context) override
+  {
+    // location 0 holds the vertex positions, which bound the geometry
+    if (this->vertex_input_attribute_description.location != 0 || !context->state.bufferdata) {
+      return;
+    }
+
+    // normalized positions lie within the unit cube, which quantized
+    // positions span exactly
+    Box3 normalized;
+    switch (this->vertex_input_attribute_description.format) {
+    case VK_FORMAT_R16G16B16A16_UNORM:
+      normalized.extend(glm::vec3(0.0f));
+      normalized.extend(glm::vec3(1.0f));
+      context->state.bounds.extend(normalized.transform(context->state.transform));
+      return;
+    case VK_FORMAT_R16G16B16A16_SNORM:
+      normalized.extend(glm::vec3(-1.0f));
+      normalized.extend(glm::vec3(1.0f));
+      context->state.bounds.extend(normalized.transform(context->state.transform));
+      return;
+    default: break;
+    }
+
+    uint32_t components;
+    switch (this->vertex_input_attribute_description.format) {
+    case VK_FORMAT_R32G32_SFLOAT: components = 2; break;
+    case VK_FORMAT_R32G32B32_SFLOAT: components = 3; break;
+    case VK_FORMAT_R32G32B32A32_SFLOAT: components = 4; break;
+    default: return;
+    }
+
+    size_t stride = components * sizeof(float);
+    for (auto & binding : context->state.vertex_input_bindings) {
+      if (binding.binding == this->vertex_input_attribute_description.binding) {
+        stride = binding.stride;
+      }
+    }
+
+    const Box3 box = context->state.bufferdata->bounds(components,
+                                                       this->vertex_input_attribute_description.offset,
+                                                       stride);
+
+    context->state.bounds.extend(box.transform(context->state.transform));
+  }
+
   void doPipeline(RenderManager * creator) override
   {
     creator->state.vertex_attributes.push_back(this->vertex_input_attribute_description);
@@ -506,8 +988,22 @@ private:
 
   void doRecord(RenderManager * recorder) override
   {
-    recorder->state.vertex_attribute_buffers.push_back(recorder->state.buffer);
-    recorder->state.vertex_attribute_buffer_offsets.push_back(0);
+    // the buffers are bound to consecutive bindings starting at 0, and
+    // attributes interleaved in one binding share its buffer. Pooled
+    // streams start at their offset into the pool buffer.
+    const uint32_t binding = this->vertex_input_attribute_description.binding;
+    auto & buffers = recorder->state.vertex_attribute_buffers;
+    auto & offsets = recorder->state.vertex_attribute_buffer_offsets;
+    auto & allocations = recorder->state.vertex_allocations;
+    if (buffers.size() <= binding) {
+      buffers.resize(binding + 1, nullptr);
+      offsets.resize(binding + 1, 0);
+      allocations.resize(binding + 1, nullptr);
+    }
+    GeometryAllocation * allocation = recorder->state.geometry_allocation;
+    buffers[binding] = recorder->state.buffer;
+    offsets[binding] = allocation ? allocation->offset : 0;
+    allocations[binding] = allocation;
   }
 
   VkVertexInputAttributeDescription vertex_input_attribute_description;
@@ -528,6 +1024,24 @@ public:
   {}
 
 private:
+  void doAlloc(RenderManager * context) override
+  {
+    context->state.vertex_input_bindings.push_back({
+      this->binding,
+      this->stride,
+      this->inputRate,
+    });
+  }
+
+  void doStage(RenderManager * context) override
+  {
+    context->state.vertex_input_bindings.push_back({
+      this->binding,
+      this->stride,
+      this->inputRate,
+    });
+  }
+
   void doPipeline(RenderManager * creator) override
   {
     creator->state.vertex_input_bindings.push_back({
@@ -536,73 +1050,228 @@ private:
       this->inputRate,
     });
   }
+
+  void doRecord(RenderManager * recorder) override
+  {
+    recorder->state.vertex_input_bindings.push_back({
+      this->binding,
+      this->stride,
+      this->inputRate,
+    });
+  }
   
   uint32_t binding;
   uint32_t stride;
   VkVertexInputRate inputRate;
 };
 
-class DescriptorSetLayoutBinding : public Node {
+// Draws the geometry once for every transform in a buffer of 4x4 float
+// matrices. The matrices are instance rate vertex attributes at the binding
+// and the four locations starting at location, and the optional colors, four
+// floats per instance, at binding + 1 and location + 4, as read by
+// Shaders/instanced.vert. The draw commands that follow in the same separator
+// draw one instance per matrix. The bounds of the geometry staged before this
+// node are extended by the bounds of all the instances, so it must follow the
+// vertex positions.
+class Instances : public Group {
 public:
-  NO_COPY_OR_ASSIGNMENT(DescriptorSetLayoutBinding)
-  DescriptorSetLayoutBinding() = delete;
-  virtual ~DescriptorSetLayoutBinding() = default;
+  NO_COPY_OR_ASSIGNMENT(Instances)
+  Instances() = delete;
+  virtual ~Instances() = default;
+
+  Instances(uint32_t binding,
+            uint32_t location,
+            std::shared_ptr<BufferData> transforms,
+            std::shared_ptr<BufferData> colors = nullptr) :
+    transforms(transforms),
+    count(static_cast<uint32_t>(transforms->size() / sizeof(glm::mat4)))
+  {
+    if (location == 0) {
+      throw std::invalid_argument("Instances: location 0 holds the vertex positions");
+    }
+    if (colors && colors->size() / sizeof(glm::vec4) != this->count) {
+      throw std::invalid_argument("Instances: there must be one color per transform");
+    }
 
-  DescriptorSetLayoutBinding(uint32_t binding, 
-                             VkDescriptorType descriptorType, 
-                             VkShaderStageFlags stageFlags) :
-    binding(binding),
-    descriptorType(descriptorType),
-    stageFlags(stageFlags)
-  {}
+    this->children = {
+      transforms,
+      std::make_shared<GpuMemoryBuffer>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT),
+      std::make_shared<VertexInputBindingDescription>(binding, static_cast<uint32_t>(sizeof(glm::mat4)), VK_VERTEX_INPUT_RATE_INSTANCE),
+    };
+    for (uint32_t column = 0; column < 4; column++) {
+      this->children.push_back(std::make_shared<VertexInputAttributeDescription>(
+        location + column, binding, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(column * sizeof(glm::vec4))));
+    }
+    if (colors) {
+      this->children.push_back(colors);
+      this->children.push_back(std::make_shared<GpuMemoryBuffer>(VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT));
+      this->children.push_back(std::make_shared<VertexInputBindingDescription>(binding + 1, static_cast<uint32_t>(sizeof(glm::vec4)), VK_VERTEX_INPUT_RATE_INSTANCE));
+      this->children.push_back(std::make_shared<VertexInputAttributeDescription>(location + 4, binding + 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0));
+    }
+  }
 
 private:
-  void doPipeline(RenderManager * creator) override
+  void doStage(RenderManager * context) override
   {
-    creator->state.descriptor_pool_sizes.push_back({
-      this->descriptorType,                // type 
-      1,                                   // descriptorCount
-    });
+    const Box3 geometry = context->state.bounds;
+    Group::doStage(context);
+    if (geometry.empty()) {
+      return;
+    }
 
-    creator->state.descriptor_set_layout_bindings.push_back({
-      this->binding,
+    std::vector<glm::mat4> matrices(this->count);
+    this->transforms->copy(reinterpret_cast<char *>(matrices.data()), 0, matrices.size() * sizeof(glm::mat4));
+
+    // the instance transforms apply before the transforms of the scene
+    const glm::dmat4 & transform = context->state.transform;
+    const Box3 local = geometry.transform(glm::inverse(transform));
+    Box3 bounds = geometry;
+    for (auto & matrix : matrices) {
+      bounds.extend(local.transform(transform * glm::dmat4(matrix)));
+    }
+    context->state.bounds = bounds;
+  }
+
+  void doRecord(RenderManager * recorder) override
+  {
+    Group::doRecord(recorder);
+    recorder->state.instance_count = this->count;
+  }
+
+  std::shared_ptr<BufferData> transforms;
+  uint32_t count;
+};
+
+class DescriptorSetLayoutBinding : public Node {
+public:
+  NO_COPY_OR_ASSIGNMENT(DescriptorSetLayoutBinding)
+  DescriptorSetLayoutBinding() = delete;
+  virtual ~DescriptorSetLayoutBinding() = default;
+
+  DescriptorSetLayoutBinding(uint32_t binding, 
+                             VkDescriptorType descriptorType, 
+                             VkShaderStageFlags stageFlags) :
+    binding(binding),
+    descriptorType(descriptorType),
+    stageFlags(stageFlags)
+  {}
+
+private:
+  void doPipeline(RenderManager * creator) override
+  {
+    creator->state.descriptor_set_layout_bindings.push_back({
+      this->binding,
       this->descriptorType,
       1,
       this->stageFlags,
       nullptr,
     });
 
-    this->descriptor_image_info = {
-      creator->state.sampler,
-      creator->state.imageView,
-      creator->state.imageLayout
-    };
+    VulkanDescriptorInfo descriptor_info{};
+    if (DescriptorAllocator::isImageDescriptor(this->descriptorType)) {
+      descriptor_info.image = {
+        creator->state.sampler,                       // sampler
+        creator->state.imageView,                     // imageView
+        creator->state.imageLayout                    // imageLayout
+      };
+    }
+    else {
+      descriptor_info.buffer = {
+        creator->state.buffer,                        // buffer
+        0,                                            // offset
+        VK_WHOLE_SIZE                                 // range
+      };
+    }
+    creator->state.descriptor_infos.push_back(descriptor_info);
+  }
 
-    this->descriptor_buffer_info = {
-      creator->state.buffer,                          // buffer
-      0,                                              // offset
-      VK_WHOLE_SIZE                                   // range
-    };
-   
-    creator->state.write_descriptor_sets.push_back({
-      VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,          // sType
-      nullptr,                                         // pNext
-      nullptr,                                         // dstSet
-      this->binding,                                   // dstBinding
-      0,                                               // dstArrayElement
-      1,                                               // descriptorCount
-      this->descriptorType,                            // descriptorType
-      &this->descriptor_image_info,                    // pImageInfo
-      &this->descriptor_buffer_info,                   // pBufferInfo
-      nullptr,                                         // pTexelBufferView
-    });
+  void doRefresh(RenderManager * creator) override
+  {
+    this->doPipeline(creator);
   }
 
   uint32_t binding;
   VkDescriptorType descriptorType;
   VkShaderStageFlags stageFlags;
-  VkDescriptorImageInfo descriptor_image_info{};
-  VkDescriptorBufferInfo descriptor_buffer_info{};
+};
+
+// Specialization constants for the next Shader node, e.g. 
+// (specializationconstants (uint32 0) (uint32 128) (uint32 1) 0.5)
+class SpecializationConstants : public Node {
+public:
+  NO_COPY_OR_ASSIGNMENT(SpecializationConstants)
+  SpecializationConstants() = default;
+  virtual ~SpecializationConstants() = default;
+
+  template <typename T>
+  void add(uint32_t constant_id, T value)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "specialization constants must be trivially copyable");
+    this->map_entries.push_back({
+      constant_id,                                           // constantID
+      static_cast<uint32_t>(this->data.size()),              // offset
+      sizeof(T),                                             // size
+    });
+    const char * bytes = reinterpret_cast<const char *>(&value);
+    this->data.insert(this->data.end(), bytes, bytes + sizeof(T));
+  }
+
+private:
+  void doPipeline(RenderManager * creator) override
+  {
+    creator->state.specialization_map_entries = this->map_entries;
+    creator->state.specialization_data = this->data;
+  }
+
+  std::vector<VkSpecializationMapEntry> map_entries;
+  std::vector<char> data;
+};
+
+// resolves #include directives relative to the including file
+class ShaderIncluder : public shaderc::CompileOptions::IncluderInterface {
+public:
+  shaderc_include_result * GetInclude(const char * requested_source,
+                                      shaderc_include_type type,
+                                      const char * requesting_source,
+                                      size_t) override
+  {
+    fs::path path(requested_source);
+    if (type == shaderc_include_type_relative) {
+      path = fs::path(requesting_source).parent_path() / path;
+    }
+
+    auto include = new Include;
+    std::ifstream input(path, std::ios::in);
+    if (input) {
+      include->name = path.string();
+      include->content.assign(std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{});
+    }
+    else {
+      // an empty source name tells shaderc that content holds an error message
+      include->content = "could not open " + path.string();
+    }
+
+    include->result = {
+      include->name.c_str(),                                 // source_name
+      include->name.size(),                                  // source_name_length
+      include->content.c_str(),                              // content
+      include->content.size(),                               // content_length
+      include,                                               // user_data
+    };
+    return &include->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result * data) override
+  {
+    delete static_cast<Include *>(data->user_data);
+  }
+
+private:
+  struct Include {
+    std::string name;
+    std::string content;
+    shaderc_include_result result;
+  };
 };
 
 class Shader : public Node {
@@ -611,10 +1280,18 @@ public:
   Shader() = delete;
   virtual ~Shader() = default;
 
-  explicit Shader(std::string filename, const VkShaderStageFlagBits stage):
+  typedef std::vector<std::pair<std::string, std::string>> MacroDefinitions;
+
+  explicit Shader(std::string filename, 
+                  const VkShaderStageFlagBits stage,
+                  const shaderc_optimization_level optimization_level = shaderc_optimization_level_zero,
+                  const MacroDefinitions & macro_definitions = MacroDefinitions()):
     stage(stage)
   {
     std::ifstream input(filename, std::ios::in);
+    if (!input) {
+      throw std::runtime_error("Shader: could not open " + filename);
+    }
     std::string glsl(std::istreambuf_iterator<char>{input}, std::istreambuf_iterator<char>{});
 
     shaderc_shader_kind kind = [stage]() 
@@ -639,22 +1316,88 @@ public:
 
     shaderc::Compiler compiler;
     shaderc::CompileOptions options;
+    options.SetOptimizationLevel(optimization_level);
+    options.SetIncluder(std::make_unique<ShaderIncluder>());
+    for (auto & macro : macro_definitions) {
+      options.AddMacroDefinition(macro.first, macro.second);
+    }
+
+    // The preprocessed source has all includes resolved and all macros
+    // expanded, so together with the stage, the options and the compiler
+    // version it determines the resulting SPIR-V.
+    shaderc::PreprocessedSourceCompilationResult preprocessed = 
+      compiler.PreprocessGlsl(glsl, kind, filename.c_str(), options);
+
+    if (preprocessed.GetCompilationStatus() != shaderc_compilation_status_success) {
+      throw std::runtime_error(preprocessed.GetErrorMessage());
+    }
+
+    unsigned int spv_version, spv_revision;
+    shaderc_get_spv_version(&spv_version, &spv_revision);
+
+    uint64_t hash = fnv1a(std::string(preprocessed.cbegin(), preprocessed.cend()));
+    const uint32_t key[] = { 
+      static_cast<uint32_t>(kind), 
+      static_cast<uint32_t>(optimization_level), 
+      spv_version, 
+      spv_revision 
+    };
+    hash = fnv1a(key, sizeof(key), hash);
+
+    const fs::path cache_path = fs::path("shadercache") / (to_hex(hash) + ".spv");
+    const std::vector<char> cached = read_file(cache_path);
+
+    // a truncated or foreign file is recompiled and overwritten
+    const uint32_t spirv_magic = 0x07230203;
+    if (!cached.empty() && cached.size() % sizeof(uint32_t) == 0) {
+      this->spv.resize(cached.size() / sizeof(uint32_t));
+      std::memcpy(this->spv.data(), cached.data(), cached.size());
+      if (this->spv.front() == spirv_magic) {
+        return;
+      }
+      this->spv.clear();
+    }
+
     shaderc::SpvCompilationResult module = compiler.CompileGlslToSpv(glsl, kind, filename.c_str(), options);
 
     if (module.GetCompilationStatus() != shaderc_compilation_status_success) {
       throw std::runtime_error(module.GetErrorMessage());
     }
     this->spv = { module.cbegin(), module.cend() };
+
+    try {
+      std::error_code error;
+      fs::create_directories(cache_path.parent_path(), error);
+      const char * data = reinterpret_cast<const char *>(this->spv.data());
+      write_file(cache_path, std::vector<char>(data, data + this->spv.size() * sizeof(uint32_t)));
+    }
+    catch (std::exception & e) {
+      // a cache that can not be written only costs compile time
+      std::cerr << e.what() << std::endl;
+    }
   }
 
 private:
   void doAlloc(RenderManager * context) override
   {
-    this->shader = std::make_unique<VulkanShaderModule>(context->device, this->spv);
+    this->shader = context->registry->getShaderModule(this->spv);
   }
 
   void doPipeline(RenderManager * creator) override
   {
+    // specialization constants only apply to the shader that follows them
+    this->specialization_map_entries = std::move(creator->state.specialization_map_entries);
+    this->specialization_data = std::move(creator->state.specialization_data);
+    creator->state.specialization_map_entries.clear();
+    creator->state.specialization_data.clear();
+
+    this->specialization_info = {
+      static_cast<uint32_t>(this->specialization_map_entries.size()), // mapEntryCount
+      this->specialization_map_entries.data(),                        // pMapEntries
+      this->specialization_data.size(),                               // dataSize
+      this->specialization_data.data(),                               // pData
+    };
+
     creator->state.shader_stage_infos.push_back({
       VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, // sType 
       nullptr,                                             // pNext
@@ -662,14 +1405,18 @@ private:
       this->stage,                                         // stage
       this->shader->module,                                // module 
       "main",                                              // pName 
-      nullptr,                                             // pSpecializationInfo
+      this->specialization_map_entries.empty() ? nullptr : &this->specialization_info, // pSpecializationInfo
     });
+    creator->state.shader_modules.push_back(this->shader);
   }
 
 protected:
   std::vector<uint32_t> spv;
+  std::vector<VkSpecializationMapEntry> specialization_map_entries;
+  std::vector<char> specialization_data;
+  VkSpecializationInfo specialization_info{};
   VkShaderStageFlagBits stage;
-  std::unique_ptr<VulkanShaderModule> shader;
+  std::shared_ptr<VulkanShaderModule> shader;
 };
 
 class Sampler : public Node {
@@ -695,22 +1442,21 @@ public:
 private:
   void doAlloc(RenderManager * context) override
   {
-    this->sampler = std::make_unique<VulkanSampler>(context->device,
-                                                    this->mag_filter,
-                                                    this->min_filter,
-                                                    this->mipmap_mode,
-                                                    this->address_mode_u,
-                                                    this->address_mode_v,
-                                                    this->address_mode_w,
-                                                    this->mip_lod_bias,
-                                                    VK_FALSE,
-                                                    1.f,
-                                                    VK_FALSE,
-                                                    VK_COMPARE_OP_NEVER,
-                                                    0.f,
-                                                    0.f,
-                                                    VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
-                                                    VK_FALSE);
+    this->sampler = context->registry->getSampler(this->mag_filter,
+                                                  this->min_filter,
+                                                  this->mipmap_mode,
+                                                  this->address_mode_u,
+                                                  this->address_mode_v,
+                                                  this->address_mode_w,
+                                                  this->mip_lod_bias,
+                                                  VK_FALSE,
+                                                  1.f,
+                                                  VK_FALSE,
+                                                  VK_COMPARE_OP_NEVER,
+                                                  0.f,
+                                                  VK_LOD_CLAMP_NONE,
+                                                  VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+                                                  VK_FALSE);
   }
 
   void doPipeline(RenderManager * creator) override
@@ -718,7 +1464,12 @@ private:
     creator->state.sampler = this->sampler->sampler;
   }
 
-  std::unique_ptr<VulkanSampler> sampler;
+  void doRefresh(RenderManager * creator) override
+  {
+    this->doPipeline(creator);
+  }
+
+  std::shared_ptr<VulkanSampler> sampler;
   VkFilter mag_filter;
   VkFilter min_filter;
   VkSamplerMipmapMode mipmap_mode;
@@ -738,11 +1489,20 @@ public:
     texture(VulkanImageFactory::Create(filename))
   {}
 
+  explicit TextureImage(std::shared_ptr<VulkanTextureImage> texture) :
+    texture(std::move(texture))
+  {}
+
   void copy(char* dst) const override
   {
     std::copy(this->texture->data(), this->texture->data() + this->texture->size(), dst);
   }
 
+  void copy(char* dst, size_t offset, size_t size) const override
+  {
+    std::copy(this->texture->data() + offset, this->texture->data() + offset + size, dst);
+  }
+
   size_t size() const override
   {
     return this->texture->size();
@@ -782,49 +1542,405 @@ private:
 };
 
 
-class Image : public Node {
+// Fills the mip levels of an image, each level downsampled from the level
+// before it. Levels are blitted with a linear filter where the format
+// supports it with optimal tiling, and averaged by a compute shader
+// otherwise. Any image with room for the levels can be used, such as a
+// texture without mip levels of its own, or a color attachment after its
+// render pass.
+class MipmapGenerator {
 public:
-  NO_COPY_OR_ASSIGNMENT(Image)
-  virtual ~Image() = default;
-  Image(VkSampleCountFlagBits sample_count,
-        VkImageTiling tiling,
-        VkImageUsageFlags usage_flags,
-        VkSharingMode sharing_mode,
-        VkImageCreateFlags create_flags,
-        VkImageLayout layout) :
-    sample_count(sample_count),
-    tiling(tiling),
-    usage_flags(usage_flags),
-    sharing_mode(sharing_mode),
-    create_flags(create_flags),
-    layout(layout)
-  {}
+  NO_COPY_OR_ASSIGNMENT(MipmapGenerator)
+  MipmapGenerator() = delete;
+  ~MipmapGenerator() = default;
+
+  MipmapGenerator(RenderManager * context, VkFormat format) :
+    device(context->device),
+    format(format),
+    blit(blittable(context->device->physical_device.device, format))
+  {
+    if (this->blit) {
+      return;
+    }
+    if (!storable(context->device->physical_device.device, format)) {
+      throw std::runtime_error("MipmapGenerator: format " + std::to_string(format) + " can not be downsampled on this device");
+    }
+
+    this->shader = std::make_shared<Shader>("Shaders/mipmap.comp",
+                                            VK_SHADER_STAGE_COMPUTE_BIT,
+                                            shaderc_optimization_level_performance,
+                                            Shader::MacroDefinitions{ { "FORMAT", format_qualifier(format) } });
+    this->shader->alloc(context);
+
+    // the shader only contributes to the pipeline of this generator
+    StateScope<RenderManager, State> scope(context);
+    context->state = State();
+    this->shader->pipeline(context);
+
+    this->allocator = context->registry->getDescriptorAllocator({
+      { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+    });
+
+    this->pipeline_layout = context->registry->getPipelineLayout(
+      std::vector<VkDescriptorSetLayout>{ this->allocator->layout->layout }, {});
+
+    this->pipeline = context->registry->getComputePipeline(context->pipelinecache->cache,
+                                                           context->state.shader_stage_infos[0],
+                                                           this->pipeline_layout->layout);
+
+    this->sampler = context->registry->getSampler(VK_FILTER_NEAREST,
+                                                  VK_FILTER_NEAREST,
+                                                  VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                                                  VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                                  VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                                  VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                                  0.0f,
+                                                  VK_FALSE,
+                                                  1.0f,
+                                                  VK_FALSE,
+                                                  VK_COMPARE_OP_ALWAYS,
+                                                  0.0f,
+                                                  VK_LOD_CLAMP_NONE,
+                                                  VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+                                                  VK_FALSE);
+  }
+
+  // number of levels of a full mip chain
+  static uint32_t levels(VkExtent3D extent)
+  {
+    uint32_t size = std::max({ extent.width, extent.height, extent.depth });
+    uint32_t levels = 1;
+    while (size >>= 1) {
+      levels++;
+    }
+    return levels;
+  }
+
+  static bool blittable(VkPhysicalDevice physical_device, VkFormat format)
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+    const VkFormatFeatureFlags required =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+      VK_FORMAT_FEATURE_BLIT_DST_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+
+    return (properties.optimalTilingFeatures & required) == required;
+  }
+
+  static bool storable(VkPhysicalDevice physical_device, VkFormat format)
+  {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+    return !format_qualifier(format).empty() &&
+           (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT);
+  }
+
+  // the usage flags an image of format needs for its levels to be generated
+  static VkImageUsageFlags usage(VkPhysicalDevice physical_device, VkFormat format)
+  {
+    if (blittable(physical_device, format)) {
+      return VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    if (storable(physical_device, format)) {
+      return VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    throw std::runtime_error("MipmapGenerator: format " + std::to_string(format) + " can not be downsampled on this device");
+  }
+
+  // the GLSL image format of the floating point and normalized formats
+  // the compute shader can write, or an empty string
+  static std::string format_qualifier(VkFormat format)
+  {
+    switch (format) {
+    case VK_FORMAT_R8_UNORM: return "r8";
+    case VK_FORMAT_R8_SNORM: return "r8_snorm";
+    case VK_FORMAT_R8G8_UNORM: return "rg8";
+    case VK_FORMAT_R8G8_SNORM: return "rg8_snorm";
+    case VK_FORMAT_R8G8B8A8_UNORM: return "rgba8";
+    case VK_FORMAT_R8G8B8A8_SNORM: return "rgba8_snorm";
+    case VK_FORMAT_A2B10G10R10_UNORM_PACK32: return "rgb10_a2";
+    case VK_FORMAT_B10G11R11_UFLOAT_PACK32: return "r11f_g11f_b10f";
+    case VK_FORMAT_R16_UNORM: return "r16";
+    case VK_FORMAT_R16_SNORM: return "r16_snorm";
+    case VK_FORMAT_R16_SFLOAT: return "r16f";
+    case VK_FORMAT_R16G16_UNORM: return "rg16";
+    case VK_FORMAT_R16G16_SNORM: return "rg16_snorm";
+    case VK_FORMAT_R16G16_SFLOAT: return "rg16f";
+    case VK_FORMAT_R16G16B16A16_UNORM: return "rgba16";
+    case VK_FORMAT_R16G16B16A16_SNORM: return "rgba16_snorm";
+    case VK_FORMAT_R16G16B16A16_SFLOAT: return "rgba16f";
+    case VK_FORMAT_R32_SFLOAT: return "r32f";
+    case VK_FORMAT_R32G32_SFLOAT: return "rg32f";
+    case VK_FORMAT_R32G32B32A32_SFLOAT: return "rgba32f";
+    default: return "";
+    }
+  }
+
+  // Records the generation of all levels of range after its first level,
+  // from the first level, which must be in old_layout. Every level of
+  // range is left in new_layout, available to dst_access_mask. extent is
+  // the extent of level 0 of the image.
+  void record(VkCommandBuffer command,
+              VkImage image,
+              VkExtent3D extent,
+              VkImageSubresourceRange subresource_range,
+              VkImageLayout old_layout,
+              VkImageLayout new_layout,
+              VkAccessFlags dst_access_mask)
+  {
+    const VkImageLayout src_layout = this->blit ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    const VkImageLayout dst_layout = this->blit ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+    const VkAccessFlags read_access = this->blit ? VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT;
+    const VkAccessFlags write_access = this->blit ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_WRITE_BIT;
+    const VkPipelineStageFlags stage = this->blit ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    const uint32_t first = subresource_range.baseMipLevel;
+    const uint32_t count = subresource_range.levelCount;
+    if (count < 2) {
+      return;
+    }
+    if (!this->blit) {
+      this->createDescriptorSets(image, extent, subresource_range);
+      vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline->pipeline);
+    }
+
+    // the first level is read, the contents of the others are discarded
+    std::vector<VkImageMemoryBarrier> barriers{
+      barrier(image, subresource_range, first, 1, VK_ACCESS_MEMORY_WRITE_BIT, read_access, old_layout, src_layout),
+      barrier(image, subresource_range, first + 1, count - 1, 0, write_access, VK_IMAGE_LAYOUT_UNDEFINED, dst_layout),
+    };
+
+    vkCmdPipelineBarrier(command,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         stage,
+                         0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    for (uint32_t level = first + 1; level < first + count; level++) {
+      if (this->blit) {
+        const VkExtent3D src = mip_extent(extent, level - 1);
+        const VkExtent3D dst = mip_extent(extent, level);
+
+        const VkImageBlit region{
+          { subresource_range.aspectMask, level - 1, subresource_range.baseArrayLayer, subresource_range.layerCount }, // srcSubresource
+          { { 0, 0, 0 }, { int32_t(src.width), int32_t(src.height), int32_t(src.depth) } },                         // srcOffsets
+          { subresource_range.aspectMask, level, subresource_range.baseArrayLayer, subresource_range.layerCount },     // dstSubresource
+          { { 0, 0, 0 }, { int32_t(dst.width), int32_t(dst.height), int32_t(dst.depth) } },                         // dstOffsets
+        };
+
+        vkCmdBlitImage(command,
+                       image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1, &region,
+                       VK_FILTER_LINEAR);
+      }
+      else {
+        const VkExtent3D dst = mip_extent(extent, level);
+        for (uint32_t layer = 0; layer < subresource_range.layerCount; layer++) {
+          const size_t set = (level - first - 1) * subresource_range.layerCount + layer;
+          vkCmdBindDescriptorSets(command,
+                                  VK_PIPELINE_BIND_POINT_COMPUTE,
+                                  this->pipeline_layout->layout,
+                                  0,
+                                  1,
+                                  &this->descriptor_sets[set]->descriptor_set,
+                                  0,
+                                  nullptr);
+
+          vkCmdDispatch(command, (dst.width + 7) / 8, (dst.height + 7) / 8, 1);
+        }
+      }
+
+      // this level is the source of the next, the level before it is done
+      barriers = {
+        barrier(image, subresource_range, level, 1, write_access, read_access, dst_layout, src_layout),
+        barrier(image, subresource_range, level - 1, 1, read_access, dst_access_mask, src_layout, new_layout),
+      };
+
+      vkCmdPipelineBarrier(command,
+                           stage,
+                           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                           0, 0, nullptr, 0, nullptr,
+                           static_cast<uint32_t>(barriers.size()), barriers.data());
+    }
+
+    barriers = {
+      barrier(image, subresource_range, first + count - 1, 1, read_access, dst_access_mask, src_layout, new_layout),
+    };
+
+    vkCmdPipelineBarrier(command,
+                         stage,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+  }
 
 private:
-  void doAlloc(RenderManager* context) override
+  static VkExtent3D mip_extent(VkExtent3D extent, uint32_t level)
   {
-    this->image = std::make_shared<VulkanImage>(context->device,
-                                                context->state.texture->image_type(),
-                                                context->state.texture->format(),
-                                                context->state.texture->extent(0),
-                                                context->state.texture->levels(),
-                                                context->state.texture->layers(),
-                                                this->sample_count,
-                                                this->tiling,
-                                                this->usage_flags,
-                                                this->sharing_mode,
-                                                this->create_flags);
+    return {
+      std::max(extent.width >> level, 1u),
+      std::max(extent.height >> level, 1u),
+      std::max(extent.depth >> level, 1u)
+    };
+  }
 
-    this->image_object = std::make_shared<ImageObject>(this->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    context->imageobjects.push_back(this->image_object);
+  static VkImageMemoryBarrier barrier(VkImage image,
+                                      VkImageSubresourceRange subresource_range,
+                                      uint32_t level,
+                                      uint32_t count,
+                                      VkAccessFlags src_access_mask,
+                                      VkAccessFlags dst_access_mask,
+                                      VkImageLayout old_layout,
+                                      VkImageLayout new_layout)
+  {
+    subresource_range.baseMipLevel = level;
+    subresource_range.levelCount = count;
+
+    return {
+      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                    // sType
+      nullptr,                                                   // pNext
+      src_access_mask,                                           // srcAccessMask
+      dst_access_mask,                                           // dstAccessMask
+      old_layout,                                                // oldLayout
+      new_layout,                                                // newLayout
+      VK_QUEUE_FAMILY_IGNORED,                                   // srcQueueFamilyIndex
+      VK_QUEUE_FAMILY_IGNORED,                                   // dstQueueFamilyIndex
+      image,                                                     // image
+      subresource_range,                                         // subresourceRange
+    };
   }
 
-  void doStage(RenderManager* context) override
+  // one view per level and layer, and one descriptor set per level and
+  // layer after the first level, reading the level before it
+  void createDescriptorSets(VkImage image, VkExtent3D extent, VkImageSubresourceRange subresource_range)
   {
-    context->state.image = this->image->image;
-    VulkanTextureImage* texture = context->state.texture;
+    if (extent.depth > 1) {
+      throw std::runtime_error("MipmapGenerator: 3D images of format " + std::to_string(this->format) + " can not be downsampled on this device");
+    }
 
-    {
+    const VkComponentMapping component_mapping{
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY
+    };
+
+    const uint32_t first = subresource_range.baseMipLevel;
+    const uint32_t layers = subresource_range.layerCount;
+
+    this->descriptor_sets.clear();
+    this->views.clear();
+    for (uint32_t level = first; level < first + subresource_range.levelCount; level++) {
+      for (uint32_t layer = 0; layer < layers; layer++) {
+        this->views.push_back(std::make_unique<VulkanImageView>(this->device,
+                                                                image,
+                                                                this->format,
+                                                                VK_IMAGE_VIEW_TYPE_2D,
+                                                                component_mapping,
+                                                                VkImageSubresourceRange{
+                                                                  subresource_range.aspectMask,
+                                                                  level, 1,
+                                                                  subresource_range.baseArrayLayer + layer, 1 }));
+      }
+    }
+
+    for (size_t view = layers; view < this->views.size(); view++) {
+      VulkanDescriptorInfo source{};
+      source.image = {
+        this->sampler->sampler,                                  // sampler
+        this->views[view - layers]->view,                        // imageView
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,                // imageLayout
+      };
+
+      VulkanDescriptorInfo destination{};
+      destination.image = {
+        nullptr,                                                 // sampler
+        this->views[view]->view,                                 // imageView
+        VK_IMAGE_LAYOUT_GENERAL,                                 // imageLayout
+      };
+
+      auto descriptor_set = std::make_unique<DescriptorSet>(this->allocator);
+      descriptor_set->update({ source, destination });
+      this->descriptor_sets.push_back(std::move(descriptor_set));
+    }
+  }
+
+  std::shared_ptr<VulkanDevice> device;
+  VkFormat format;
+  bool blit;
+  std::shared_ptr<Shader> shader;
+  std::shared_ptr<DescriptorAllocator> allocator;
+  std::shared_ptr<VulkanPipelineLayout> pipeline_layout;
+  std::shared_ptr<VulkanComputePipeline> pipeline;
+  std::shared_ptr<VulkanSampler> sampler;
+  std::vector<std::unique_ptr<VulkanImageView>> views;
+  std::vector<std::unique_ptr<DescriptorSet>> descriptor_sets;
+};
+
+// Uploads the mip levels of an image one at a time, from the smallest level
+// up. The levels from resident_level and up are uploaded, and handed over to
+// the graphics queue in the image layout they are sampled in. A level is
+// copied in bands of block rows, so that it can be uploaded over several
+// frames, and in pieces that fit the staging buffer.
+class ImageStream : public StreamedTexture {
+public:
+  NO_COPY_OR_ASSIGNMENT(ImageStream)
+  ImageStream() = delete;
+  virtual ~ImageStream() = default;
+
+  ImageStream(std::shared_ptr<VulkanImage> image,
+              VulkanTextureImage * texture,
+              BufferData * bufferdata,
+              VkImageLayout layout) :
+    image(std::move(image)),
+    texture(texture),
+    bufferdata(bufferdata),
+    layout(layout),
+    resident_level(texture->levels())
+  {}
+
+  bool streamed() const override
+  {
+    return this->resident_level == 0;
+  }
+
+  VkDeviceSize stream(RenderManager * context, VkDeviceSize budget) override
+  {
+    VkDeviceSize uploaded = 0;
+    while (!this->streamed() && uploaded < budget) {
+      uploaded += this->streamLevel(context, budget - uploaded);
+    }
+    return uploaded;
+  }
+
+  // uploads all levels from level and up
+  void upload(RenderManager * context, uint32_t level)
+  {
+    while (this->resident_level > level) {
+      this->streamLevel(context, std::numeric_limits<VkDeviceSize>::max());
+    }
+  }
+
+  std::shared_ptr<VulkanImage> image;
+  VulkanTextureImage * texture;
+  BufferData * bufferdata;
+  VkImageLayout layout;
+  uint32_t resident_level;
+
+private:
+  VkDeviceSize streamLevel(RenderManager * context, VkDeviceSize budget)
+  {
+    UploadQueue * upload = context->upload.get();
+    const uint32_t mip_level = this->resident_level - 1;
+
+    VkImageSubresourceRange subresource_range = this->texture->subresource_range();
+    subresource_range.baseMipLevel = mip_level;
+    subresource_range.levelCount = 1;
+
+    if (this->row == 0) {
       VkImageMemoryBarrier memory_barrier{
         VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                // sType
         nullptr,                                               // pNext
@@ -832,74 +1948,238 @@ private:
         VK_ACCESS_TRANSFER_WRITE_BIT,                          // dstAccessMask
         VK_IMAGE_LAYOUT_UNDEFINED,                             // oldLayout
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,                  // newLayout
-        0,                                                     // srcQueueFamilyIndex
-        0,                                                     // dstQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,                               // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,                               // dstQueueFamilyIndex
         this->image->image,                                    // image
-        texture->subresource_range(),                          // subresourceRange
+        subresource_range,                                     // subresourceRange
       };
 
-      vkCmdPipelineBarrier(context->command->buffer(),
-                           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+      vkCmdPipelineBarrier(upload->command(),
+                           VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                           VK_PIPELINE_STAGE_TRANSFER_BIT,
                            0, 0, nullptr, 0, nullptr, 1,
                            &memory_barrier);
     }
 
-    std::vector<VkBufferImageCopy> regions;
+    const VkExtent3D extent = this->texture->extent(mip_level);
+    const VkExtent3D block = this->texture->block_extent();
+    const size_t layer_size = this->texture->size(mip_level) / subresource_range.layerCount;
 
-    VkDeviceSize buffer_offset = 0;
-    for (uint32_t mip_level = 0; mip_level < texture->levels(); mip_level++) {
+    // the rows of a compressed image are rows of blocks, and the last
+    // block of a row or column may reach past the edge of the level
+    const uint32_t block_rows = (extent.height + block.height - 1) / block.height;
+    const size_t slice_size = layer_size / extent.depth;
+    const size_t row_size = slice_size / block_rows;
+    const uint32_t rows = block_rows * extent.depth * subresource_range.layerCount;
+
+    if (row_size > upload->staging->size) {
+      throw std::runtime_error("ImageStream: image row larger than staging buffer");
+    }
+    const VkDeviceSize rows_per_chunk = upload->staging->size / row_size;
 
+    VkDeviceSize uploaded = 0;
+    while (this->row < rows && uploaded < budget) {
+      // the rows of all depth slices of all layers, in the order they are stored
+      const uint32_t slice = this->row / block_rows;
+      const uint32_t layer = slice / extent.depth;
+      const uint32_t z = slice % extent.depth;
+      const uint32_t row = this->row % block_rows;
+
+      const VkDeviceSize budget_rows = std::max(VkDeviceSize(1), (budget - uploaded) / row_size);
+      const uint32_t count = static_cast<uint32_t>(
+        std::min({ VkDeviceSize(block_rows - row), rows_per_chunk, budget_rows }));
+
+      const uint32_t y = row * block.height;
       const VkImageSubresourceLayers subresource_layers{
-        texture->subresource_range().aspectMask,               // aspectMask
+        subresource_range.aspectMask,                          // aspectMask
         mip_level,                                             // mipLevel
-        texture->subresource_range().baseArrayLayer,           // baseArrayLayer
-        texture->subresource_range().layerCount,               // layerCount
+        subresource_range.baseArrayLayer + layer,              // baseArrayLayer
+        1,                                                     // layerCount
       };
 
-      regions.push_back({
-        buffer_offset,                             // bufferOffset 
-        0,                                         // bufferRowLength
-        0,                                         // bufferImageHeight
-        subresource_layers,                        // imageSubresource
-        { 0, 0, 0 },                               // imageOffset
-        texture->extent(mip_level),                // imageExtent
-        });
+      this->copy(upload,
+                 this->texture->offset(mip_level, layer) + z * slice_size + row * row_size,
+                 count * row_size,
+                 subresource_layers,
+                 { 0, static_cast<int32_t>(y), static_cast<int32_t>(z) },
+                 { extent.width, std::min(count * block.height, extent.height - y), 1 });
 
-      buffer_offset += texture->size(mip_level);
+      this->row += count;
+      uploaded += count * row_size;
     }
 
-    vkCmdCopyBufferToImage(context->command->buffer(),
-                           context->state.buffer,
+    if (this->row == rows) {
+      upload->release(this->image->image, subresource_range, this->layout, VK_ACCESS_SHADER_READ_BIT);
+      upload->acquire(context->command->buffer(), this->image->image, subresource_range, this->layout, VK_ACCESS_SHADER_READ_BIT);
+      this->resident_level = mip_level;
+      this->row = 0;
+    }
+    return uploaded;
+  }
+
+  void copy(UploadQueue * upload,
+            size_t offset,
+            size_t size,
+            VkImageSubresourceLayers subresource_layers,
+            VkOffset3D image_offset,
+            VkExtent3D image_extent)
+  {
+    const VkDeviceSize staging_offset = upload->reserve(size);
+    this->bufferdata->copy(upload->staging->data(staging_offset), offset, size);
+
+    const VkBufferImageCopy region{
+      staging_offset,                            // bufferOffset 
+      0,                                         // bufferRowLength
+      0,                                         // bufferImageHeight
+      subresource_layers,                        // imageSubresource
+      image_offset,                              // imageOffset
+      image_extent,                              // imageExtent
+    };
+
+    vkCmdCopyBufferToImage(upload->command(),
+                           upload->staging->vkbuffer(),
                            this->image->image,
                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           static_cast<uint32_t>(regions.size()),
-                           regions.data());
-    {
-      VkImageMemoryBarrier memory_barrier{
-        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                // sType
-        nullptr,                                               // pNext
-        0,                                                     // srcAccessMask
-        VK_ACCESS_TRANSFER_WRITE_BIT,                          // dstAccessMask
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,                  // oldLayout
-        this->layout,                                          // newLayout
-        0,                                                     // srcQueueFamilyIndex
-        0,                                                     // dstQueueFamilyIndex
-        this->image->image,                                    // image
-        texture->subresource_range(),                          // subresourceRange
-      };
+                           1, &region);
+  }
 
-      vkCmdPipelineBarrier(context->command->buffer(),
-                           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                           0, 0, nullptr, 0, nullptr, 1,
-                           &memory_barrier);
+  // the next block row of the level being uploaded
+  uint32_t row{ 0 };
+};
+
+class Image : public Node {
+public:
+  NO_COPY_OR_ASSIGNMENT(Image)
+  virtual ~Image() = default;
+  Image(VkSampleCountFlagBits sample_count,
+        VkImageTiling tiling,
+        VkImageUsageFlags usage_flags,
+        VkSharingMode sharing_mode,
+        VkImageCreateFlags create_flags,
+        VkImageLayout layout,
+        bool streaming = false,
+        bool mipmaps = false) :
+    sample_count(sample_count),
+    tiling(tiling),
+    usage_flags(usage_flags),
+    sharing_mode(sharing_mode),
+    create_flags(create_flags),
+    layout(layout),
+    streaming(streaming),
+    mipmaps(mipmaps)
+  {}
+
+  // levels of at most this many texels on a side are uploaded when a
+  // streaming image is staged
+  static constexpr uint32_t tail_extent = 256;
+
+private:
+  void doAlloc(RenderManager* context) override
+  {
+    VulkanTextureImage * texture = context->state.texture;
+
+    // block compressed formats are optional features of the device
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(context->device->physical_device.device, texture->format(), &properties);
+    const VkFormatFeatureFlags features = this->tiling == VK_IMAGE_TILING_OPTIMAL ?
+      properties.optimalTilingFeatures : properties.linearTilingFeatures;
+
+    if ((this->usage_flags & VK_IMAGE_USAGE_SAMPLED_BIT) && !(features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) {
+      throw std::runtime_error("Image: format " + std::to_string(texture->format()) + " can not be sampled on this device");
+    }
+
+    // the levels the texture does not have are generated from its last level
+    VkImageUsageFlags usage_flags = this->usage_flags;
+    this->levels = texture->levels();
+    if (this->mipmaps && MipmapGenerator::levels(texture->extent(0)) > this->levels) {
+      this->levels = MipmapGenerator::levels(texture->extent(0));
+      usage_flags |= MipmapGenerator::usage(context->device->physical_device.device, texture->format());
+    }
+
+    VkImageCreateFlags create_flags = this->create_flags;
+    const VkImageViewType view_type = texture->image_view_type();
+    if (view_type == VK_IMAGE_VIEW_TYPE_CUBE || view_type == VK_IMAGE_VIEW_TYPE_CUBE_ARRAY) {
+      create_flags |= VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    }
+
+    this->image = std::make_shared<VulkanImage>(context->device,
+                                                texture->image_type(),
+                                                texture->format(),
+                                                texture->extent(0),
+                                                this->levels,
+                                                texture->layers(),
+                                                this->sample_count,
+                                                this->tiling,
+                                                usage_flags,
+                                                this->sharing_mode,
+                                                create_flags);
+
+    this->image_object = std::make_shared<ImageObject>(this->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    context->imageobjects.push_back(this->image_object);
+  }
+
+  void doStage(RenderManager* context) override
+  {
+    context->state.image = this->image->image;
+    VulkanTextureImage* texture = context->state.texture;
+
+    this->stream = std::make_shared<ImageStream>(this->image,
+                                                 texture,
+                                                 context->state.bufferdata,
+                                                 this->layout);
+    if (this->streaming) {
+      // the mip tail, and at least the smallest level, is uploaded now
+      uint32_t tail_level = texture->levels() - 1;
+      while (tail_level > 0 &&
+             std::max(texture->extent(tail_level - 1).width,
+                      texture->extent(tail_level - 1).height) <= tail_extent) {
+        tail_level--;
+      }
+      this->stream->upload(context, tail_level);
+      context->streamer->add(this->stream);
+    }
+    else {
+      this->stream->upload(context, 0);
+    }
+    context->state.image_min_level = this->stream->resident_level;
+
+    if (this->levels > texture->levels()) {
+      VkImageSubresourceRange subresource_range = texture->subresource_range();
+      subresource_range.baseMipLevel = texture->levels() - 1;
+      subresource_range.levelCount = this->levels - subresource_range.baseMipLevel;
+
+      this->mipmap_generator = std::make_unique<MipmapGenerator>(context, texture->format());
+      this->mipmap_generator->record(context->command->buffer(),
+                                     this->image->image,
+                                     texture->extent(0),
+                                     subresource_range,
+                                     this->layout,
+                                     this->layout,
+                                     VK_ACCESS_SHADER_READ_BIT);
     }
   }
 
   void doPipeline(RenderManager * context) override
   {
+    context->state.image = this->image->image;
     context->state.imageLayout = this->layout;
+    context->state.image_min_level = this->stream->resident_level;
+  }
+
+  void doRefresh(RenderManager * context) override
+  {
+    this->doPipeline(context);
+  }
+
+  void doRender(SceneRenderer * renderer) override
+  {
+    if (renderer->phase != SceneRenderer::Phase::Graphics || this->stream->streamed()) {
+      return;
+    }
+    // images outside of any separator with bounds count as full screen
+    const double size = renderer->state.bounds ?
+      Separator::projected_size(*renderer->state.bounds, renderer->state) : 1.0;
+    this->stream->priority = std::max(this->stream->priority, size);
   }
 
   std::shared_ptr<VulkanImage> image;
@@ -911,6 +2191,45 @@ private:
   VkSharingMode sharing_mode;
   VkImageCreateFlags create_flags;
   VkImageLayout layout;
+  bool streaming;
+  bool mipmaps;
+  uint32_t levels{ 0 };
+  std::shared_ptr<ImageStream> stream;
+  std::unique_ptr<MipmapGenerator> mipmap_generator;
+};
+
+// An image whose mip tail is uploaded when it is staged, and whose larger
+// levels are streamed in over the following frames, the images that are
+// largest on screen first. Until then, views of it are clamped to the
+// levels uploaded so far.
+class StreamingImage : public Image {
+public:
+  NO_COPY_OR_ASSIGNMENT(StreamingImage)
+  virtual ~StreamingImage() = default;
+  StreamingImage(VkSampleCountFlagBits sample_count,
+                 VkImageTiling tiling,
+                 VkImageUsageFlags usage_flags,
+                 VkSharingMode sharing_mode,
+                 VkImageCreateFlags create_flags,
+                 VkImageLayout layout) :
+    Image(sample_count, tiling, usage_flags, sharing_mode, create_flags, layout, true)
+  {}
+};
+
+// An image with a full mip chain, the levels the texture does not have
+// generated on the GPU from its smallest level when the image is staged
+class MipmappedImage : public Image {
+public:
+  NO_COPY_OR_ASSIGNMENT(MipmappedImage)
+  virtual ~MipmappedImage() = default;
+  MipmappedImage(VkSampleCountFlagBits sample_count,
+                 VkImageTiling tiling,
+                 VkImageUsageFlags usage_flags,
+                 VkSharingMode sharing_mode,
+                 VkImageCreateFlags create_flags,
+                 VkImageLayout layout) :
+    Image(sample_count, tiling, usage_flags, sharing_mode, create_flags, layout, false, true)
+  {}
 };
 
 
@@ -928,20 +2247,46 @@ public:
 private:
   void doStage(RenderManager* context) override
   {
-    this->view = std::make_unique<VulkanImageView>(context->device,
-                                                   context->state.image,
-                                                   context->state.texture->format(),
-                                                   context->state.texture->image_view_type(),
-                                                   this->component_mapping,
-                                                   context->state.texture->subresource_range());
+    this->createView(context);
   }
 
   void doPipeline(RenderManager* context) override
   {
+    // a streamed image has uploaded more levels since the view was created
+    if (context->state.image_min_level != this->min_level) {
+      this->createView(context);
+    }
     context->state.imageView = this->view->view;
   }
 
+  void doRefresh(RenderManager * context) override
+  {
+    this->doPipeline(context);
+  }
+
+  void createView(RenderManager * context)
+  {
+    // the frames in flight may still sample the view that is replaced
+    if (this->view) {
+      context->retire(std::move(this->view));
+    }
+    this->min_level = context->state.image_min_level;
+
+    VkImageSubresourceRange subresource_range = context->state.texture->subresource_range();
+    // generated mip levels are not levels of the texture
+    subresource_range.baseMipLevel += this->min_level;
+    subresource_range.levelCount = VK_REMAINING_MIP_LEVELS;
+
+    this->view = std::make_unique<VulkanImageView>(context->device,
+                                                   context->state.image,
+                                                   context->state.texture->format(),
+                                                   context->state.texture->image_view_type(),
+                                                   this->component_mapping,
+                                                   subresource_range);
+  }
+
   std::unique_ptr<VulkanImageView> view;
+  uint32_t min_level{ 0 };
   VkComponentMapping component_mapping;
 };
 
@@ -979,42 +2324,49 @@ public:
   {}
 
 private:
+  void doAlloc(RenderManager * context) override
+  {
+    this->command = std::make_unique<VulkanCommandBuffers>(
+      context->device,
+      1,
+      VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+  }
+
   void doPipeline(RenderManager * creator) override
   {
-    this->descriptor_set_layout = std::make_unique<VulkanDescriptorSetLayout>(
-      creator->device,
+    auto descriptor_allocator = creator->registry->getDescriptorAllocator(
       creator->state.descriptor_set_layout_bindings);
 
-    this->descriptor_set = std::make_unique<VulkanDescriptorSets>(
-      creator->device,
-      this->descriptor_pool,
-      std::vector<VkDescriptorSetLayout>{ this->descriptor_set_layout->layout });
+    this->descriptor_set = std::make_unique<DescriptorSet>(descriptor_allocator);
+    this->descriptor_set->update(creator->state.descriptor_infos);
 
-    this->pipeline_layout = std::make_unique<VulkanPipelineLayout>(
-      creator->device,
-      std::vector<VkDescriptorSetLayout>{ this->descriptor_set_layout->layout },
+    this->pipeline_layout = creator->registry->getPipelineLayout(
+      std::vector<VkDescriptorSetLayout>{ descriptor_allocator->layout->layout },
       creator->state.push_constant_ranges);
 
-    for (auto & write_descriptor_set : creator->state.write_descriptor_sets) {
-      write_descriptor_set.dstSet = this->descriptor_set->descriptor_sets[0];
-    }
-    this->descriptor_set->update(creator->state.write_descriptor_sets);
-
-    this->pipeline = std::make_unique<VulkanComputePipeline>(
-      creator->device,
-      creator->pipelinecache->cache,
+    this->pipeline.reset();
+    this->pending_pipeline = creator->registry->getComputePipelineAsync(
+      creator->pipelinecache,
       creator->state.shader_stage_infos[0],
-      this->pipeline_layout->layout);
+      creator->state.shader_modules[0],
+      this->pipeline_layout);
   }
 
   void doRecord(RenderManager * recorder) override
   {
+    // later passes may depend on the results, so wait rather than skip
+    if (!this->pipeline) {
+      this->pipeline = this->pending_pipeline->get();
+    }
+
+    VulkanCommandBufferScope command_scope(this->command->buffer());
+
     vkCmdBindDescriptorSets(this->command->buffer(),
                             VK_PIPELINE_BIND_POINT_COMPUTE,
                             this->pipeline_layout->layout,
                             0,
-                            static_cast<uint32_t>(this->descriptor_set->descriptor_sets.size()),
-                            this->descriptor_set->descriptor_sets.data(),
+                            1,
+                            &this->descriptor_set->descriptor_set,
                             0,
                             nullptr);
 
@@ -1028,17 +2380,59 @@ private:
                   this->group_count_z);
   }
 
+  // a changed descriptor gets a new descriptor set and command buffer, the
+  // frames in flight may still use the old ones
+  void doRefresh(RenderManager * creator) override
+  {
+    if (this->descriptor_set->holds(creator->state.descriptor_infos)) {
+      return;
+    }
+    auto descriptor_set = std::make_unique<DescriptorSet>(this->descriptor_set->allocator);
+    descriptor_set->update(creator->state.descriptor_infos);
+
+    creator->retire(std::move(this->descriptor_set));
+    creator->retire(std::move(this->command));
+    this->descriptor_set = std::move(descriptor_set);
+    this->doAlloc(creator);
+    this->doRecord(creator);
+  }
+
+  void doRender(SceneRenderer * renderer) override
+  {
+    if (renderer->phase != SceneRenderer::Phase::Compute) {
+      return;
+    }
+    vkCmdExecuteCommands(renderer->command->buffer(),
+                         static_cast<uint32_t>(this->command->buffers.size()),
+                         this->command->buffers.data());
+
+    // results are visible to everything recorded after the dispatch
+    VkMemoryBarrier barrier{
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER,              // sType
+      nullptr,                                       // pNext
+      VK_ACCESS_SHADER_WRITE_BIT,                    // srcAccessMask
+      VK_ACCESS_MEMORY_READ_BIT,                     // dstAccessMask
+    };
+
+    vkCmdPipelineBarrier(renderer->command->buffer(),
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+  }
+
   uint32_t group_count_x;
   uint32_t group_count_y;
   uint32_t group_count_z;
 
-  std::unique_ptr<VulkanComputePipeline> pipeline;
+  std::shared_ptr<AsyncObject<VulkanComputePipeline>> pending_pipeline;
+  std::shared_ptr<VulkanComputePipeline> pipeline;
   std::unique_ptr<VulkanCommandBuffers> command;
 
-  std::shared_ptr<VulkanDescriptorSetLayout> descriptor_set_layout;
-  std::shared_ptr<VulkanDescriptorSets> descriptor_set;
+  std::unique_ptr<DescriptorSet> descriptor_set;
   std::shared_ptr<VulkanPipelineLayout> pipeline_layout;
-  std::shared_ptr<VulkanDescriptorPool> descriptor_pool;
 };
 
 class DrawCommandBase : public Node {
@@ -1052,10 +2446,30 @@ public:
   {}
 
 private:
-  virtual void execute(VkCommandBuffer command, RenderManager * recorder) = 0;
+  virtual void execute(VkCommandBuffer command, const State & state) = 0;
+
+  // whether the first vertex of pooled vertex streams is passed to the draw
+  // rather than in the offsets of the vertex buffers
+  virtual bool rebasesVertices() const
+  {
+    return true;
+  }
 
   void doAlloc(RenderManager * context) override
   {
+    // pooled vertex streams start at a whole vertex into the pool buffer
+    const State & state = context->state;
+    for (auto & binding : state.vertex_input_bindings) {
+      if (binding.inputRate == VK_VERTEX_INPUT_RATE_VERTEX &&
+          binding.stride > 0 &&
+          binding.binding < state.vertex_allocations.size() &&
+          state.vertex_allocations[binding.binding]) {
+        GeometryAllocation * allocation = state.vertex_allocations[binding.binding];
+        allocation->alignment = std::lcm(allocation->alignment, VkDeviceSize(binding.stride));
+      }
+    }
+
+    this->device = context->device;
     this->command = std::make_unique<VulkanCommandBuffers>(
       context->device,
       1,
@@ -1064,50 +2478,126 @@ private:
 
   void doPipeline(RenderManager * creator) override
   {
-    auto descriptor_pool = std::make_shared<VulkanDescriptorPool>(
-      creator->device,
-      creator->state.descriptor_pool_sizes);
-
-    this->descriptor_set_layout = std::make_unique<VulkanDescriptorSetLayout>(
-      creator->device,
+    auto descriptor_allocator = creator->registry->getDescriptorAllocator(
       creator->state.descriptor_set_layout_bindings);
 
-    std::vector<VkDescriptorSetLayout> descriptor_set_layouts{ 
-      this->descriptor_set_layout->layout 
-    };
+    // the previous set of this draw, if any, goes back to the free list
+    this->descriptor_set = std::make_unique<DescriptorSet>(descriptor_allocator);
+    this->descriptor_set->update(creator->state.descriptor_infos);
 
-    this->pipeline_layout = std::make_unique<VulkanPipelineLayout>(
-      creator->device,
-      descriptor_set_layouts,
+    this->pipeline_layout = creator->registry->getPipelineLayout(
+      std::vector<VkDescriptorSetLayout>{ descriptor_allocator->layout->layout },
       creator->state.push_constant_ranges);
 
-    this->descriptor_sets = std::make_unique<VulkanDescriptorSets>(
-      creator->device,
-      descriptor_pool,
-      descriptor_set_layouts);
-
-    for (auto & write_descriptor_set : creator->state.write_descriptor_sets) {
-      write_descriptor_set.dstSet = this->descriptor_sets->descriptor_sets[0];
-    }
-    this->descriptor_sets->update(creator->state.write_descriptor_sets);
-
-    this->pipeline = std::make_unique<VulkanGraphicsPipeline>(
-      creator->device,
-      creator->state.renderpass->renderpass,
-      creator->pipelinecache->cache,
-      this->pipeline_layout->layout,
+    // compiled on a worker thread, the draw is skipped until it is ready
+    this->pipeline.reset();
+    this->pending_pipeline = creator->registry->getGraphicsPipelineAsync(
+      creator->state.renderpass,
+      creator->pipelinecache,
+      this->pipeline_layout,
       this->topology,
       creator->state.rasterization_state,
       this->dynamic_states,
       creator->state.shader_stage_infos,
+      creator->state.shader_modules,
       creator->state.vertex_input_bindings,
       creator->state.vertex_attributes);
   }
 
   void doRecord(RenderManager * recorder) override
   {
+    // keep what the command buffer needs, it may be recorded at render time
+    this->record_state = recorder->state;
+    this->resolveGeometry(this->record_state);
+    this->record_extent = recorder->extent;
+    this->recorded = false;
+    this->tryRecord();
+  }
+
+  // A changed descriptor gets a new descriptor set and command buffer, the
+  // frames in flight may still use the old ones. The command buffer is
+  // recorded again when the draw is next rendered.
+  void doRefresh(RenderManager * creator) override
+  {
+    if (this->descriptor_set->holds(creator->state.descriptor_infos)) {
+      return;
+    }
+    auto descriptor_set = std::make_unique<DescriptorSet>(this->descriptor_set->allocator);
+    descriptor_set->update(creator->state.descriptor_infos);
+
+    creator->retire(std::move(this->descriptor_set));
+    creator->retire(std::move(this->command));
+    this->descriptor_set = std::move(descriptor_set);
+    this->command = std::make_unique<VulkanCommandBuffers>(
+      creator->device,
+      1,
+      VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    this->recorded = false;
+  }
+
+  // Binds pooled vertex streams at their first common vertex, and passes
+  // the rest of their offsets into the pool buffer to the draw as its base
+  // vertex. Single stream meshes in the same pool buffer are then all bound
+  // at the same offset, and draws of the same vertex layout only differ in
+  // their first vertex or vertex offset.
+  void resolveGeometry(State & state) const
+  {
+    state.base_vertex = 0;
+    if (!this->rebasesVertices()) {
+      return;
+    }
+
+    // the vertex rate bindings, with the stride of their last description
+    std::map<uint32_t, uint32_t> strides;
+    for (auto & binding : state.vertex_input_bindings) {
+      if (binding.inputRate == VK_VERTEX_INPUT_RATE_VERTEX) {
+        strides[binding.binding] = binding.stride;
+      }
+      else {
+        strides.erase(binding.binding);
+      }
+    }
+
+    VkDeviceSize base_vertex = std::numeric_limits<uint32_t>::max();
+    for (auto & [binding, stride] : strides) {
+      // the base vertex would also offset streams with buffers of their own
+      if (binding >= state.vertex_allocations.size() || !state.vertex_allocations[binding] || stride == 0) {
+        return;
+      }
+      base_vertex = std::min(base_vertex, state.vertex_attribute_buffer_offsets[binding] / stride);
+    }
+    if (strides.empty()) {
+      return;
+    }
+
+    for (auto & [binding, stride] : strides) {
+      state.vertex_attribute_buffer_offsets[binding] -= base_vertex * stride;
+    }
+    state.base_vertex = static_cast<uint32_t>(base_vertex);
+  }
+
+  // records the secondary command buffer once the pipeline is ready
+  bool tryRecord()
+  {
+    if (!this->pipeline) {
+      if (!this->pending_pipeline || !this->pending_pipeline->ready()) {
+        return false;
+      }
+      this->pipeline = this->pending_pipeline->get();
+    }
+    if (!this->recorded) {
+      this->recordCommands();
+      this->recorded = true;
+    }
+    return true;
+  }
+
+  void recordCommands()
+  {
+    const State & state = this->record_state;
+
     VulkanCommandBufferScope command_scope(this->command->buffer(),
-                                           recorder->state.renderpass->renderpass,
+                                           state.renderpass->renderpass,
                                            0,
                                            VK_NULL_HANDLE,
                                            VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
@@ -1124,8 +2614,8 @@ private:
                             VK_PIPELINE_BIND_POINT_GRAPHICS, 
                             this->pipeline_layout->layout, 
                             0, 
-                            static_cast<uint32_t>(this->descriptor_sets->descriptor_sets.size()), 
-                            this->descriptor_sets->descriptor_sets.data(), 
+                            1, 
+                            &this->descriptor_set->descriptor_set, 
                             0, 
                             nullptr);
 
@@ -1135,14 +2625,14 @@ private:
 
     std::vector<VkRect2D> scissors{ {
       { 0, 0 },
-      recorder->extent
+      this->record_extent
     } };
 
     std::vector<VkViewport> viewports{ {
       0.0f,                                         // x
       0.0f,                                         // y
-      static_cast<float>(recorder->extent.width),   // width
-      static_cast<float>(recorder->extent.height),  // height
+      static_cast<float>(this->record_extent.width),  // width
+      static_cast<float>(this->record_extent.height), // height
       0.0f,                                         // minDepth
       1.0f                                          // maxDepth
     } };
@@ -1159,15 +2649,18 @@ private:
 
     vkCmdBindVertexBuffers(this->command->buffer(), 
                            0, 
-                           static_cast<uint32_t>(recorder->state.vertex_attribute_buffers.size()),
-                           recorder->state.vertex_attribute_buffers.data(),
-                           recorder->state.vertex_attribute_buffer_offsets.data());
+                           static_cast<uint32_t>(state.vertex_attribute_buffers.size()),
+                           state.vertex_attribute_buffers.data(),
+                           state.vertex_attribute_buffer_offsets.data());
     
-    this->execute(this->command->buffer(), recorder);
+    this->execute(this->command->buffer(), state);
   }
 
   void doRender(SceneRenderer * renderer) override
   {
+    if (renderer->phase != SceneRenderer::Phase::Graphics || !this->tryRecord()) {
+      return;
+    }
     vkCmdExecuteCommands(renderer->command->buffer(), 
                          static_cast<uint32_t>(this->command->buffers.size()), 
                          this->command->buffers.data());
@@ -1175,14 +2668,20 @@ private:
 
   VkPrimitiveTopology topology;
   std::unique_ptr<VulkanCommandBuffers> command;
-  std::unique_ptr<VulkanGraphicsPipeline> pipeline;
+  std::shared_ptr<AsyncObject<VulkanGraphicsPipeline>> pending_pipeline;
+  std::shared_ptr<VulkanGraphicsPipeline> pipeline;
+  State record_state;
+  VkExtent2D record_extent{ 0, 0 };
+  bool recorded{ false };
   std::vector<VkDynamicState> dynamic_states{
     VK_DYNAMIC_STATE_VIEWPORT,
     VK_DYNAMIC_STATE_SCISSOR
   };
-  std::shared_ptr<VulkanDescriptorSetLayout> descriptor_set_layout;
-  std::shared_ptr<VulkanDescriptorSets> descriptor_sets;
+  std::unique_ptr<DescriptorSet> descriptor_set;
   std::shared_ptr<VulkanPipelineLayout> pipeline_layout;
+
+protected:
+  std::shared_ptr<VulkanDevice> device;
 };
 
 class DrawCommand : public DrawCommandBase {
@@ -1203,9 +2702,10 @@ public:
   {}
 
 private:
-  void execute(VkCommandBuffer command, RenderManager *) override
+  void execute(VkCommandBuffer command, const State & state) override
   {
-    vkCmdDraw(command, this->vertexcount, this->instancecount, this->firstvertex, this->firstinstance);
+    const uint32_t instancecount = state.instance_count ? state.instance_count : this->instancecount;
+    vkCmdDraw(command, this->vertexcount, instancecount, this->firstvertex + state.base_vertex, this->firstinstance);
   }
 
   uint32_t vertexcount;
@@ -1235,18 +2735,24 @@ public:
   {}
 
 private:
-  void execute(VkCommandBuffer command, RenderManager * recorder) override
+  void execute(VkCommandBuffer command, const State & state) override
   {
+    // pooled indices are bound at the start of the pool buffer, and their
+    // offset into it is passed to the draw as its first index
+    const VkDeviceSize index_size = state.index_buffer_description.type == VK_INDEX_TYPE_UINT16 ? 2 : 4;
+    const uint32_t firstindex = this->firstindex + 
+      static_cast<uint32_t>(state.index_buffer_description.offset / index_size);
+
     vkCmdBindIndexBuffer(command, 
-                         recorder->state.index_buffer_description.buffer, 
+                         state.index_buffer_description.buffer, 
                          this->offset, 
-                         recorder->state.index_buffer_description.type);
+                         state.index_buffer_description.type);
 
     vkCmdDrawIndexed(command, 
                      this->indexcount, 
-                     this->instancecount, 
-                     this->firstindex, 
-                     this->vertexoffset, 
+                     state.instance_count ? state.instance_count : this->instancecount, 
+                     firstindex, 
+                     this->vertexoffset + static_cast<int32_t>(state.base_vertex), 
                      this->firstinstance);
   }
 
@@ -1258,6 +2764,115 @@ private:
   VkDeviceSize offset;
 };
 
+// Draws drawcount commands laid out stride bytes apart in the argument
+// buffer of the state, so that many draws sharing a pipeline are recorded
+// as one. With a draw count buffer in the state and VK_KHR_draw_indirect_count
+// enabled, the GPU reads the number of draws from it, up to drawcount.
+// Otherwise all drawcount commands are issued, so writers of the argument
+// buffer should set instanceCount to 0 in commands that are not used.
+class IndirectDrawCommandBase : public DrawCommandBase {
+public:
+  NO_COPY_OR_ASSIGNMENT(IndirectDrawCommandBase)
+  virtual ~IndirectDrawCommandBase() = default;
+
+  IndirectDrawCommandBase(uint32_t drawcount,
+                          uint32_t stride,
+                          uint32_t command_size,
+                          VkPrimitiveTopology topology) :
+    DrawCommandBase(topology),
+    drawcount(drawcount),
+    stride(stride)
+  {
+    if (stride < command_size || stride % 4 != 0) {
+      throw std::runtime_error("IndirectDrawCommandBase: stride must be a multiple of 4 and at least the command size");
+    }
+  }
+
+protected:
+  // the commands in the argument buffer are relative to the start of the
+  // vertex and index data, which is bound at its offset into the pool
+  bool rebasesVertices() const override
+  {
+    return false;
+  }
+
+  template <typename DrawIndirect, typename DrawIndirectCount>
+  void drawIndirect(VkCommandBuffer command,
+                    const State & state,
+                    DrawIndirect draw_indirect,
+                    DrawIndirectCount draw_indirect_count) const
+  {
+    if (!state.indirect_buffer) {
+      throw std::runtime_error("IndirectDrawCommandBase: no indirect buffer in state");
+    }
+
+    if (state.indirect_count_buffer && draw_indirect_count) {
+      draw_indirect_count(command, state.indirect_buffer, 0, state.indirect_count_buffer, 0, this->drawcount, this->stride);
+      return;
+    }
+
+    // one draw per command without multiDrawIndirect
+    const uint32_t max_drawcount = this->device->enabled_features.multiDrawIndirect ?
+      this->device->physical_device.properties.limits.maxDrawIndirectCount : 1;
+
+    for (uint32_t first = 0; first < this->drawcount; first += max_drawcount) {
+      draw_indirect(command,
+                    state.indirect_buffer,
+                    static_cast<VkDeviceSize>(first) * this->stride,
+                    std::min(max_drawcount, this->drawcount - first),
+                    this->stride);
+    }
+  }
+
+  uint32_t drawcount;
+  uint32_t stride;
+};
+
+class IndirectDrawCommand : public IndirectDrawCommandBase {
+public:
+  NO_COPY_OR_ASSIGNMENT(IndirectDrawCommand)
+  virtual ~IndirectDrawCommand() = default;
+
+  explicit IndirectDrawCommand(uint32_t drawcount,
+                               uint32_t stride,
+                               VkPrimitiveTopology topology) :
+    IndirectDrawCommandBase(drawcount, stride, sizeof(VkDrawIndirectCommand), topology)
+  {}
+
+private:
+  void execute(VkCommandBuffer command, const State & state) override
+  {
+    this->drawIndirect(command, state, vkCmdDrawIndirect, this->device->vkCmdDrawIndirectCountKHR);
+  }
+};
+
+class IndexedIndirectDrawCommand : public IndirectDrawCommandBase {
+public:
+  NO_COPY_OR_ASSIGNMENT(IndexedIndirectDrawCommand)
+  virtual ~IndexedIndirectDrawCommand() = default;
+
+  explicit IndexedIndirectDrawCommand(uint32_t drawcount,
+                                      uint32_t stride,
+                                      VkPrimitiveTopology topology) :
+    IndirectDrawCommandBase(drawcount, stride, sizeof(VkDrawIndexedIndirectCommand), topology)
+  {}
+
+private:
+  void execute(VkCommandBuffer command, const State & state) override
+  {
+    vkCmdBindIndexBuffer(command,
+                         state.index_buffer_description.buffer,
+                         state.index_buffer_description.offset,
+                         state.index_buffer_description.type);
+
+    this->drawIndirect(command, state, vkCmdDrawIndexedIndirect, this->device->vkCmdDrawIndexedIndirectCountKHR);
+  }
+};
+
+// An image that is rendered to. With mipmaps, the image has a full mip
+// chain, whose levels after the first are generated by the render pass
+// when it has rendered the first. The framebuffer then only gets a view
+// of the first level, imageview is a view of all levels.
 class FramebufferAttachment {
 public:
   NO_COPY_OR_ASSIGNMENT(FramebufferAttachment)
@@ -1265,9 +2880,11 @@ public:
 
   FramebufferAttachment(VkFormat format,
                         VkImageUsageFlags usage,
-                        VkImageAspectFlags aspectMask) :
+                        VkImageAspectFlags aspectMask,
+                        bool mipmaps = false) :
     format(format),
-    usage(usage)
+    usage(usage),
+    mipmaps(mipmaps)
   {
     this->subresource_range = {
       aspectMask, 0, 1, 0, 1
@@ -1276,16 +2893,26 @@ public:
 
   VkImageView alloc(RenderManager * context)
   {
-    VkExtent3D extent = { context->extent.width, context->extent.height, 1 };
+    this->extent = { context->extent.width, context->extent.height, 1 };
+
+    VkImageUsageFlags usage = this->usage;
+    if (this->mipmaps) {
+      this->subresource_range.levelCount = MipmapGenerator::levels(this->extent);
+      usage |= MipmapGenerator::usage(context->device->physical_device.device, this->format);
+      if (!this->mipmap_generator) {
+        this->mipmap_generator = std::make_unique<MipmapGenerator>(context, this->format);
+      }
+    }
+
     this->image = std::make_shared<VulkanImage>(context->device,
                                                 VK_IMAGE_TYPE_2D,
                                                 this->format,
-                                                extent,
+                                                this->extent,
                                                 this->subresource_range.levelCount,
                                                 this->subresource_range.layerCount,
                                                 VK_SAMPLE_COUNT_1_BIT,
                                                 VK_IMAGE_TILING_OPTIMAL,
-                                                this->usage,
+                                                usage,
                                                 VK_SHARING_MODE_EXCLUSIVE);
 
     this->imageobject = std::make_shared<ImageObject>(this->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
@@ -1301,12 +2928,41 @@ public:
                                                         VK_IMAGE_VIEW_TYPE_2D,
                                                         this->component_mapping,
                                                         this->subresource_range);
-    return this->imageview->view;
+
+    // a framebuffer attachment is a single level
+    this->framebuffer_view = this->imageview;
+    if (this->subresource_range.levelCount > 1) {
+      VkImageSubresourceRange first_level = this->subresource_range;
+      first_level.levelCount = 1;
+      this->framebuffer_view = std::make_shared<VulkanImageView>(context->device,
+                                                                 this->image->image,
+                                                                 this->format,
+                                                                 VK_IMAGE_VIEW_TYPE_2D,
+                                                                 this->component_mapping,
+                                                                 first_level);
+    }
+    return this->framebuffer_view->view;
+  }
+
+  // Records the generation of the levels after the first from the first,
+  // which the render pass has left in layout. All levels are left in
+  // layout, see MipmapGenerator::record.
+  void generateMipmaps(VkCommandBuffer command, VkImageLayout layout)
+  {
+    this->mipmap_generator->record(command,
+                                   this->image->image,
+                                   this->extent,
+                                   this->subresource_range,
+                                   layout,
+                                   layout,
+                                   VK_ACCESS_MEMORY_READ_BIT);
   }
 
 public:
   VkFormat format;
   VkImageUsageFlags usage;
+  bool mipmaps;
+  VkExtent3D extent{ 0, 0, 0 };
   VkImageSubresourceRange subresource_range;
 
   VkComponentMapping component_mapping{
@@ -1320,6 +2976,8 @@ public:
   std::shared_ptr<VulkanImage> image;
   std::shared_ptr<ImageObject> imageobject;
   std::shared_ptr<VulkanImageView> imageview;
+  std::shared_ptr<VulkanImageView> framebuffer_view;
+  std::unique_ptr<MipmapGenerator> mipmap_generator;
 };
 
 class FramebufferObject : public Node {
@@ -1351,11 +3009,689 @@ private:
     this->doAlloc(context);
   }
 
+  void doRecord(RenderManager * recorder) override
+  {
+    for (auto & attachment : this->attachments) {
+      if (attachment->subresource_range.aspectMask & VK_IMAGE_ASPECT_DEPTH_BIT) {
+        recorder->state.depth_attachment = attachment.get();
+      }
+    }
+  }
+
 public:
   std::unique_ptr<VulkanFramebuffer> framebuffer;
   std::vector<std::shared_ptr<FramebufferAttachment>> attachments;
 };
 
+// Culls indexed indirect draws on the GPU. Reads drawcount commands from
+// the indirect buffer in the state, and one bounding sphere per command
+// (center and radius in model space, as a vec4) from the current buffer.
+// The commands of visible objects are compacted into this node's argument
+// buffer, and their number is written to its count buffer. Both replace
+// the indirect buffers in the state, for a following drawindexedindirect.
+// Objects are tested against the view frustum and against a depth pyramid
+// built from the depth attachment as the previous frame left it, so objects
+// that become visible show up one frame late.
+class GpuCulling : public Node {
+public:
+  NO_COPY_OR_ASSIGNMENT(GpuCulling)
+  GpuCulling() = delete;
+  virtual ~GpuCulling() = default;
+
+  explicit GpuCulling(uint32_t drawcount) :
+    drawcount(drawcount),
+    pyramid_shader(std::make_shared<Shader>("Shaders/depthpyramid.comp",
+                                            VK_SHADER_STAGE_COMPUTE_BIT,
+                                            shaderc_optimization_level_performance)),
+    cull_shader(std::make_shared<Shader>("Shaders/cull.comp",
+                                         VK_SHADER_STAGE_COMPUTE_BIT,
+                                         shaderc_optimization_level_performance))
+  {
+    if (drawcount == 0) {
+      throw std::runtime_error("GpuCulling: drawcount must be greater than 0");
+    }
+  }
+
+private:
+  // matches the Culling uniform block in cull.comp (std140)
+  struct Uniforms {
+    glm::mat4 modelview;
+    glm::mat4 projection;
+    glm::vec4 planes[6];
+    glm::vec2 pyramid_size;
+    float scale;
+    uint32_t command_count;
+    uint32_t occlusion;
+  };
+
+  void doAlloc(RenderManager * context) override
+  {
+    this->pyramid_shader->alloc(context);
+    this->cull_shader->alloc(context);
+
+    const VkBufferUsageFlags usage = 
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | 
+      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | 
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    this->commands = this->createBuffer(context, 
+                                        this->drawcount * sizeof(VkDrawIndexedIndirectCommand),
+                                        usage,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    this->count = this->createBuffer(context,
+                                     sizeof(uint32_t),
+                                     usage,
+                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    this->uniforms = this->createBuffer(context,
+                                        sizeof(Uniforms),
+                                        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    this->doResize(context);
+  }
+
+  void doResize(RenderManager * context) override
+  {
+    // the largest power of two size that fits, so that every level halves evenly
+    const auto floor_pow2 = [](uint32_t value) {
+      uint32_t result = 1;
+      while (result * 2 <= value) {
+        result *= 2;
+      }
+      return result;
+    };
+
+    this->pyramid_extent = {
+      floor_pow2(context->extent.width),
+      floor_pow2(context->extent.height),
+      1
+    };
+
+    this->pyramid_levels = 1;
+    while ((std::max(this->pyramid_extent.width, this->pyramid_extent.height) >> this->pyramid_levels) > 0) {
+      this->pyramid_levels++;
+    }
+
+    this->pyramid = std::make_shared<VulkanImage>(context->device,
+                                                  VK_IMAGE_TYPE_2D,
+                                                  VK_FORMAT_R32_SFLOAT,
+                                                  this->pyramid_extent,
+                                                  this->pyramid_levels,
+                                                  1,
+                                                  VK_SAMPLE_COUNT_1_BIT,
+                                                  VK_IMAGE_TILING_OPTIMAL,
+                                                  VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                                  VK_SHARING_MODE_EXCLUSIVE);
+
+    this->pyramid_object = std::make_shared<ImageObject>(this->pyramid, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    const auto memory = std::make_shared<VulkanMemory>(context->device,
+                                                       this->pyramid_object->memory_requirements.size,
+                                                       this->pyramid_object->memory_type_index);
+    const VkDeviceSize offset = 0;
+    this->pyramid_object->bind(memory, offset);
+
+    const VkComponentMapping component_mapping{
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY,
+      VK_COMPONENT_SWIZZLE_IDENTITY
+    };
+
+    this->pyramid_view = std::make_unique<VulkanImageView>(context->device,
+                                                           this->pyramid->image,
+                                                           VK_FORMAT_R32_SFLOAT,
+                                                           VK_IMAGE_VIEW_TYPE_2D,
+                                                           component_mapping,
+                                                           VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, this->pyramid_levels, 0, 1 });
+
+    this->pyramid_level_views.clear();
+    for (uint32_t level = 0; level < this->pyramid_levels; level++) {
+      this->pyramid_level_views.push_back(std::make_unique<VulkanImageView>(context->device,
+                                                                            this->pyramid->image,
+                                                                            VK_FORMAT_R32_SFLOAT,
+                                                                            VK_IMAGE_VIEW_TYPE_2D,
+                                                                            component_mapping,
+                                                                            VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 }));
+    }
+
+    // the depth attachment is new, it has no depth to build a pyramid from
+    this->depth_valid = false;
+  }
+
+  void doPipeline(RenderManager * creator) override
+  {
+    // the shaders only contribute to the pipelines of this node
+    StateScope<RenderManager, State> scope(creator);
+    creator->state = State();
+    this->pyramid_shader->pipeline(creator);
+    this->cull_shader->pipeline(creator);
+
+    this->pyramid_allocator = creator->registry->getDescriptorAllocator({
+      { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+    });
+
+    this->cull_allocator = creator->registry->getDescriptorAllocator({
+      { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 5, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+    });
+
+    this->pyramid_layout = creator->registry->getPipelineLayout(
+      std::vector<VkDescriptorSetLayout>{ this->pyramid_allocator->layout->layout }, {});
+
+    this->cull_layout = creator->registry->getPipelineLayout(
+      std::vector<VkDescriptorSetLayout>{ this->cull_allocator->layout->layout }, {});
+
+    this->pyramid_pipeline = creator->registry->getComputePipelineAsync(
+      creator->pipelinecache,
+      creator->state.shader_stage_infos[0],
+      creator->state.shader_modules[0],
+      this->pyramid_layout);
+
+    this->cull_pipeline = creator->registry->getComputePipelineAsync(
+      creator->pipelinecache,
+      creator->state.shader_stage_infos[1],
+      creator->state.shader_modules[1],
+      this->cull_layout);
+
+    this->sampler = creator->registry->getSampler(VK_FILTER_NEAREST,
+                                                  VK_FILTER_NEAREST,
+                                                  VK_SAMPLER_MIPMAP_MODE_NEAREST,
+                                                  VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                                  VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                                  VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+                                                  0.0f,
+                                                  VK_FALSE,
+                                                  1.0f,
+                                                  VK_FALSE,
+                                                  VK_COMPARE_OP_ALWAYS,
+                                                  0.0f,
+                                                  VK_LOD_CLAMP_NONE,
+                                                  VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE,
+                                                  VK_FALSE);
+  }
+
+  void doRecord(RenderManager * recorder) override
+  {
+    State & state = recorder->state;
+    if (!state.indirect_buffer || !state.buffer || !state.depth_attachment) {
+      throw std::runtime_error("GpuCulling: requires an indirect buffer, a bounding sphere buffer and a depth attachment");
+    }
+    this->depth_attachment = state.depth_attachment;
+
+    // level 0 is built from the depth attachment, every other level from the one before it
+    this->pyramid_sets.clear();
+    for (uint32_t level = 0; level < this->pyramid_levels; level++) {
+      VulkanDescriptorInfo source{};
+      source.image = {
+        this->sampler->sampler,                                                              // sampler
+        level == 0 ? this->depth_attachment->imageview->view : this->pyramid_level_views[level - 1]->view, // imageView
+        level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL,     // imageLayout
+      };
+
+      VulkanDescriptorInfo destination{};
+      destination.image = {
+        nullptr,                                                                             // sampler
+        this->pyramid_level_views[level]->view,                                              // imageView
+        VK_IMAGE_LAYOUT_GENERAL,                                                             // imageLayout
+      };
+
+      auto descriptor_set = std::make_unique<DescriptorSet>(this->pyramid_allocator);
+      descriptor_set->update({ source, destination });
+      this->pyramid_sets.push_back(std::move(descriptor_set));
+    }
+
+    std::vector<VulkanDescriptorInfo> infos(6);
+    infos[0].buffer = { state.indirect_buffer, 0, VK_WHOLE_SIZE };
+    infos[1].buffer = { state.buffer, 0, VK_WHOLE_SIZE };
+    infos[2].buffer = { this->commands->buffer->buffer, 0, VK_WHOLE_SIZE };
+    infos[3].buffer = { this->count->buffer->buffer, 0, VK_WHOLE_SIZE };
+    infos[4].image = { this->sampler->sampler, this->pyramid_view->view, VK_IMAGE_LAYOUT_GENERAL };
+    infos[5].buffer = { this->uniforms->buffer->buffer, 0, VK_WHOLE_SIZE };
+
+    this->cull_set = std::make_unique<DescriptorSet>(this->cull_allocator);
+    this->cull_set->update(infos);
+
+    state.indirect_buffer = this->commands->buffer->buffer;
+    state.indirect_count_buffer = this->count->buffer->buffer;
+  }
+
+  void doRender(SceneRenderer * renderer) override
+  {
+    if (renderer->phase != SceneRenderer::Phase::Compute) {
+      return;
+    }
+    VkCommandBuffer command = renderer->command->buffer();
+
+    this->updateUniforms(renderer->state);
+
+    // commands past the draw count stay empty for devices without draw count support
+    vkCmdFillBuffer(command, this->commands->buffer->buffer, 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(command, this->count->buffer->buffer, 0, VK_WHOLE_SIZE, 0);
+
+    // nothing is drawn until both pipelines are compiled
+    if (this->pyramid_pipeline->ready() && this->cull_pipeline->ready()) {
+      this->memoryBarrier(command,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+      this->buildPyramid(command);
+      this->cull(command);
+    }
+
+    this->memoryBarrier(command,
+                        VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                        VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+
+    // the render pass is about to write depth
+    this->depth_valid = true;
+  }
+
+  void updateUniforms(const RenderState & state)
+  {
+    const glm::mat4 modelview(state.ViewMatrix * state.ModelMatrix);
+    const glm::mat4 projection(state.ProjMatrix);
+    const glm::mat4 m = projection * modelview;
+
+    const auto row = [&m](int i) {
+      return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    };
+
+    // clip space planes pulled back to model space, normalized so that
+    // plane distances are model space distances (depth range is [0, 1])
+    Uniforms data{};
+    data.modelview = modelview;
+    data.projection = projection;
+    data.planes[0] = row(3) + row(0);
+    data.planes[1] = row(3) - row(0);
+    data.planes[2] = row(3) + row(1);
+    data.planes[3] = row(3) - row(1);
+    data.planes[4] = row(2);
+    data.planes[5] = row(3) - row(2);
+    for (auto & plane : data.planes) {
+      plane /= glm::length(glm::vec3(plane));
+    }
+    data.pyramid_size = glm::vec2(this->pyramid_extent.width, this->pyramid_extent.height);
+    data.scale = std::max(glm::length(glm::vec3(modelview[0])),
+                          std::max(glm::length(glm::vec3(modelview[1])),
+                                   glm::length(glm::vec3(modelview[2]))));
+    data.command_count = this->drawcount;
+    data.occlusion = this->depth_valid ? 1 : 0;
+
+    this->uniforms->memcpy(&data, sizeof(Uniforms));
+  }
+
+  void buildPyramid(VkCommandBuffer command)
+  {
+    const VkImageSubresourceRange pyramid_range{ VK_IMAGE_ASPECT_COLOR_BIT, 0, this->pyramid_levels, 0, 1 };
+
+    // the whole pyramid is rebuilt, so its old contents can be discarded
+    std::vector<VkImageMemoryBarrier> barriers{ {
+      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                    // sType
+      nullptr,                                                   // pNext
+      0,                                                         // srcAccessMask
+      VK_ACCESS_SHADER_WRITE_BIT,                                // dstAccessMask
+      VK_IMAGE_LAYOUT_UNDEFINED,                                 // oldLayout
+      VK_IMAGE_LAYOUT_GENERAL,                                   // newLayout
+      VK_QUEUE_FAMILY_IGNORED,                                   // srcQueueFamilyIndex
+      VK_QUEUE_FAMILY_IGNORED,                                   // dstQueueFamilyIndex
+      this->pyramid->image,                                      // image
+      pyramid_range,                                             // subresourceRange
+    } };
+
+    if (this->depth_valid) {
+      barriers.push_back({
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                  // sType
+        nullptr,                                                 // pNext
+        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,            // srcAccessMask
+        VK_ACCESS_SHADER_READ_BIT,                               // dstAccessMask
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,        // oldLayout
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,                // newLayout
+        VK_QUEUE_FAMILY_IGNORED,                                 // srcQueueFamilyIndex
+        VK_QUEUE_FAMILY_IGNORED,                                 // dstQueueFamilyIndex
+        this->depth_attachment->image->image,                    // image
+        this->depth_attachment->subresource_range,               // subresourceRange
+      });
+    }
+
+    vkCmdPipelineBarrier(command,
+                         VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    if (!this->depth_valid) {
+      return;
+    }
+
+    vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, this->pyramid_pipeline->get()->pipeline);
+
+    for (uint32_t level = 0; level < this->pyramid_levels; level++) {
+      vkCmdBindDescriptorSets(command,
+                              VK_PIPELINE_BIND_POINT_COMPUTE,
+                              this->pyramid_layout->layout,
+                              0,
+                              1,
+                              &this->pyramid_sets[level]->descriptor_set,
+                              0,
+                              nullptr);
+
+      const uint32_t width = std::max(this->pyramid_extent.width >> level, 1u);
+      const uint32_t height = std::max(this->pyramid_extent.height >> level, 1u);
+      vkCmdDispatch(command, (width + 7) / 8, (height + 7) / 8, 1);
+
+      this->memoryBarrier(command,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+    }
+
+    // back to the layout the render pass leaves it in
+    VkImageMemoryBarrier depth_barrier{
+      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                    // sType
+      nullptr,                                                   // pNext
+      VK_ACCESS_SHADER_READ_BIT,                                 // srcAccessMask
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+      VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,              // dstAccessMask
+      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,                  // oldLayout
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,          // newLayout
+      VK_QUEUE_FAMILY_IGNORED,                                   // srcQueueFamilyIndex
+      VK_QUEUE_FAMILY_IGNORED,                                   // dstQueueFamilyIndex
+      this->depth_attachment->image->image,                      // image
+      this->depth_attachment->subresource_range,                 // subresourceRange
+    };
+
+    vkCmdPipelineBarrier(command,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+                         0,
+                         0, nullptr,
+                         0, nullptr,
+                         1, &depth_barrier);
+  }
+
+  void cull(VkCommandBuffer command)
+  {
+    vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, this->cull_pipeline->get()->pipeline);
+
+    vkCmdBindDescriptorSets(command,
+                            VK_PIPELINE_BIND_POINT_COMPUTE,
+                            this->cull_layout->layout,
+                            0,
+                            1,
+                            &this->cull_set->descriptor_set,
+                            0,
+                            nullptr);
+
+    vkCmdDispatch(command, (this->drawcount + 63) / 64, 1, 1);
+  }
+
+public:
+  static void memoryBarrier(VkCommandBuffer command,
+                            VkPipelineStageFlags src_stage,
+                            VkAccessFlags src_access,
+                            VkPipelineStageFlags dst_stage,
+                            VkAccessFlags dst_access)
+  {
+    VkMemoryBarrier barrier{
+      VK_STRUCTURE_TYPE_MEMORY_BARRIER,              // sType
+      nullptr,                                       // pNext
+      src_access,                                    // srcAccessMask
+      dst_access,                                    // dstAccessMask
+    };
+
+    vkCmdPipelineBarrier(command,
+                         src_stage,
+                         dst_stage,
+                         0,
+                         1, &barrier,
+                         0, nullptr,
+                         0, nullptr);
+  }
+
+  static std::shared_ptr<BufferObject> createBuffer(RenderManager * context,
+                                                    VkDeviceSize size,
+                                                    VkBufferUsageFlags usage,
+                                                    VkMemoryPropertyFlags memory_property_flags)
+  {
+    auto buffer = std::make_shared<BufferObject>(
+      std::make_shared<VulkanBuffer>(context->device,
+                                     0,
+                                     size,
+                                     usage,
+                                     VK_SHARING_MODE_EXCLUSIVE),
+      memory_property_flags);
+
+    context->bufferobjects.push_back(buffer);
+    return buffer;
+  }
+
+private:
+  uint32_t drawcount;
+  std::shared_ptr<Shader> pyramid_shader;
+  std::shared_ptr<Shader> cull_shader;
+
+  std::shared_ptr<BufferObject> commands;
+  std::shared_ptr<BufferObject> count;
+  std::shared_ptr<BufferObject> uniforms;
+
+  VkExtent3D pyramid_extent{ 1, 1, 1 };
+  uint32_t pyramid_levels{ 1 };
+  std::shared_ptr<VulkanImage> pyramid;
+  std::shared_ptr<ImageObject> pyramid_object;
+  std::unique_ptr<VulkanImageView> pyramid_view;
+  std::vector<std::unique_ptr<VulkanImageView>> pyramid_level_views;
+  FramebufferAttachment * depth_attachment{ nullptr };
+  bool depth_valid{ false };
+
+  std::shared_ptr<VulkanSampler> sampler;
+  std::shared_ptr<DescriptorAllocator> pyramid_allocator;
+  std::shared_ptr<DescriptorAllocator> cull_allocator;
+  std::vector<std::unique_ptr<DescriptorSet>> pyramid_sets;
+  std::unique_ptr<DescriptorSet> cull_set;
+  std::shared_ptr<VulkanPipelineLayout> pyramid_layout;
+  std::shared_ptr<VulkanPipelineLayout> cull_layout;
+  std::shared_ptr<AsyncObject<VulkanComputePipeline>> pyramid_pipeline;
+  std::shared_ptr<AsyncObject<VulkanComputePipeline>> cull_pipeline;
+};
+
+// Culls the meshlets of an indexed mesh on the GPU, see build_meshlets.
+// Reads meshletcount meshlets from the current buffer, and writes an
+// indexed indirect command for each meshlet that is inside the view
+// frustum and does not face away from the camera into this node's argument
+// buffer, and their number into its count buffer. Both replace the indirect
+// buffers in the state, for a following drawindexedindirect of meshletcount
+// commands with the mesh's index buffer. The meshlet bounds are in the
+// model space of this node, so it must precede the transform that restores
+// quantized positions, and the cone test assumes back faces are culled.
+class MeshletCulling : public Node {
+public:
+  NO_COPY_OR_ASSIGNMENT(MeshletCulling)
+  MeshletCulling() = delete;
+  virtual ~MeshletCulling() = default;
+
+  explicit MeshletCulling(uint32_t meshletcount) :
+    meshletcount(meshletcount),
+    shader(std::make_shared<Shader>("Shaders/meshletcull.comp",
+                                    VK_SHADER_STAGE_COMPUTE_BIT,
+                                    shaderc_optimization_level_performance))
+  {
+    if (meshletcount == 0) {
+      throw std::runtime_error("MeshletCulling: meshletcount must be greater than 0");
+    }
+  }
+
+private:
+  // matches the Culling uniform block in meshletcull.comp (std140)
+  struct Uniforms {
+    glm::vec4 planes[6];
+    glm::vec4 camera;
+    uint32_t meshlet_count;
+  };
+
+  void doAlloc(RenderManager * context) override
+  {
+    this->shader->alloc(context);
+
+    const VkBufferUsageFlags usage =
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    this->commands = GpuCulling::createBuffer(context,
+                                              this->meshletcount * sizeof(VkDrawIndexedIndirectCommand),
+                                              usage,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    this->count = GpuCulling::createBuffer(context,
+                                           sizeof(uint32_t),
+                                           usage,
+                                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    this->uniforms = GpuCulling::createBuffer(context,
+                                              sizeof(Uniforms),
+                                              VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  }
+
+  void doPipeline(RenderManager * creator) override
+  {
+    // the shader only contributes to the pipeline of this node
+    StateScope<RenderManager, State> scope(creator);
+    creator->state = State();
+    this->shader->pipeline(creator);
+
+    this->allocator = creator->registry->getDescriptorAllocator({
+      { 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+      { 3, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+    });
+
+    this->layout = creator->registry->getPipelineLayout(
+      std::vector<VkDescriptorSetLayout>{ this->allocator->layout->layout }, {});
+
+    this->pipeline = creator->registry->getComputePipelineAsync(
+      creator->pipelinecache,
+      creator->state.shader_stage_infos[0],
+      creator->state.shader_modules[0],
+      this->layout);
+  }
+
+  void doRecord(RenderManager * recorder) override
+  {
+    State & state = recorder->state;
+    if (!state.buffer) {
+      throw std::runtime_error("MeshletCulling: requires a meshlet buffer");
+    }
+    // after the transform, the planes would be in the quantized space
+    if (state.dequantized) {
+      throw std::runtime_error("MeshletCulling: must precede the transform of meshquantize or meshfilevertices");
+    }
+
+    std::vector<VulkanDescriptorInfo> infos(4);
+    infos[0].buffer = { state.buffer, 0, VK_WHOLE_SIZE };
+    infos[1].buffer = { this->commands->buffer->buffer, 0, VK_WHOLE_SIZE };
+    infos[2].buffer = { this->count->buffer->buffer, 0, VK_WHOLE_SIZE };
+    infos[3].buffer = { this->uniforms->buffer->buffer, 0, VK_WHOLE_SIZE };
+
+    this->descriptor_set = std::make_unique<DescriptorSet>(this->allocator);
+    this->descriptor_set->update(infos);
+
+    state.indirect_buffer = this->commands->buffer->buffer;
+    state.indirect_count_buffer = this->count->buffer->buffer;
+  }
+
+  void doRender(SceneRenderer * renderer) override
+  {
+    if (renderer->phase != SceneRenderer::Phase::Compute) {
+      return;
+    }
+    VkCommandBuffer command = renderer->command->buffer();
+
+    this->updateUniforms(renderer->state);
+
+    // commands past the draw count stay empty for devices without draw count support
+    vkCmdFillBuffer(command, this->commands->buffer->buffer, 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(command, this->count->buffer->buffer, 0, VK_WHOLE_SIZE, 0);
+
+    // nothing is drawn until the pipeline is compiled
+    if (this->pipeline->ready()) {
+      GpuCulling::memoryBarrier(command,
+                                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+      vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, this->pipeline->get()->pipeline);
+
+      vkCmdBindDescriptorSets(command,
+                              VK_PIPELINE_BIND_POINT_COMPUTE,
+                              this->layout->layout,
+                              0,
+                              1,
+                              &this->descriptor_set->descriptor_set,
+                              0,
+                              nullptr);
+
+      vkCmdDispatch(command, (this->meshletcount + 63) / 64, 1, 1);
+    }
+
+    GpuCulling::memoryBarrier(command,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                              VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                              VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                              VK_ACCESS_INDIRECT_COMMAND_READ_BIT);
+  }
+
+  void updateUniforms(const RenderState & state)
+  {
+    const glm::dmat4 modelview = state.ViewMatrix * state.ModelMatrix;
+    const glm::mat4 m(state.ProjMatrix * modelview);
+
+    const auto row = [&m](int i) {
+      return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    };
+
+    // clip space planes pulled back to model space, normalized so that
+    // plane distances are model space distances (depth range is [0, 1])
+    Uniforms data{};
+    data.planes[0] = row(3) + row(0);
+    data.planes[1] = row(3) - row(0);
+    data.planes[2] = row(3) + row(1);
+    data.planes[3] = row(3) - row(1);
+    data.planes[4] = row(2);
+    data.planes[5] = row(3) - row(2);
+    for (auto & plane : data.planes) {
+      plane /= glm::length(glm::vec3(plane));
+    }
+    data.camera = glm::vec4(glm::inverse(modelview) * glm::dvec4(0.0, 0.0, 0.0, 1.0));
+    data.meshlet_count = this->meshletcount;
+
+    this->uniforms->memcpy(&data, sizeof(Uniforms));
+  }
+
+  uint32_t meshletcount;
+  std::shared_ptr<Shader> shader;
+
+  std::shared_ptr<BufferObject> commands;
+  std::shared_ptr<BufferObject> count;
+  std::shared_ptr<BufferObject> uniforms;
+
+  std::shared_ptr<DescriptorAllocator> allocator;
+  std::unique_ptr<DescriptorSet> descriptor_set;
+  std::shared_ptr<VulkanPipelineLayout> layout;
+  std::shared_ptr<AsyncObject<VulkanComputePipeline>> pipeline;
+};
+
 class SubpassObject {
 public:
   NO_COPY_OR_ASSIGNMENT(SubpassObject)
@@ -1418,6 +3754,7 @@ private:
     this->render_command = std::make_unique<VulkanCommandBuffers>(context->device);
     this->render_queue = context->device->getQueue(VK_QUEUE_GRAPHICS_BIT);
     this->render_fence = std::make_unique<VulkanFence>(context->device);
+    context->frame_fences.push_back(this->render_fence);
     this->rendering_finished = std::make_unique<VulkanSemaphore>(context->device);
 
     this->renderpass = std::make_shared<VulkanRenderpass>(context->device,
@@ -1444,6 +3781,46 @@ private:
   {
     recorder->state.renderpass = this->renderpass;
     Group::doRecord(recorder);
+    this->recordMipmaps(recorder);
+  }
+
+  // Records the generation of the levels of the attachments with mip
+  // chains, to run when the pass has ended. The levels are generated from
+  // and left in the final layout of their attachment.
+  void recordMipmaps(RenderManager * recorder)
+  {
+    this->mipmap_command.reset();
+
+    std::shared_ptr<FramebufferObject> framebuffer = this->children.empty() ? nullptr :
+      std::dynamic_pointer_cast<FramebufferObject>(this->children[0]);
+
+    if (!framebuffer) {
+      return;
+    }
+
+    std::vector<size_t> mipmapped;
+    for (size_t i = 0; i < framebuffer->attachments.size(); i++) {
+      if (framebuffer->attachments[i]->subresource_range.levelCount > 1) {
+        mipmapped.push_back(i);
+      }
+    }
+    if (mipmapped.empty()) {
+      return;
+    }
+    if (framebuffer->attachments.size() > this->attachments.size()) {
+      throw std::runtime_error("RenderpassObject::recordMipmaps(): Framebuffer has more attachments than the renderpass!");
+    }
+
+    this->mipmap_command = std::make_unique<VulkanCommandBuffers>(
+      recorder->device,
+      1,
+      VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+    VulkanCommandBufferScope command_scope(this->mipmap_command->buffer());
+    for (size_t i : mipmapped) {
+      framebuffer->attachments[i]->generateMipmaps(this->mipmap_command->buffer(),
+                                                   this->attachments[i].finalLayout);
+    }
   }
 
   void doRender(SceneRenderer * renderer) override
@@ -1471,16 +3848,32 @@ private:
 
     {
       renderer->command = this->render_command.get();
+      const SceneRenderer::Phase phase = renderer->phase;
 
       VulkanCommandBufferScope commandbuffer(this->render_command->buffer());
 
-      VulkanRenderPassScope renderpass_scope(this->renderpass->renderpass,
-                                             framebuffer->framebuffer->framebuffer,
-                                             renderarea,
-                                             clearvalues,
-                                             this->render_command->buffer());
+      {
+        StateScope<SceneRenderer, RenderState> scope(renderer);
+        renderer->phase = SceneRenderer::Phase::Compute;
+        Group::doRender(renderer);
+      }
+      renderer->phase = SceneRenderer::Phase::Graphics;
+      {
+        VulkanRenderPassScope renderpass_scope(this->renderpass->renderpass,
+                                               framebuffer->framebuffer->framebuffer,
+                                               renderarea,
+                                               clearvalues,
+                                               this->render_command->buffer());
+
+        Group::doRender(renderer);
+      }
+      renderer->phase = phase;
 
-      Group::doRender(renderer);
+      if (this->mipmap_command) {
+        vkCmdExecuteCommands(this->render_command->buffer(),
+                             static_cast<uint32_t>(this->mipmap_command->buffers.size()),
+                             this->mipmap_command->buffers.data());
+      }
     }
 
     FenceScope fence(renderer->device->device, this->render_fence->fence);
@@ -1499,6 +3892,7 @@ private:
   VkQueue render_queue{ nullptr };
   std::unique_ptr<VulkanSemaphore> rendering_finished;
   std::unique_ptr<VulkanCommandBuffers> render_command;  
+  std::unique_ptr<VulkanCommandBuffers> mipmap_command;
   std::shared_ptr<VulkanFence> render_fence;
   std::shared_ptr<VulkanRenderpass> renderpass;
 };
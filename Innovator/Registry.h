@@ -0,0 +1,669 @@
+#pragma once
+
+#include <Innovator/Defines.h>
+#include <Innovator/Cache.h>
+#include <Innovator/Wrapper.h>
+#include <Innovator/ThreadPool.h>
+
+#include <vulkan/vulkan.h>
+
+#include <cstring>
+#include <memory>
+#include <iterator>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <future>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+
+// Serializes create info members into a key, and accumulates an FNV-1a
+// hash of it. Structs are serialized member by member, since padding bytes
+// in them are not initialized.
+class Hasher {
+public:
+  template <typename T>
+  Hasher & operator()(const T & value)
+  {
+    static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value || std::is_pointer<T>::value,
+                  "Hasher: hash structs member by member");
+    return this->bytes(&value, sizeof(T));
+  }
+
+  Hasher & operator()(const char * str)
+  {
+    const std::string string(str ? str : "");
+    // including the terminator, so that consecutive strings can not run together
+    return this->bytes(string.c_str(), string.size() + 1);
+  }
+
+  Hasher & bytes(const void * data, size_t size)
+  {
+    this->hash = fnv1a(data, size, this->hash);
+    this->key.append(static_cast<const char *>(data), size);
+    return *this;
+  }
+
+  Hasher & operator()(const VkDescriptorSetLayoutBinding & binding)
+  {
+    return (*this)(binding.binding)(binding.descriptorType)(binding.descriptorCount)(binding.stageFlags)(binding.pImmutableSamplers);
+  }
+
+  Hasher & operator()(const VkPushConstantRange & range)
+  {
+    return (*this)(range.stageFlags)(range.offset)(range.size);
+  }
+
+  Hasher & operator()(const VkVertexInputBindingDescription & binding)
+  {
+    return (*this)(binding.binding)(binding.stride)(binding.inputRate);
+  }
+
+  Hasher & operator()(const VkVertexInputAttributeDescription & attribute)
+  {
+    return (*this)(attribute.location)(attribute.binding)(attribute.format)(attribute.offset);
+  }
+
+  Hasher & operator()(const VkPipelineRasterizationStateCreateInfo & state)
+  {
+    return (*this)(state.flags)(state.depthClampEnable)(state.rasterizerDiscardEnable)(state.polygonMode)
+      (state.cullMode)(state.frontFace)(state.depthBiasEnable)(state.depthBiasConstantFactor)
+      (state.depthBiasClamp)(state.depthBiasSlopeFactor)(state.lineWidth);
+  }
+
+  Hasher & operator()(const VkPipelineShaderStageCreateInfo & stage)
+  {
+    (*this)(stage.flags)(stage.stage)(stage.module)(stage.pName);
+    if (stage.pSpecializationInfo) {
+      const VkSpecializationInfo & info = *stage.pSpecializationInfo;
+      (*this)(info.mapEntryCount);
+      for (uint32_t i = 0; i < info.mapEntryCount; i++) {
+        (*this)(info.pMapEntries[i].constantID)(info.pMapEntries[i].offset)(info.pMapEntries[i].size);
+      }
+      (*this)(info.dataSize).bytes(info.pData, info.dataSize);
+    }
+    return *this;
+  }
+
+  template <typename T>
+  Hasher & operator()(const std::vector<T> & values)
+  {
+    (*this)(values.size());
+    for (auto & value : values) {
+      (*this)(value);
+    }
+    return *this;
+  }
+
+  uint64_t hash{ 14695981039346656037ull };
+  std::string key;
+};
+
+// Maps keys to objects that are shared for as long as anyone uses them.
+// Objects are found by the hash of their key and the full keys are
+// compared, so objects with colliding hashes are kept side by side.
+template <typename T>
+class ObjectCache {
+public:
+  std::shared_ptr<T> get(const Hasher & key, const std::function<std::shared_ptr<T>()> & create)
+  {
+    auto it = this->objects.find(key.hash);
+    if (it != this->objects.end()) {
+      for (auto & entry : it->second) {
+        if (entry.key == key.key) {
+          if (auto object = entry.object.lock()) {
+            return object;
+          }
+        }
+      }
+    }
+    if (this->count >= this->prune_size) {
+      this->prune();
+    }
+    std::shared_ptr<T> object = create();
+    // create may have used other caches, look up the bucket again
+    std::vector<Entry> & entries = this->objects[key.hash];
+    auto entry = std::find_if(entries.begin(), entries.end(), [&](const Entry & entry) {
+      return entry.key == key.key;
+    });
+    if (entry == entries.end()) {
+      entries.push_back({ key.key, object });
+      this->count++;
+    }
+    else {
+      entry->object = object;
+    }
+    return object;
+  }
+
+private:
+  struct Entry {
+    std::string key;
+    std::weak_ptr<T> object;
+  };
+
+  void prune()
+  {
+    this->count = 0;
+    for (auto it = this->objects.begin(); it != this->objects.end();) {
+      std::vector<Entry> & entries = it->second;
+      entries.erase(std::remove_if(entries.begin(), entries.end(), [](const Entry & entry) {
+        return entry.object.expired();
+      }), entries.end());
+      this->count += entries.size();
+      it = entries.empty() ? this->objects.erase(it) : std::next(it);
+    }
+    this->prune_size = std::max<size_t>(64, this->count * 2);
+  }
+
+  std::unordered_map<uint64_t, std::vector<Entry>> objects;
+  size_t count{ 0 };
+  size_t prune_size{ 64 };
+};
+
+// An object that is created on a worker thread. Users poll ready() and
+// switch over to the object once it is there, get() waits for it.
+template <typename T>
+class AsyncObject {
+public:
+  NO_COPY_OR_ASSIGNMENT(AsyncObject)
+  AsyncObject() = delete;
+  ~AsyncObject() = default;
+
+  explicit AsyncObject(std::shared_future<std::shared_ptr<T>> future) :
+    future(std::move(future))
+  {}
+
+  bool ready() const
+  {
+    return this->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
+  // rethrows the exception thrown while creating the object, if any
+  std::shared_ptr<T> get() const
+  {
+    return this->future.get();
+  }
+
+  std::shared_future<std::shared_ptr<T>> future;
+};
+
+// Deep copy of shader stage create infos, which point into the Shader
+// nodes, so that pipelines can be created after the nodes have changed.
+// Also keeps the shader modules alive until the pipeline is created.
+class ShaderStages {
+public:
+  NO_COPY_OR_ASSIGNMENT(ShaderStages)
+  ShaderStages() = delete;
+  ~ShaderStages() = default;
+
+  ShaderStages(const std::vector<VkPipelineShaderStageCreateInfo> & stages,
+               std::vector<std::shared_ptr<VulkanShaderModule>> modules) :
+    modules(std::move(modules))
+  {
+    // reserve up front, stages point into these
+    this->names.reserve(stages.size());
+    this->specialization_infos.reserve(stages.size());
+    this->map_entries.reserve(stages.size());
+    this->data.reserve(stages.size());
+
+    for (auto stage : stages) {
+      this->names.emplace_back(stage.pName);
+      stage.pName = this->names.back().c_str();
+
+      if (stage.pSpecializationInfo) {
+        const VkSpecializationInfo & info = *stage.pSpecializationInfo;
+        const char * bytes = static_cast<const char *>(info.pData);
+
+        this->map_entries.emplace_back(info.pMapEntries, info.pMapEntries + info.mapEntryCount);
+        this->data.emplace_back(bytes, bytes + info.dataSize);
+        this->specialization_infos.push_back({
+          info.mapEntryCount,                                  // mapEntryCount
+          this->map_entries.back().data(),                     // pMapEntries
+          info.dataSize,                                       // dataSize
+          this->data.back().data(),                            // pData
+        });
+        stage.pSpecializationInfo = &this->specialization_infos.back();
+      }
+      this->stages.push_back(stage);
+    }
+  }
+
+  std::vector<VkPipelineShaderStageCreateInfo> stages;
+
+private:
+  std::vector<std::shared_ptr<VulkanShaderModule>> modules;
+  std::vector<std::string> names;
+  std::vector<VkSpecializationInfo> specialization_infos;
+  std::vector<std::vector<VkSpecializationMapEntry>> map_entries;
+  std::vector<std::vector<char>> data;
+};
+
+// Allocates descriptor sets of one layout from a growing list of pools.
+// Released sets go on a free list and are handed out again before any new
+// pool memory is used, so pools are never freed into or fragmented.
+// Sets must only be released when no pending command buffer uses them.
+class DescriptorAllocator {
+public:
+  NO_COPY_OR_ASSIGNMENT(DescriptorAllocator)
+  DescriptorAllocator() = delete;
+  ~DescriptorAllocator() = default;
+
+  DescriptorAllocator(std::shared_ptr<VulkanDevice> device,
+                      std::shared_ptr<VulkanDescriptorSetLayout> layout,
+                      const std::vector<VkDescriptorSetLayoutBinding> & bindings) :
+    device(std::move(device)),
+    layout(std::move(layout)),
+    bindings(bindings)
+  {
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    for (auto & binding : this->bindings) {
+      auto it = std::find_if(this->pool_sizes.begin(), this->pool_sizes.end(), [&](const VkDescriptorPoolSize & size) {
+        return size.type == binding.descriptorType;
+      });
+      if (it == this->pool_sizes.end()) {
+        this->pool_sizes.push_back({ binding.descriptorType, binding.descriptorCount });
+      }
+      else {
+        it->descriptorCount += binding.descriptorCount;
+      }
+
+      entries.push_back({
+        binding.binding,                                     // dstBinding
+        0,                                                   // dstArrayElement
+        binding.descriptorCount,                             // descriptorCount
+        binding.descriptorType,                              // descriptorType
+        this->descriptor_count * sizeof(VulkanDescriptorInfo), // offset
+        sizeof(VulkanDescriptorInfo),                        // stride
+      });
+      this->descriptor_count += binding.descriptorCount;
+    }
+
+    // a pool needs at least one pool size, even for layouts without bindings
+    if (this->pool_sizes.empty()) {
+      this->pool_sizes.push_back({ VK_DESCRIPTOR_TYPE_SAMPLER, 1 });
+    }
+
+    if (this->device->vkCreateDescriptorUpdateTemplate && !entries.empty()) {
+      this->update_template = std::make_unique<VulkanDescriptorUpdateTemplate>(this->device, entries, this->layout->layout);
+    }
+  }
+
+  VkDescriptorSet allocate()
+  {
+    if (!this->free_sets.empty()) {
+      const VkDescriptorSet descriptor_set = this->free_sets.back();
+      this->free_sets.pop_back();
+      return descriptor_set;
+    }
+
+    if (this->pool_capacity == 0) {
+      // each new pool is twice as large as the previous one
+      this->sets_per_pool = std::min<uint32_t>(this->sets_per_pool * 2, 1024);
+
+      std::vector<VkDescriptorPoolSize> sizes = this->pool_sizes;
+      for (auto & size : sizes) {
+        size.descriptorCount *= this->sets_per_pool;
+      }
+      this->pools.push_back(std::make_unique<VulkanDescriptorPool>(this->device, sizes, this->sets_per_pool, 0));
+      this->pool_capacity = this->sets_per_pool;
+    }
+
+    VkDescriptorSetAllocateInfo allocate_info {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, // sType
+      nullptr,                                        // pNext
+      this->pools.back()->pool,                       // descriptorPool
+      1,                                              // descriptorSetCount
+      &this->layout->layout                           // pSetLayouts
+    };
+
+    VkDescriptorSet descriptor_set;
+    THROW_ON_ERROR(vkAllocateDescriptorSets(this->device->device, &allocate_info, &descriptor_set));
+    this->pool_capacity--;
+    return descriptor_set;
+  }
+
+  void release(VkDescriptorSet descriptor_set)
+  {
+    this->free_sets.push_back(descriptor_set);
+  }
+
+  // infos holds one entry per descriptor, in binding order
+  void update(VkDescriptorSet descriptor_set, const std::vector<VulkanDescriptorInfo> & infos) const
+  {
+    if (infos.size() != this->descriptor_count) {
+      throw std::runtime_error("DescriptorAllocator::update: descriptor count does not match layout");
+    }
+    if (this->update_template) {
+      this->update_template->update(descriptor_set, infos.data());
+      return;
+    }
+
+    // infos are strided by the union size, so write array elements one by one
+    std::vector<VkWriteDescriptorSet> writes;
+    const VulkanDescriptorInfo * info = infos.data();
+    for (auto & binding : this->bindings) {
+      for (uint32_t i = 0; i < binding.descriptorCount; i++, info++) {
+        const bool image = isImageDescriptor(binding.descriptorType);
+        const bool texel_buffer = isTexelBufferDescriptor(binding.descriptorType);
+        writes.push_back({
+          VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,                  // sType
+          nullptr,                                                 // pNext
+          descriptor_set,                                          // dstSet
+          binding.binding,                                         // dstBinding
+          i,                                                       // dstArrayElement
+          1,                                                       // descriptorCount
+          binding.descriptorType,                                  // descriptorType
+          image ? &info->image : nullptr,                          // pImageInfo
+          !image && !texel_buffer ? &info->buffer : nullptr,       // pBufferInfo
+          texel_buffer ? &info->texel_buffer_view : nullptr,       // pTexelBufferView
+        });
+      }
+    }
+    vkUpdateDescriptorSets(this->device->device,
+                           static_cast<uint32_t>(writes.size()),
+                           writes.data(),
+                           0, nullptr);
+  }
+
+  static bool isImageDescriptor(VkDescriptorType type)
+  {
+    return type == VK_DESCRIPTOR_TYPE_SAMPLER ||
+      type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ||
+      type == VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE ||
+      type == VK_DESCRIPTOR_TYPE_STORAGE_IMAGE ||
+      type == VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+  }
+
+  static bool isTexelBufferDescriptor(VkDescriptorType type)
+  {
+    return type == VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER ||
+      type == VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+  }
+
+  std::shared_ptr<VulkanDevice> device;
+  std::shared_ptr<VulkanDescriptorSetLayout> layout;
+  std::vector<VkDescriptorSetLayoutBinding> bindings;
+  size_t descriptor_count{ 0 };
+
+private:
+  std::vector<VkDescriptorPoolSize> pool_sizes;
+  std::unique_ptr<VulkanDescriptorUpdateTemplate> update_template;
+  std::vector<std::unique_ptr<VulkanDescriptorPool>> pools;
+  std::vector<VkDescriptorSet> free_sets;
+  uint32_t sets_per_pool{ 8 };
+  uint32_t pool_capacity{ 0 };
+};
+
+// A descriptor set that returns to its allocator's free list when destroyed
+class DescriptorSet {
+public:
+  NO_COPY_OR_ASSIGNMENT(DescriptorSet)
+  DescriptorSet() = delete;
+
+  explicit DescriptorSet(std::shared_ptr<DescriptorAllocator> allocator) :
+    allocator(std::move(allocator))
+  {
+    this->descriptor_set = this->allocator->allocate();
+  }
+
+  ~DescriptorSet()
+  {
+    this->allocator->release(this->descriptor_set);
+  }
+
+  void update(const std::vector<VulkanDescriptorInfo> & infos)
+  {
+    this->allocator->update(this->descriptor_set, infos);
+    this->infos = infos;
+  }
+
+  // whether the set was last updated with infos
+  bool holds(const std::vector<VulkanDescriptorInfo> & infos) const
+  {
+    return this->infos.size() == infos.size() &&
+      std::memcmp(this->infos.data(), infos.data(), infos.size() * sizeof(VulkanDescriptorInfo)) == 0;
+  }
+
+  std::shared_ptr<DescriptorAllocator> allocator;
+  VkDescriptorSet descriptor_set{ nullptr };
+  std::vector<VulkanDescriptorInfo> infos;
+};
+
+// Device level registry of immutable Vulkan objects. Equal create infos
+// return the same object. Keys contain the handles of the shader modules,
+// layouts and render passes an object was created with, and the users of
+// an object keep those alive, so a handle can not be reused for another
+// object while entries referring to it are still alive.
+// Pipelines can also be compiled on worker threads, all through the same
+// pipeline cache, which is internally synchronized.
+class Registry {
+public:
+  NO_COPY_OR_ASSIGNMENT(Registry)
+  Registry() = delete;
+  ~Registry() = default;
+
+  explicit Registry(std::shared_ptr<VulkanDevice> device,
+                    size_t thread_count = ThreadPool::default_thread_count()) :
+    device(std::move(device)),
+    workers(std::make_unique<ThreadPool>(thread_count))
+  {}
+
+  // blocks until all pipelines requested so far are compiled
+  void wait()
+  {
+    this->workers->wait();
+  }
+
+  std::shared_ptr<VulkanShaderModule> getShaderModule(const std::vector<uint32_t> & code)
+  {
+    const Hasher key = Hasher().bytes(code.data(), code.size() * sizeof(uint32_t));
+    return this->shader_modules.get(key, [&]() {
+      return std::make_shared<VulkanShaderModule>(this->device, code);
+    });
+  }
+
+  std::shared_ptr<VulkanDescriptorSetLayout> getDescriptorSetLayout(
+    const std::vector<VkDescriptorSetLayoutBinding> & bindings)
+  {
+    const Hasher key = Hasher()(bindings);
+    return this->descriptor_set_layouts.get(key, [&]() {
+      return std::make_shared<VulkanDescriptorSetLayout>(this->device, bindings);
+    });
+  }
+
+  // one allocator per distinct layout, shared by all users of the layout
+  std::shared_ptr<DescriptorAllocator> getDescriptorAllocator(
+    const std::vector<VkDescriptorSetLayoutBinding> & bindings)
+  {
+    const Hasher key = Hasher()(bindings);
+    return this->descriptor_allocators.get(key, [&]() {
+      return std::make_shared<DescriptorAllocator>(this->device, this->getDescriptorSetLayout(bindings), bindings);
+    });
+  }
+
+  std::shared_ptr<VulkanPipelineLayout> getPipelineLayout(
+    const std::vector<VkDescriptorSetLayout> & set_layouts,
+    const std::vector<VkPushConstantRange> & push_constant_ranges)
+  {
+    const Hasher key = Hasher()(set_layouts)(push_constant_ranges);
+    return this->pipeline_layouts.get(key, [&]() {
+      return std::make_shared<VulkanPipelineLayout>(this->device, set_layouts, push_constant_ranges);
+    });
+  }
+
+  std::shared_ptr<VulkanGraphicsPipeline> getGraphicsPipeline(
+    VkRenderPass render_pass,
+    VkPipelineCache pipeline_cache,
+    VkPipelineLayout pipeline_layout,
+    VkPrimitiveTopology primitive_topology,
+    const VkPipelineRasterizationStateCreateInfo & rasterization_state,
+    const std::vector<VkDynamicState> & dynamic_states,
+    const std::vector<VkPipelineShaderStageCreateInfo> & shader_stages,
+    const std::vector<VkVertexInputBindingDescription> & binding_descriptions,
+    const std::vector<VkVertexInputAttributeDescription> & attribute_descriptions)
+  {
+    const Hasher key = Hasher()
+      (render_pass)
+      (pipeline_layout)
+      (primitive_topology)
+      (rasterization_state)
+      (dynamic_states)
+      (shader_stages)
+      (binding_descriptions)
+      (attribute_descriptions);
+
+    return this->graphics_pipelines.get(key, [&]() {
+      return std::make_shared<VulkanGraphicsPipeline>(this->device,
+                                                      render_pass,
+                                                      pipeline_cache,
+                                                      pipeline_layout,
+                                                      primitive_topology,
+                                                      rasterization_state,
+                                                      dynamic_states,
+                                                      shader_stages,
+                                                      binding_descriptions,
+                                                      attribute_descriptions);
+    });
+  }
+
+  // The returned object becomes ready when the pipeline is compiled. The
+  // inputs are copied and the objects they refer to are kept alive, so
+  // the state they came from can change while the pipeline compiles.
+  std::shared_ptr<AsyncObject<VulkanGraphicsPipeline>> getGraphicsPipelineAsync(
+    std::shared_ptr<VulkanRenderpass> render_pass,
+    std::shared_ptr<VulkanPipelineCache> pipeline_cache,
+    std::shared_ptr<VulkanPipelineLayout> pipeline_layout,
+    VkPrimitiveTopology primitive_topology,
+    const VkPipelineRasterizationStateCreateInfo & rasterization_state,
+    const std::vector<VkDynamicState> & dynamic_states,
+    const std::vector<VkPipelineShaderStageCreateInfo> & shader_stages,
+    const std::vector<std::shared_ptr<VulkanShaderModule>> & shader_modules,
+    const std::vector<VkVertexInputBindingDescription> & binding_descriptions,
+    const std::vector<VkVertexInputAttributeDescription> & attribute_descriptions)
+  {
+    const Hasher key = Hasher()
+      (render_pass->renderpass)
+      (pipeline_layout->layout)
+      (primitive_topology)
+      (rasterization_state)
+      (dynamic_states)
+      (shader_stages)
+      (binding_descriptions)
+      (attribute_descriptions);
+
+    return this->async_graphics_pipelines.get(key, [&]() {
+      auto stages = std::make_shared<ShaderStages>(shader_stages, shader_modules);
+      auto future = this->workers->submit([=, device = this->device]() {
+        return std::make_shared<VulkanGraphicsPipeline>(device,
+                                                        render_pass->renderpass,
+                                                        pipeline_cache->cache,
+                                                        pipeline_layout->layout,
+                                                        primitive_topology,
+                                                        rasterization_state,
+                                                        dynamic_states,
+                                                        stages->stages,
+                                                        binding_descriptions,
+                                                        attribute_descriptions);
+      });
+      return std::make_shared<AsyncObject<VulkanGraphicsPipeline>>(future.share());
+    });
+  }
+
+  std::shared_ptr<AsyncObject<VulkanComputePipeline>> getComputePipelineAsync(
+    std::shared_ptr<VulkanPipelineCache> pipeline_cache,
+    const VkPipelineShaderStageCreateInfo & stage,
+    std::shared_ptr<VulkanShaderModule> shader_module,
+    std::shared_ptr<VulkanPipelineLayout> pipeline_layout)
+  {
+    const Hasher key = Hasher()(stage)(pipeline_layout->layout);
+    return this->async_compute_pipelines.get(key, [&]() {
+      auto stages = std::make_shared<ShaderStages>(
+        std::vector<VkPipelineShaderStageCreateInfo>{ stage },
+        std::vector<std::shared_ptr<VulkanShaderModule>>{ shader_module });
+
+      auto future = this->workers->submit([=, device = this->device]() {
+        return std::make_shared<VulkanComputePipeline>(device,
+                                                       pipeline_cache->cache,
+                                                       stages->stages[0],
+                                                       pipeline_layout->layout);
+      });
+      return std::make_shared<AsyncObject<VulkanComputePipeline>>(future.share());
+    });
+  }
+
+  std::shared_ptr<VulkanComputePipeline> getComputePipeline(
+    VkPipelineCache pipeline_cache,
+    const VkPipelineShaderStageCreateInfo & stage,
+    VkPipelineLayout pipeline_layout)
+  {
+    const Hasher key = Hasher()(stage)(pipeline_layout);
+    return this->compute_pipelines.get(key, [&]() {
+      return std::make_shared<VulkanComputePipeline>(this->device,
+                                                     pipeline_cache,
+                                                     stage,
+                                                     pipeline_layout);
+    });
+  }
+
+  std::shared_ptr<VulkanSampler> getSampler(VkFilter mag_filter,
+                                            VkFilter min_filter,
+                                            VkSamplerMipmapMode mipmap_mode,
+                                            VkSamplerAddressMode address_mode_u,
+                                            VkSamplerAddressMode address_mode_v,
+                                            VkSamplerAddressMode address_mode_w,
+                                            float mip_lod_bias,
+                                            VkBool32 anisotropy_enable,
+                                            float max_anisotropy,
+                                            VkBool32 compare_enable,
+                                            VkCompareOp compare_op,
+                                            float min_lod,
+                                            float max_lod,
+                                            VkBorderColor border_color,
+                                            VkBool32 unnormalized_coordinates)
+  {
+    const Hasher key = Hasher()
+      (mag_filter)(min_filter)(mipmap_mode)
+      (address_mode_u)(address_mode_v)(address_mode_w)
+      (mip_lod_bias)(anisotropy_enable)(max_anisotropy)
+      (compare_enable)(compare_op)(min_lod)(max_lod)
+      (border_color)(unnormalized_coordinates);
+
+    return this->samplers.get(key, [&]() {
+      return std::make_shared<VulkanSampler>(this->device,
+                                             mag_filter,
+                                             min_filter,
+                                             mipmap_mode,
+                                             address_mode_u,
+                                             address_mode_v,
+                                             address_mode_w,
+                                             mip_lod_bias,
+                                             anisotropy_enable,
+                                             max_anisotropy,
+                                             compare_enable,
+                                             compare_op,
+                                             min_lod,
+                                             max_lod,
+                                             border_color,
+                                             unnormalized_coordinates);
+    });
+  }
+
+  std::shared_ptr<VulkanDevice> device;
+
+private:
+  ObjectCache<VulkanShaderModule> shader_modules;
+  ObjectCache<VulkanDescriptorSetLayout> descriptor_set_layouts;
+  ObjectCache<DescriptorAllocator> descriptor_allocators;
+  ObjectCache<VulkanPipelineLayout> pipeline_layouts;
+  ObjectCache<VulkanGraphicsPipeline> graphics_pipelines;
+  ObjectCache<VulkanComputePipeline> compute_pipelines;
+  ObjectCache<VulkanSampler> samplers;
+  ObjectCache<AsyncObject<VulkanGraphicsPipeline>> async_graphics_pipelines;
+  ObjectCache<AsyncObject<VulkanComputePipeline>> async_compute_pipelines;
+
+  // declared last, so that pending work finishes before anything else is destroyed
+  std::unique_ptr<ThreadPool> workers;
+};
@@ -1,12 +1,15 @@
 #pragma once
 
 #include <Innovator/Defines.h>
+#include <Innovator/Cache.h>
+#include <Innovator/Registry.h>
 #include <Innovator/Node.h>
 #include <Innovator/State.h>
 #include <Innovator/VulkanObjects.h>
 
 #include <map>
 #include <memory>
+#include <algorithm>
 #include <utility>
 #include <vector>
 #include <fstream>
@@ -27,11 +30,17 @@ public:
     extent(extent)
   {}
 
+  // Render passes traverse their children twice: first outside the render
+  // pass, for compute work such as culling, then inside it for the draws.
+  // Nodes outside of any render pass are traversed in neither phase.
+  enum class Phase { None, Compute, Graphics };
+
   std::shared_ptr<VulkanInstance> vulkan;
   std::shared_ptr<VulkanDevice> device;
   RenderState state;
   VulkanCommandBuffers* command{ nullptr };
   VkExtent2D extent;  
+  Phase phase{ Phase::None };
 };
 
 class MemoryAllocator {
@@ -45,6 +54,200 @@ public:
   std::vector<std::shared_ptr<BufferObject>> bufferobjects;
 };
 
+// A range of one of the buffers of the geometry pool. The range is placed,
+// and the buffer created, at the end of the allocation traversal, so the
+// offset is only valid in the later traversals.
+class GeometryAllocation {
+public:
+  NO_COPY_OR_ASSIGNMENT(GeometryAllocation)
+  GeometryAllocation() = delete;
+  ~GeometryAllocation() = default;
+
+  GeometryAllocation(VkBufferUsageFlags usage_flags, VkDeviceSize size) :
+    usage_flags(usage_flags),
+    size(size)
+  {}
+
+  VkBuffer vkbuffer() const
+  {
+    return this->buffer->buffer->buffer;
+  }
+
+  VkBufferUsageFlags usage_flags;
+  VkDeviceSize size;
+  // vertex streams are aligned to their stride, so that the first vertex
+  // of a stream is a whole number of vertices into the buffer
+  VkDeviceSize alignment{ 4 };
+  VkDeviceSize offset{ 0 };
+  std::shared_ptr<BufferObject> buffer{ nullptr };
+};
+
+// Sub-allocates static vertex and index data from one large buffer per
+// buffer usage, so that the draws of different meshes bind the same
+// buffers, and only differ in their first vertex and index.
+class GeometryPool {
+public:
+  NO_COPY_OR_ASSIGNMENT(GeometryPool)
+  GeometryPool() = default;
+  ~GeometryPool() = default;
+
+  // static geometry is written by transfers only, and read as vertices or
+  // indices only
+  static bool poolable(VkBufferUsageFlags usage_flags, VkBufferCreateFlags create_flags)
+  {
+    const VkBufferUsageFlags geometry_flags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    return create_flags == 0 &&
+           (usage_flags & geometry_flags) != 0 &&
+           (usage_flags & ~(geometry_flags | VK_BUFFER_USAGE_TRANSFER_DST_BIT)) == 0;
+  }
+
+  std::shared_ptr<GeometryAllocation> allocate(VkBufferUsageFlags usage_flags, VkDeviceSize size)
+  {
+    auto allocation = std::make_shared<GeometryAllocation>(usage_flags | VK_BUFFER_USAGE_TRANSFER_DST_BIT, size);
+    this->allocations.push_back(allocation);
+    return allocation;
+  }
+
+  // places the allocations made since the last call, and creates their
+  // buffers, to be bound to memory with the other buffer objects
+  void create(const std::shared_ptr<VulkanDevice> & device,
+              std::vector<std::shared_ptr<BufferObject>> & bufferobjects)
+  {
+    std::map<VkBufferUsageFlags, VkDeviceSize> sizes;
+    for (auto & allocation : this->allocations) {
+      VkDeviceSize & size = sizes[allocation->usage_flags];
+      allocation->offset = (size + allocation->alignment - 1) / allocation->alignment * allocation->alignment;
+      size = allocation->offset + allocation->size;
+    }
+
+    const VkMemoryPropertyFlags preferred_flags =
+      device->physical_device.hasHostVisibleDeviceMemory() ?
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : 0;
+
+    for (auto & [usage_flags, size] : sizes) {
+      auto buffer = std::make_shared<BufferObject>(
+        std::make_shared<VulkanBuffer>(device,
+                                       0,
+                                       std::max(size, VkDeviceSize(1)),
+                                       usage_flags,
+                                       VK_SHARING_MODE_EXCLUSIVE),
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+        preferred_flags);
+
+      bufferobjects.push_back(buffer);
+
+      for (auto & allocation : this->allocations) {
+        if (allocation->usage_flags == usage_flags) {
+          allocation->buffer = buffer;
+        }
+      }
+    }
+    this->allocations.clear();
+  }
+
+  // marks a pool buffer as written by transfers in the current traversal
+  void stage(VkBuffer buffer)
+  {
+    if (std::find(this->staged.begin(), this->staged.end(), buffer) == this->staged.end()) {
+      this->staged.push_back(buffer);
+    }
+  }
+
+  // Makes the transfer writes to the buffers staged since the last call
+  // visible to the graphics queue. Many ranges share a buffer, and a buffer
+  // released to the graphics queue must not be written on the transfer
+  // queue anymore, so this is done once per buffer, after all its ranges.
+  void release(UploadQueue * upload, VkCommandBuffer command)
+  {
+    for (VkBuffer buffer : this->staged) {
+      upload->release(buffer, VK_ACCESS_MEMORY_READ_BIT);
+      upload->acquire(command, buffer, VK_ACCESS_MEMORY_READ_BIT);
+    }
+    this->staged.clear();
+  }
+
+private:
+  std::vector<std::shared_ptr<GeometryAllocation>> allocations;
+  std::vector<VkBuffer> staged;
+};
+
+class RenderManager;
+
+// A texture whose mip levels are uploaded over several frames, smallest
+// first. Each call to stream() uploads at most about budget bytes, and
+// returns the number of bytes it uploaded.
+class StreamedTexture {
+public:
+  NO_COPY_OR_ASSIGNMENT(StreamedTexture)
+  StreamedTexture() = default;
+  virtual ~StreamedTexture() = default;
+
+  virtual VkDeviceSize stream(RenderManager * context, VkDeviceSize budget) = 0;
+  virtual bool streamed() const = 0;
+
+  // projected size of the texture in the last frame, zero if it was not rendered
+  double priority{ 0.0 };
+};
+
+// Streams the textures registered with it under a per-frame byte budget,
+// the textures that were largest on screen in the last frame first.
+class TextureStreamer {
+public:
+  NO_COPY_OR_ASSIGNMENT(TextureStreamer)
+  TextureStreamer() = delete;
+  ~TextureStreamer() = default;
+
+  explicit TextureStreamer(VkDeviceSize frame_budget) :
+    frame_budget(frame_budget)
+  {}
+
+  void add(const std::shared_ptr<StreamedTexture> & texture)
+  {
+    this->textures.push_back(texture);
+  }
+
+  bool pending() const
+  {
+    return !this->textures.empty();
+  }
+
+  // returns true if any texture level was uploaded
+  bool stream(RenderManager * context)
+  {
+    std::vector<std::shared_ptr<StreamedTexture>> textures;
+    for (auto & texture : this->textures) {
+      auto locked = texture.lock();
+      if (locked && !locked->streamed()) {
+        textures.push_back(locked);
+      }
+    }
+    this->textures.assign(textures.begin(), textures.end());
+
+    std::stable_sort(textures.begin(), textures.end(), [](auto & a, auto & b) {
+      return a->priority > b->priority;
+    });
+
+    VkDeviceSize uploaded = 0;
+    for (auto & texture : textures) {
+      if (uploaded >= this->frame_budget) {
+        break;
+      }
+      uploaded += texture->stream(context, this->frame_budget - uploaded);
+    }
+
+    // textures that are rendered in the next frame set their priority again
+    for (auto & texture : textures) {
+      texture->priority = 0.0;
+    }
+    return uploaded > 0;
+  }
+
+  VkDeviceSize frame_budget;
+
+private:
+  std::vector<std::weak_ptr<StreamedTexture>> textures;
+};
+
 class RenderManager {
 public:
   typedef std::function<void(RenderManager *)> alloc_callback;
@@ -54,21 +257,33 @@ public:
 
   explicit RenderManager(std::shared_ptr<VulkanInstance> vulkan,
                          std::shared_ptr<VulkanDevice> device,
-                         VkExtent2D extent) :
+                         VkExtent2D extent,
+                         VkDeviceSize staging_size = 64 * 1024 * 1024,
+                         fs::path pipelinecache_path = "pipeline.cache") :
       vulkan(std::move(vulkan)),
       device(std::move(device)),
       extent(extent),
       fence(std::make_unique<VulkanFence>(this->device)),
       command(std::make_unique<VulkanCommandBuffers>(this->device)),
-      pipelinecache(std::make_shared<VulkanPipelineCache>(this->device))
+      registry(std::make_unique<Registry>(this->device)),
+      geometry(std::make_unique<GeometryPool>()),
+      streamer(std::make_unique<TextureStreamer>(staging_size / 4)),
+      pipelinecache_path(std::move(pipelinecache_path))
   {
-    this->queue = this->device->getQueue(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
+    this->pipelinecache_data = read_file(this->pipelinecache_path);
+    this->pipelinecache = std::make_shared<VulkanPipelineCache>(this->device, this->pipelinecache_data);
+
+    this->queue_family_index = this->device->getQueueIndex(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
+    this->queue = this->device->queues[this->queue_family_index];
+    this->upload = std::make_unique<UploadQueue>(this->device, this->queue_family_index, staging_size);
   }
 
   virtual ~RenderManager() 
   {
     try {
       THROW_ON_ERROR(vkDeviceWaitIdle(this->device->device));
+      this->registry->wait();
+      this->save_pipelinecache();
     } 
     catch (std::exception & e) {
       std::cerr << e.what() << std::endl;
@@ -81,6 +296,13 @@ public:
     this->stage(root);
     this->pipeline(root);
     this->record(root);
+
+    try {
+      this->save_pipelinecache();
+    }
+    catch (std::exception & e) {
+      std::cerr << e.what() << std::endl;
+    }
   }
 
   void redraw(Node * root)
@@ -88,6 +310,7 @@ public:
     try {
       this->render(root);
       this->present(root);
+      this->stream(root);
     }
     catch (VkException &) {
       // recreate swapchain, try again next frame
@@ -115,6 +338,8 @@ public:
 
   void end_alloc()
   {
+    this->geometry->create(this->device, this->bufferobjects);
+
     for (auto & image_object : this->imageobjects) {
       const auto memory = std::make_shared<VulkanMemory>(
         this->device,
@@ -141,17 +366,34 @@ public:
     this->state = State();
 
     this->begin_alloc();
-    {
-      VulkanCommandBufferScope scope(this->command->buffer());
-      action();
-    }
+    this->command_scope.reset();
+    this->command_scope = std::make_unique<VulkanCommandBufferScope>(this->command->buffer());
+    action();
     this->end_alloc();
+    this->submit();
+  }
+
+  void submit()
+  {
+    this->geometry->release(this->upload.get(), this->command->buffer());
+    this->command_scope.reset();
+
+    // uploads recorded during the traversal go to the transfer queue first,
+    // the graphics queue waits for them on the GPU
+    this->upload->flush();
+    const auto semaphores = this->upload->take_semaphores();
+
+    std::vector<VkSemaphore> wait_semaphores;
+    for (auto & semaphore : semaphores) {
+      wait_semaphores.push_back(semaphore->semaphore);
+    }
 
     FenceScope fence_scope(this->device->device, this->fence->fence);
 
     this->command->submit(this->queue,
-                          VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-                          this->fence->fence);
+                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                          this->fence->fence,
+                          wait_semaphores);
   }
 
   void alloc(Node * root)
@@ -175,6 +417,8 @@ public:
     });
   }
 
+  // pipelines are looked up in the registry and the pipeline cache, which
+  // is written to disk by init() and the destructor, not on every call
   void pipeline(Node * root)
   {
     this->traverse([&]() {
@@ -182,6 +426,16 @@ public:
     });
   }
 
+  // writes the pipeline cache to disk if it has changed since it was last read or written
+  void save_pipelinecache()
+  {
+    std::vector<char> data = this->pipelinecache->getData();
+    if (data != this->pipelinecache_data) {
+      write_file(this->pipelinecache_path, data);
+      this->pipelinecache_data = std::move(data);
+    }
+  }
+
   void record(Node * root)
   {
     this->traverse([&]() {
@@ -189,6 +443,62 @@ public:
     });
   }
 
+  // Rebuilds the descriptor sets and command buffers of the draws whose
+  // descriptors have changed since the last pipeline or refresh traversal,
+  // such as the views of streamed images that have uploaded more levels
+  void refresh(Node * root)
+  {
+    this->traverse([&]() {
+      root->refresh(this);
+    });
+  }
+
+  // Uploads the next mip levels of streamed textures. The image views are
+  // clamped to the levels uploaded so far, and the draws that use a view
+  // are refreshed when more levels have landed.
+  void stream(Node * root)
+  {
+    this->release_retired();
+    if (!this->streamer->pending()) {
+      return;
+    }
+    this->traverse([&]() {
+      // the new levels are acquired by this submission, before the next frame
+      if (this->streamer->stream(this)) {
+        root->refresh(this);
+      }
+    });
+  }
+
+  // Keeps an object that command buffers of the frames in flight may use
+  // alive until those frames have finished, see release_retired()
+  void retire(std::shared_ptr<void> object)
+  {
+    std::vector<std::shared_ptr<VulkanFence>> fences;
+    for (auto & fence : this->frame_fences) {
+      if (vkGetFenceStatus(this->device->device, fence->fence) != VK_SUCCESS) {
+        fences.push_back(fence);
+      }
+    }
+    if (!fences.empty()) {
+      this->retired.push_back({ std::move(fences), std::move(object) });
+    }
+  }
+
+  // Releases the retired objects whose frames have finished, without
+  // blocking. A fence that is reset for a later frame before it is seen
+  // signaled holds on to its objects until that frame has finished too.
+  void release_retired()
+  {
+    auto finished = [this](const RetiredObject & retired) {
+      return std::all_of(retired.fences.begin(), retired.fences.end(), [this](auto & fence) {
+        return vkGetFenceStatus(this->device->device, fence->fence) == VK_SUCCESS;
+      });
+    };
+    this->retired.erase(std::remove_if(this->retired.begin(), this->retired.end(), finished),
+                        this->retired.end());
+  }
+
   void render(Node * root) const
   {
     SceneRenderer renderer(this->vulkan, 
@@ -206,13 +516,29 @@ public:
   std::shared_ptr<VulkanInstance> vulkan;
   std::shared_ptr<VulkanDevice> device;
   VkExtent2D extent;
+  uint32_t queue_family_index{ 0 };
   VkQueue queue{ nullptr };
 
   State state;
 
   std::shared_ptr<VulkanFence> fence;
   std::unique_ptr<VulkanCommandBuffers> command;
+  std::unique_ptr<Registry> registry;
+  std::unique_ptr<GeometryPool> geometry;
+  std::unique_ptr<TextureStreamer> streamer;
+  // the fences of the submissions that render frames, see retire()
+  std::vector<std::shared_ptr<VulkanFence>> frame_fences;
+
+  struct RetiredObject {
+    std::vector<std::shared_ptr<VulkanFence>> fences;
+    std::shared_ptr<void> object;
+  };
+  std::vector<RetiredObject> retired;
+  fs::path pipelinecache_path;
+  std::vector<char> pipelinecache_data;
   std::shared_ptr<VulkanPipelineCache> pipelinecache;
+  std::unique_ptr<UploadQueue> upload;
+  std::unique_ptr<VulkanCommandBufferScope> command_scope;
 
   std::vector<std::shared_ptr<ImageObject>> imageobjects;
   std::vector<std::shared_ptr<BufferObject>> bufferobjects;
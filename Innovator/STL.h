@@ -0,0 +1,142 @@
+#pragma once
+
+#include <Innovator/MappedFile.h>
+#include <Innovator/ThreadPool.h>
+
+#include <string>
+#include <vector>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+// Binary STL files hold an 80 byte header, a triangle count, and one 50
+// byte record per triangle: a normal, the three vertex positions and two
+// attribute bytes. ASCII files start with "solid", but so do the headers of
+// some binary files, whose size always matches their triangle count.
+inline bool stl_binary_triangle_count(const MappedFile & file, uint32_t & triangle_count)
+{
+  if (file.size() < 84) {
+    return false;
+  }
+  std::memcpy(&triangle_count, file.data() + 80, sizeof(triangle_count));
+  return file.size() == 84 + size_t(triangle_count) * 50;
+}
+
+// Copies the 36 bytes of vertex positions out of the records of the
+// triangles first to last of a binary STL file, to dst.
+inline void stl_decode_binary(const char * data, char * dst, size_t first, size_t last)
+{
+  const char * src = data + 84 + first * 50 + 12;
+  for (size_t i = first; i < last; i++, src += 50, dst += 36) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), a);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16), b);
+    std::memcpy(dst + 32, src + 32, 4);
+#else
+    std::memcpy(dst, src, 36);
+#endif
+  }
+}
+
+// Copies size bytes starting at offset of the positions of a binary STL
+// file to dst. Whole triangles are decoded in parallel chunks straight
+// into dst, the partial triangles at the ends of the range through a
+// temporary.
+inline void stl_copy_binary(const MappedFile & file, char * dst, size_t offset, size_t size)
+{
+  const size_t first = (offset + 35) / 36;
+  const size_t last = std::max(first, (offset + size) / 36);
+
+  ThreadPool::shared().parallel_for(last - first, 1 << 16, [&](size_t begin, size_t end) {
+    stl_decode_binary(file.data(), dst + (first + begin) * 36 - offset, first + begin, first + end);
+  });
+
+  char triangle[36];
+  if (offset % 36 != 0) {
+    stl_decode_binary(file.data(), triangle, offset / 36, offset / 36 + 1);
+    const size_t begin = offset % 36;
+    const size_t count = std::min(36 - begin, size);
+    std::copy(triangle + begin, triangle + begin + count, dst);
+  }
+  if ((offset + size) % 36 != 0 && (offset + size) / 36 >= first) {
+    stl_decode_binary(file.data(), triangle, last, last + 1);
+    std::copy(triangle, triangle + (offset + size) % 36, dst + last * 36 - offset);
+  }
+}
+
+inline std::vector<float> stl_parse_vertices(std::string_view text)
+{
+  std::vector<float> values;
+  const char * end = text.data() + text.size();
+  for (size_t pos = text.find("vertex"); pos != std::string_view::npos; pos = text.find("vertex", pos)) {
+    const char * ptr = text.data() + pos + 6;
+    for (int k = 0; k < 3; k++) {
+      while (ptr < end && std::isspace(static_cast<unsigned char>(*ptr))) {
+        ptr++;
+      }
+      float value;
+      const std::from_chars_result result = std::from_chars(ptr, end, value);
+      if (result.ec != std::errc()) {
+        throw std::runtime_error("stl_parse_vertices: invalid vertex coordinate");
+      }
+      values.push_back(value);
+      ptr = result.ptr;
+    }
+    pos = ptr - text.data();
+  }
+  return values;
+}
+
+// Parses the vertex positions of an ASCII STL file. The text is split
+// after "endfacet" keywords into chunks that are parsed in parallel.
+inline std::vector<float> stl_parse_ascii(const MappedFile & file)
+{
+  const std::string_view text(file.data(), file.size());
+  if (text.substr(0, 5) != "solid") {
+    throw std::runtime_error("stl_parse_ascii: not an STL file");
+  }
+  const size_t chunk_count = std::max<size_t>(1, text.size() >> 20);
+  std::vector<size_t> bounds{ 0 };
+  for (size_t i = 1; i < chunk_count; i++) {
+    size_t bound = text.find("endfacet", std::max(text.size() * i / chunk_count, bounds.back()));
+    bound = (bound == std::string_view::npos) ? text.size() : bound + 8;
+    bounds.push_back(bound);
+  }
+  bounds.push_back(text.size());
+
+  std::vector<std::vector<float>> chunks(chunk_count);
+  ThreadPool::shared().parallel_for(chunk_count, 1, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      chunks[i] = stl_parse_vertices(text.substr(bounds[i], bounds[i + 1] - bounds[i]));
+    }
+  });
+
+  std::vector<float> values;
+  for (auto & chunk : chunks) {
+    values.insert(values.end(), chunk.begin(), chunk.end());
+  }
+  return values;
+}
+
+// The vertex positions of all triangles of a binary or ASCII STL file
+inline std::vector<float> stl_read_positions(const std::string & filename)
+{
+  const MappedFile file(filename);
+  uint32_t triangle_count;
+  if (stl_binary_triangle_count(file, triangle_count)) {
+    std::vector<float> values(size_t(triangle_count) * 9);
+    stl_copy_binary(file, reinterpret_cast<char *>(values.data()), 0, values.size() * sizeof(float));
+    return values;
+  }
+  return stl_parse_ascii(file);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <Innovator/Wrapper.h>
+#include <Innovator/Bounds.h>
 
 #include <glm/glm.hpp>
 #include <vector>
@@ -8,6 +9,7 @@
 struct VulkanIndexBufferDescription {
   VkIndexType type;
   VkBuffer buffer{ nullptr };
+  VkDeviceSize offset{ 0 };
 };
 
 struct State {
@@ -16,7 +18,9 @@ struct State {
   };
   VkBuffer buffer{ nullptr };
   class BufferData * bufferdata{ nullptr };
+  class GeometryAllocation * geometry_allocation{ nullptr };
   class VulkanTextureImage* texture{ nullptr };
+  class FramebufferAttachment * depth_attachment{ nullptr };
   std::shared_ptr<VulkanRenderpass> renderpass{ nullptr };
   VkExtent2D extent{ 0, 0 };
 
@@ -39,23 +43,38 @@ struct State {
   VkImage image{ nullptr };
   VkImageView imageView { nullptr };
   VkImageLayout imageLayout { VK_IMAGE_LAYOUT_UNDEFINED };
+  uint32_t image_min_level{ 0 };
   VkSampler sampler{ nullptr };
 
   std::vector<VkPipelineShaderStageCreateInfo> shader_stage_infos;
-  std::vector<VkDescriptorPoolSize> descriptor_pool_sizes;
-  std::vector<VkWriteDescriptorSet> write_descriptor_sets;
+  std::vector<std::shared_ptr<VulkanShaderModule>> shader_modules;
+  std::vector<VkSpecializationMapEntry> specialization_map_entries;
+  std::vector<char> specialization_data;
+  std::vector<VulkanDescriptorInfo> descriptor_infos;
   std::vector<VkDescriptorSetLayoutBinding> descriptor_set_layout_bindings;
   std::vector<VkPushConstantRange> push_constant_ranges;
   std::vector<VkVertexInputBindingDescription> vertex_input_bindings;
   std::vector<VkVertexInputAttributeDescription> vertex_attributes;
 
   VulkanIndexBufferDescription index_buffer_description;
+  VkBuffer indirect_buffer{ nullptr };
+  VkBuffer indirect_count_buffer{ nullptr };
+  uint32_t instance_count{ 0 };
+  uint32_t base_vertex{ 0 };
   std::vector<VkBuffer> vertex_attribute_buffers;
   std::vector<VkDeviceSize> vertex_attribute_buffer_offsets;
+  std::vector<class GeometryAllocation *> vertex_allocations;
+
+  Box3 bounds;
+  glm::dmat4 transform{ 1.0 };
+  // set after the transform that restores quantized positions
+  bool dequantized{ false };
 };
 
 struct RenderState {
   glm::dmat4 ModelMatrix{ 1.0 };
   glm::dmat4 ViewMatrix{ 1.0 };
   glm::dmat4 ProjMatrix{ 1.0 };
+  // bounds of the innermost separator being rendered, in its coordinate frame
+  const Box3 * bounds{ nullptr };
 };
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <Innovator/Defines.h>
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <future>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <condition_variable>
+
+// Fixed set of worker threads executing tasks in submission order.
+// The destructor finishes all submitted tasks before joining the workers.
+class ThreadPool {
+public:
+  NO_COPY_OR_ASSIGNMENT(ThreadPool)
+  ThreadPool() = delete;
+
+  explicit ThreadPool(size_t thread_count)
+  {
+    thread_count = std::max<size_t>(thread_count, 1);
+    for (size_t i = 0; i < thread_count; i++) {
+      this->threads.emplace_back([this]() { this->run(); });
+    }
+  }
+
+  ~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->stopping = true;
+    }
+    this->task_available.notify_all();
+    for (auto & thread : this->threads) {
+      thread.join();
+    }
+  }
+
+  // leaves one core for the thread submitting the work
+  static size_t default_thread_count()
+  {
+    const size_t cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 1;
+  }
+
+  // process wide pool for data parallel loops, such as decoding files
+  static ThreadPool & shared()
+  {
+    static ThreadPool pool(default_thread_count());
+    return pool;
+  }
+
+  // Calls function(begin, end) for consecutive ranges of at least grain of
+  // the count items, and returns when all ranges are done. Exceptions are
+  // rethrown here. Must not be called from a task running on this pool.
+  template <typename Function>
+  void parallel_for(size_t count, size_t grain, Function function)
+  {
+    const size_t chunks = std::min(this->threads.size() * 4, count / std::max<size_t>(grain, 1));
+    if (chunks <= 1) {
+      function(size_t(0), count);
+      return;
+    }
+    std::vector<std::future<void>> results;
+    for (size_t i = 0; i < chunks; i++) {
+      const size_t begin = count * i / chunks;
+      const size_t end = count * (i + 1) / chunks;
+      results.push_back(this->submit([&function, begin, end]() { function(begin, end); }));
+    }
+    // all ranges reference function, so wait for every one before rethrowing
+    for (auto & result : results) {
+      result.wait();
+    }
+    for (auto & result : results) {
+      result.get();
+    }
+  }
+
+  template <typename Function>
+  std::future<std::invoke_result_t<Function>> submit(Function function)
+  {
+    typedef std::invoke_result_t<Function> Result;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+    std::future<Result> future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->tasks.emplace_back([task]() { (*task)(); });
+    }
+    this->task_available.notify_one();
+    return future;
+  }
+
+  // blocks until every task submitted so far has finished
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->idle.wait(lock, [this]() {
+      return this->tasks.empty() && this->running == 0;
+    });
+  }
+
+private:
+  void run()
+  {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->task_available.wait(lock, [this]() {
+          return this->stopping || !this->tasks.empty();
+        });
+        if (this->tasks.empty()) {
+          return;
+        }
+        task = std::move(this->tasks.front());
+        this->tasks.pop_front();
+        this->running++;
+      }
+      // exceptions are stored in the packaged_task's future
+      task();
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->running--;
+      }
+      this->idle.notify_all();
+    }
+  }
+
+  std::mutex mutex;
+  std::condition_variable task_available;
+  std::condition_variable idle;
+  std::deque<std::function<void()>> tasks;
+  std::vector<std::thread> threads;
+  size_t running{ 0 };
+  bool stopping{ false };
+};
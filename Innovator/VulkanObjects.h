@@ -7,6 +7,8 @@
 
 #include <utility>
 #include <memory>
+#include <deque>
+#include <algorithm>
 #include <assert.h>
 
 class BufferObject {
@@ -16,7 +18,8 @@ public:
   ~BufferObject() = default;
   
   BufferObject(std::shared_ptr<VulkanBuffer> buffer,
-               VkMemoryPropertyFlags memory_property_flags) :
+               VkMemoryPropertyFlags memory_property_flags,
+               VkMemoryPropertyFlags preferred_property_flags = 0) :
     buffer(std::move(buffer))
   {
     vkGetBufferMemoryRequirements(this->buffer->device->device,
@@ -25,7 +28,8 @@ public:
 
     this->memory_type_index = this->buffer->device->physical_device.getMemoryTypeIndex(
       this->memory_requirements.memoryTypeBits,
-      memory_property_flags);
+      memory_property_flags,
+      preferred_property_flags);
   }
 
   void bind(std::shared_ptr<VulkanMemory> memory, VkDeviceSize offset)
@@ -44,6 +48,13 @@ public:
     this->memory->memcpy(data, size, this->offset);
   }
 
+  bool host_visible() const
+  {
+    const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    const VkMemoryType & type = this->buffer->device->physical_device.memory_properties.memoryTypes[this->memory_type_index];
+    return (type.propertyFlags & flags) == flags;
+  }
+
   std::shared_ptr<VulkanBuffer> buffer;
   VkDeviceSize offset{ 0 };
   VkMemoryRequirements memory_requirements;
@@ -87,3 +98,389 @@ public:
   uint32_t memory_type_index;
   std::shared_ptr<VulkanMemory> memory;
 };
+
+
+class StagingBuffer {
+public:
+  NO_COPY_OR_ASSIGNMENT(StagingBuffer)
+  StagingBuffer() = delete;
+
+  StagingBuffer(std::shared_ptr<VulkanDevice> device, VkDeviceSize size)
+  {
+    const VkPhysicalDeviceLimits & limits = device->physical_device.properties.limits;
+    this->alignment = std::max<VkDeviceSize>({ 16,
+                                               limits.optimalBufferCopyOffsetAlignment,
+                                               limits.nonCoherentAtomSize });
+
+    // keep offsets aligned across wrap-around
+    this->size = size / this->alignment * this->alignment;
+
+    this->buffer = std::make_shared<BufferObject>(
+      std::make_shared<VulkanBuffer>(device,
+                                     0,
+                                     this->size,
+                                     VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                     VK_SHARING_MODE_EXCLUSIVE),
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    const auto memory = std::make_shared<VulkanMemory>(device,
+                                                       this->buffer->memory_requirements.size,
+                                                       this->buffer->memory_type_index);
+    const VkDeviceSize offset = 0;
+    this->buffer->bind(memory, offset);
+
+    // the ring stays mapped for its whole lifetime
+    this->mem = this->buffer->memory->map(VK_WHOLE_SIZE, offset);
+  }
+
+  ~StagingBuffer()
+  {
+    this->buffer->memory->unmap();
+  }
+
+  // head and tail are monotonically increasing positions, the offset in the
+  // buffer is the position modulo size. Regions between tail and head are in
+  // use by transfers that have not completed yet.
+  bool fits(VkDeviceSize size) const
+  {
+    return size <= this->size && this->place(size) + size - this->tail <= this->size;
+  }
+
+  VkDeviceSize alloc(VkDeviceSize size)
+  {
+    if (!this->fits(size)) {
+      throw std::runtime_error("StagingBuffer::alloc: out of staging memory");
+    }
+    const VkDeviceSize position = this->place(size);
+    this->head = position + size;
+    return position % this->size;
+  }
+
+  // marks everything allocated before position as free again
+  void release(VkDeviceSize position)
+  {
+    this->tail = position;
+  }
+
+  // only valid when all transfers reading from the ring have completed
+  void reset()
+  {
+    this->tail = this->head;
+  }
+
+  char * data(VkDeviceSize offset) const
+  {
+    return this->mem + offset;
+  }
+
+  VkBuffer vkbuffer() const
+  {
+    return this->buffer->buffer->buffer;
+  }
+
+  VkDeviceSize align(VkDeviceSize offset) const
+  {
+    return (offset + this->alignment - 1) / this->alignment * this->alignment;
+  }
+
+  // start position of the next allocation, regions never straddle the end
+  VkDeviceSize place(VkDeviceSize size) const
+  {
+    const VkDeviceSize position = this->align(this->head);
+    const VkDeviceSize offset = position % this->size;
+    return (offset + size > this->size) ? position + this->size - offset : position;
+  }
+
+  std::shared_ptr<BufferObject> buffer;
+  VkDeviceSize size;
+  VkDeviceSize alignment{ 16 };
+  VkDeviceSize head{ 0 };
+  VkDeviceSize tail{ 0 };
+  char * mem{ nullptr };
+};
+
+class UploadBatch {
+public:
+  NO_COPY_OR_ASSIGNMENT(UploadBatch)
+  UploadBatch() = delete;
+  ~UploadBatch() = default;
+
+  UploadBatch(const std::shared_ptr<VulkanDevice> & device,
+              const std::shared_ptr<VulkanCommandPool> & pool) :
+    command(std::make_unique<VulkanCommandBuffers>(device, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY, pool)),
+    fence(std::make_unique<VulkanFence>(device))
+  {}
+
+  std::unique_ptr<VulkanCommandBuffers> command;
+  std::unique_ptr<VulkanCommandBufferScope> scope;
+  std::unique_ptr<VulkanFence> fence;
+  std::shared_ptr<VulkanSemaphore> semaphore;
+  VkDeviceSize end{ 0 };
+};
+
+// Records staging copies into command buffers that are submitted to a
+// transfer-only queue family when the device has one, and to the graphics
+// queue family otherwise. Every submitted batch signals a semaphore that the
+// next graphics submission must wait on, and resources written here must be
+// handed over with release()/acquire() before the graphics queue uses them.
+class UploadQueue {
+public:
+  NO_COPY_OR_ASSIGNMENT(UploadQueue)
+  UploadQueue() = delete;
+
+  UploadQueue(std::shared_ptr<VulkanDevice> device,
+              uint32_t graphics_family_index,
+              VkDeviceSize staging_size) :
+    device(std::move(device)),
+    graphics_family_index(graphics_family_index),
+    family_index(graphics_family_index)
+  {
+    const uint32_t transfer_family_index =
+      this->device->getQueueIndex(VK_QUEUE_TRANSFER_BIT, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+
+    // image copies are split into bands of rows, which requires a
+    // transfer granularity of a single texel
+    const VkExtent3D granularity = this->device->physical_device.
+      queue_family_properties[transfer_family_index].minImageTransferGranularity;
+
+    if (granularity.width == 1 && granularity.height == 1 && granularity.depth == 1) {
+      this->family_index = transfer_family_index;
+    }
+
+    this->queue = this->device->queues[this->family_index];
+    this->pool = std::make_shared<VulkanCommandPool>(this->device, this->family_index);
+    this->staging = std::make_unique<StagingBuffer>(this->device, staging_size);
+  }
+
+  ~UploadQueue()
+  {
+    try {
+      this->flush();
+      while (!this->pending.empty()) {
+        this->retire();
+      }
+    }
+    catch (std::exception & e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+
+  bool dedicated() const
+  {
+    return this->family_index != this->graphics_family_index;
+  }
+
+  // the command buffer of the batch currently being recorded
+  VkCommandBuffer command()
+  {
+    if (!this->current) {
+      this->poll();
+      if (this->idle.empty()) {
+        this->idle.push_back(std::make_unique<UploadBatch>(this->device, this->pool));
+      }
+      this->current = std::move(this->idle.back());
+      this->idle.pop_back();
+      this->current->scope = std::make_unique<VulkanCommandBufferScope>(
+        this->current->command->buffer(), nullptr, 0, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    }
+    return this->current->command->buffer();
+  }
+
+  // Reserves size bytes in the staging ring and returns their offset. If the
+  // ring is full, the current batch is submitted and the oldest batches are
+  // waited for until enough space is free.
+  VkDeviceSize reserve(VkDeviceSize size)
+  {
+    if (size > this->staging->size) {
+      throw std::runtime_error("UploadQueue::reserve: region larger than staging buffer");
+    }
+    if (!this->staging->fits(size)) {
+      this->flush();
+      while (!this->staging->fits(size)) {
+        this->retire();
+      }
+    }
+    return this->staging->alloc(size);
+  }
+
+  // submits the batch being recorded, if any
+  void flush()
+  {
+    if (!this->current) {
+      return;
+    }
+    this->current->scope.reset();
+    this->current->semaphore = std::make_shared<VulkanSemaphore>(this->device);
+    this->current->end = this->staging->head;
+
+    THROW_ON_ERROR(vkResetFences(this->device->device, 1, &this->current->fence->fence));
+
+    VulkanCommandBuffers::submit(this->queue,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 this->current->command->buffers,
+                                 {},
+                                 { this->current->semaphore->semaphore },
+                                 this->current->fence->fence);
+
+    this->signaled.push_back(this->current->semaphore);
+    this->pending.push_back(std::move(this->current));
+  }
+
+  // semaphores signaled since the last call, to be waited on by the graphics queue
+  std::vector<std::shared_ptr<VulkanSemaphore>> take_semaphores()
+  {
+    std::vector<std::shared_ptr<VulkanSemaphore>> semaphores;
+    semaphores.swap(this->signaled);
+    return semaphores;
+  }
+
+  // recycles batches that have completed without blocking
+  void poll()
+  {
+    while (!this->pending.empty() &&
+           vkGetFenceStatus(this->device->device, this->pending.front()->fence->fence) == VK_SUCCESS) {
+      this->retire();
+    }
+  }
+
+  // Makes transfer writes to buffer available to the graphics queue. On a
+  // dedicated transfer queue this is the release half of an ownership
+  // transfer, and acquire() must be recorded on the graphics queue.
+  void release(VkBuffer buffer, VkAccessFlags dst_access_mask)
+  {
+    const bool transfer = this->dedicated();
+
+    VkBufferMemoryBarrier barrier{
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,                   // sType
+      nullptr,                                                   // pNext
+      VK_ACCESS_TRANSFER_WRITE_BIT,                              // srcAccessMask
+      transfer ? 0 : dst_access_mask,                            // dstAccessMask
+      this->src_family_index(),                                  // srcQueueFamilyIndex
+      this->dst_family_index(),                                  // dstQueueFamilyIndex
+      buffer,                                                    // buffer
+      0,                                                         // offset
+      VK_WHOLE_SIZE,                                             // size
+    };
+
+    vkCmdPipelineBarrier(this->command(),
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         transfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+  }
+
+  void acquire(VkCommandBuffer command, VkBuffer buffer, VkAccessFlags dst_access_mask) const
+  {
+    if (!this->dedicated()) {
+      return;
+    }
+    VkBufferMemoryBarrier barrier{
+      VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,                   // sType
+      nullptr,                                                   // pNext
+      0,                                                         // srcAccessMask
+      dst_access_mask,                                           // dstAccessMask
+      this->family_index,                                        // srcQueueFamilyIndex
+      this->graphics_family_index,                               // dstQueueFamilyIndex
+      buffer,                                                    // buffer
+      0,                                                         // offset
+      VK_WHOLE_SIZE,                                             // size
+    };
+
+    vkCmdPipelineBarrier(command,
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+  }
+
+  // transitions image from TRANSFER_DST_OPTIMAL to new_layout, see release() above
+  void release(VkImage image,
+               VkImageSubresourceRange subresource_range,
+               VkImageLayout new_layout,
+               VkAccessFlags dst_access_mask)
+  {
+    const bool transfer = this->dedicated();
+
+    VkImageMemoryBarrier barrier{
+      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                    // sType
+      nullptr,                                                   // pNext
+      VK_ACCESS_TRANSFER_WRITE_BIT,                              // srcAccessMask
+      transfer ? 0 : dst_access_mask,                            // dstAccessMask
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,                      // oldLayout
+      new_layout,                                                // newLayout
+      this->src_family_index(),                                  // srcQueueFamilyIndex
+      this->dst_family_index(),                                  // dstQueueFamilyIndex
+      image,                                                     // image
+      subresource_range,                                         // subresourceRange
+    };
+
+    vkCmdPipelineBarrier(this->command(),
+                         VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         transfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+
+  void acquire(VkCommandBuffer command,
+               VkImage image,
+               VkImageSubresourceRange subresource_range,
+               VkImageLayout new_layout,
+               VkAccessFlags dst_access_mask) const
+  {
+    if (!this->dedicated()) {
+      return;
+    }
+    VkImageMemoryBarrier barrier{
+      VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,                    // sType
+      nullptr,                                                   // pNext
+      0,                                                         // srcAccessMask
+      dst_access_mask,                                           // dstAccessMask
+      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,                      // oldLayout
+      new_layout,                                                // newLayout
+      this->family_index,                                        // srcQueueFamilyIndex
+      this->graphics_family_index,                               // dstQueueFamilyIndex
+      image,                                                     // image
+      subresource_range,                                         // subresourceRange
+    };
+
+    vkCmdPipelineBarrier(command,
+                         VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+  }
+
+  std::shared_ptr<VulkanDevice> device;
+  uint32_t graphics_family_index;
+  uint32_t family_index;
+  VkQueue queue{ nullptr };
+  std::shared_ptr<VulkanCommandPool> pool;
+  std::unique_ptr<StagingBuffer> staging;
+
+private:
+  uint32_t src_family_index() const
+  {
+    return this->dedicated() ? this->family_index : VK_QUEUE_FAMILY_IGNORED;
+  }
+
+  uint32_t dst_family_index() const
+  {
+    return this->dedicated() ? this->graphics_family_index : VK_QUEUE_FAMILY_IGNORED;
+  }
+
+  // waits for the oldest submitted batch and frees its staging memory
+  void retire()
+  {
+    if (this->pending.empty()) {
+      throw std::runtime_error("UploadQueue::retire: no batch in flight");
+    }
+    std::unique_ptr<UploadBatch> batch = std::move(this->pending.front());
+    this->pending.pop_front();
+
+    THROW_ON_ERROR(vkWaitForFences(this->device->device, 1, &batch->fence->fence, VK_TRUE, UINT64_MAX));
+    this->staging->release(batch->end);
+    batch->semaphore.reset();
+    this->idle.push_back(std::move(batch));
+  }
+
+  std::unique_ptr<UploadBatch> current;
+  std::deque<std::unique_ptr<UploadBatch>> pending;
+  std::vector<std::unique_ptr<UploadBatch>> idle;
+  std::vector<std::shared_ptr<VulkanSemaphore>> signaled;
+};
@@ -8,6 +8,7 @@
 #include <utility>
 #include <vector>
 #include <memory>
+#include <string>
 #include <iostream>
 #include <algorithm>
 
@@ -74,6 +75,58 @@ public:
     }
     throw std::runtime_error("VulkanDevice::getMemoryTypeIndex: could not find suitable memory type");
   }
+
+  // prefers a memory type that also has the preferred flags, if there is one
+  uint32_t getMemoryTypeIndex(uint32_t memory_type, 
+                              VkMemoryPropertyFlags required_flags, 
+                              VkMemoryPropertyFlags preferred_flags) const
+  {
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++) {
+      if (((memory_type >> i) & 1) == 1) {
+        const VkMemoryPropertyFlags flags = required_flags | preferred_flags;
+        if ((this->memory_properties.memoryTypes[i].propertyFlags & flags) == flags) {
+          return i;
+        }
+      }
+    }
+    return this->getMemoryTypeIndex(memory_type, required_flags);
+  }
+
+  // True if device local memory can be written directly from the host
+  // without running out, i.e. on unified memory architectures, with
+  // resizable BAR or on software rasterizers. A small host visible window
+  // into a larger device local heap does not count.
+  bool hasHostVisibleDeviceMemory() const
+  {
+    const VkMemoryPropertyFlags flags = 
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | 
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | 
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkDeviceSize device_heap_size = 0;
+    VkDeviceSize host_visible_heap_size = 0;
+    for (uint32_t i = 0; i < this->memory_properties.memoryTypeCount; i++) {
+      const VkMemoryType & type = this->memory_properties.memoryTypes[i];
+      const VkDeviceSize heap_size = this->memory_properties.memoryHeaps[type.heapIndex].size;
+      if (type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+        device_heap_size = std::max(device_heap_size, heap_size);
+      }
+      if ((type.propertyFlags & flags) == flags) {
+        host_visible_heap_size = std::max(host_visible_heap_size, heap_size);
+      }
+    }
+    return host_visible_heap_size > 0 && host_visible_heap_size >= device_heap_size;
+  }
+
+  bool supportsExtension(const char * extension_name) const
+  {
+    for (auto & properties : this->extension_properties) {
+      if (std::strcmp(extension_name, properties.extensionName) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
   
   bool supportsFeatures(const VkPhysicalDeviceFeatures & required_features) const
   {
@@ -177,6 +230,15 @@ public:
       throw std::runtime_error("Required instance extension " + std::string(extension_name) + " not supported.");
     });
 
+    // Vulkan 1.0 loaders reject instances that ask for a newer version
+    auto enumerate_instance_version = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+      vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion"));
+
+    uint32_t loader_version = VK_API_VERSION_1_0;
+    if (enumerate_instance_version && enumerate_instance_version(&loader_version) == VK_SUCCESS) {
+      this->api_version = std::min<uint32_t>(loader_version, VK_API_VERSION_1_1);
+    }
+
     VkApplicationInfo application_info{
       VK_STRUCTURE_TYPE_APPLICATION_INFO, // sType
       nullptr,                            // pNext
@@ -184,7 +246,7 @@ public:
       1,                                  // applicationVersion
       "Innovator",                        // pEngineName
       1,                                  // engineVersion
-      VK_API_VERSION_1_0,                 // apiVersion
+      this->api_version,                  // apiVersion
     };
 
     VkInstanceCreateInfo create_info{
@@ -291,6 +353,7 @@ public:
   PFN_vkGetPhysicalDeviceSurfacePresentModesKHR vkGetPhysicalDeviceSurfacePresentModes;
 
   VkInstance instance{ nullptr };
+  uint32_t api_version{ VK_API_VERSION_1_0 };
   std::vector<VulkanPhysicalDevice> physical_devices;
 };
 
@@ -303,7 +366,9 @@ public:
                const VkPhysicalDeviceFeatures& device_features,
                const std::vector<const char*>& required_layers,
                const std::vector<const char*>& required_extensions) : 
-    physical_device(vulkan->selectPhysicalDevice(device_features))
+    physical_device(vulkan->selectPhysicalDevice(device_features)),
+    enabled_features(device_features),
+    enabled_extensions(required_extensions.begin(), required_extensions.end())
   {
     std::for_each(required_layers.begin(), required_layers.end(), [&](const char * layer_name) {
       for (auto properties : physical_device.layer_properties)
@@ -365,6 +430,32 @@ public:
     };
 
     THROW_ON_ERROR(vkCreateCommandPool(this->device, &create_info, nullptr, &this->default_pool));
+
+    this->api_version = std::min(vulkan->api_version, this->physical_device.properties.apiVersion);
+    if (this->api_version >= VK_API_VERSION_1_1) {
+      this->vkCreateDescriptorUpdateTemplate = this->getProcAddress<PFN_vkCreateDescriptorUpdateTemplate>("vkCreateDescriptorUpdateTemplate");
+      this->vkDestroyDescriptorUpdateTemplate = this->getProcAddress<PFN_vkDestroyDescriptorUpdateTemplate>("vkDestroyDescriptorUpdateTemplate");
+      this->vkUpdateDescriptorSetWithTemplate = this->getProcAddress<PFN_vkUpdateDescriptorSetWithTemplate>("vkUpdateDescriptorSetWithTemplate");
+    }
+
+    if (this->hasExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+      this->vkCmdDrawIndirectCountKHR = this->getProcAddress<PFN_vkCmdDrawIndirectCountKHR>("vkCmdDrawIndirectCountKHR");
+      this->vkCmdDrawIndexedIndirectCountKHR = this->getProcAddress<PFN_vkCmdDrawIndexedIndirectCountKHR>("vkCmdDrawIndexedIndirectCountKHR");
+    }
+  }
+
+  bool hasExtension(const std::string & extension_name) const
+  {
+    return std::find(this->enabled_extensions.begin(), this->enabled_extensions.end(), extension_name) != this->enabled_extensions.end();
+  }
+
+  template <typename T>
+  T getProcAddress(const std::string & name) {
+    auto address = reinterpret_cast<T>(vkGetDeviceProcAddr(this->device, name.c_str()));
+    if (!address) {
+      throw std::runtime_error("vkGetDeviceProcAddr failed for " + name);
+    }
+    return address;
   }
 
   ~VulkanDevice()
@@ -373,11 +464,26 @@ public:
     vkDestroyDevice(this->device, nullptr);
   }
 
+  // returns the first queue family that has all required flags and none of
+  // the excluded flags, or the family getQueue(required_flags) would use
+  uint32_t getQueueIndex(VkQueueFlags required_flags, VkQueueFlags excluded_flags = 0)
+  {
+    const auto & properties = this->physical_device.queue_family_properties;
+    if (excluded_flags) {
+      for (uint32_t queue_index = 0; queue_index < properties.size(); queue_index++) {
+        const VkQueueFlags flags = properties[queue_index].queueFlags;
+        if ((flags & required_flags) == required_flags && !(flags & excluded_flags)) {
+          return queue_index;
+        }
+      }
+    }
+    std::vector<VkBool32> filter(properties.size(), VK_TRUE);
+    return this->physical_device.getQueueIndex(required_flags, filter);
+  }
+
   VkQueue getQueue(VkQueueFlags required_flags)
   {
-    std::vector<VkBool32> filter(this->physical_device.queue_family_properties.size(), VK_TRUE);
-    uint32_t queue_index = this->physical_device.getQueueIndex(required_flags, filter);
-    return this->queues[queue_index];
+    return this->queues[this->getQueueIndex(required_flags)];
   }
 
   VkQueue getQueue(VkQueueFlags required_flags, VkSurfaceKHR surface)
@@ -393,8 +499,20 @@ public:
 
   VkDevice device{ nullptr };
   VulkanPhysicalDevice physical_device;
+  VkPhysicalDeviceFeatures enabled_features;
+  std::vector<std::string> enabled_extensions;
   std::vector<VkQueue> queues;
   VkCommandPool default_pool{ nullptr };
+  uint32_t api_version{ VK_API_VERSION_1_0 };
+
+  // Vulkan 1.1 entry points, null on 1.0 devices
+  PFN_vkCreateDescriptorUpdateTemplate vkCreateDescriptorUpdateTemplate{ nullptr };
+  PFN_vkDestroyDescriptorUpdateTemplate vkDestroyDescriptorUpdateTemplate{ nullptr };
+  PFN_vkUpdateDescriptorSetWithTemplate vkUpdateDescriptorSetWithTemplate{ nullptr };
+
+  // VK_KHR_draw_indirect_count entry points, null if the extension is not enabled
+  PFN_vkCmdDrawIndirectCountKHR vkCmdDrawIndirectCountKHR{ nullptr };
+  PFN_vkCmdDrawIndexedIndirectCountKHR vkCmdDrawIndexedIndirectCountKHR{ nullptr };
 };
 
 class VulkanMemory {
@@ -566,14 +684,16 @@ public:
   VulkanDescriptorPool() = delete;
 
   explicit VulkanDescriptorPool(std::shared_ptr<VulkanDevice> device, 
-                                std::vector<VkDescriptorPoolSize> descriptor_pool_sizes)
+                                std::vector<VkDescriptorPoolSize> descriptor_pool_sizes,
+                                uint32_t max_sets,
+                                VkDescriptorPoolCreateFlags flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
     : device(std::move(device))
   {
     VkDescriptorPoolCreateInfo create_info {
     VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,         // sType 
       nullptr,                                             // pNext
-      VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,   // flags
-      static_cast<uint32_t>(descriptor_pool_sizes.size()), // maxSets
+      flags,                                               // flags
+      max_sets,                                            // maxSets
       static_cast<uint32_t>(descriptor_pool_sizes.size()), // poolSizeCount
       descriptor_pool_sizes.data()                         // pPoolSizes
     };
@@ -619,6 +739,53 @@ public:
   VkDescriptorSetLayout layout { nullptr };
 };
 
+// one descriptor worth of data, as laid out for update templates
+union VulkanDescriptorInfo {
+  VkDescriptorImageInfo image;
+  VkDescriptorBufferInfo buffer;
+  VkBufferView texel_buffer_view;
+};
+
+class VulkanDescriptorUpdateTemplate {
+public:
+  NO_COPY_OR_ASSIGNMENT(VulkanDescriptorUpdateTemplate)
+  VulkanDescriptorUpdateTemplate() = delete;
+
+  VulkanDescriptorUpdateTemplate(std::shared_ptr<VulkanDevice> device,
+                                 const std::vector<VkDescriptorUpdateTemplateEntry> & entries,
+                                 VkDescriptorSetLayout descriptor_set_layout)
+    : device(std::move(device))
+  {
+    VkDescriptorUpdateTemplateCreateInfo create_info{
+      VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,  // sType
+      nullptr,                                                   // pNext
+      0,                                                         // flags
+      static_cast<uint32_t>(entries.size()),                     // descriptorUpdateEntryCount
+      entries.data(),                                            // pDescriptorUpdateEntries
+      VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,         // templateType
+      descriptor_set_layout,                                     // descriptorSetLayout
+      VK_PIPELINE_BIND_POINT_GRAPHICS,                           // pipelineBindPoint (ignored)
+      nullptr,                                                   // pipelineLayout (ignored)
+      0,                                                         // set (ignored)
+    };
+
+    THROW_ON_ERROR(this->device->vkCreateDescriptorUpdateTemplate(this->device->device, &create_info, nullptr, &this->update_template));
+  }
+
+  ~VulkanDescriptorUpdateTemplate()
+  {
+    this->device->vkDestroyDescriptorUpdateTemplate(this->device->device, this->update_template, nullptr);
+  }
+
+  void update(VkDescriptorSet descriptor_set, const void * data) const
+  {
+    this->device->vkUpdateDescriptorSetWithTemplate(this->device->device, descriptor_set, this->update_template, data);
+  }
+
+  std::shared_ptr<VulkanDevice> device;
+  VkDescriptorUpdateTemplate update_template{ nullptr };
+};
+
 class VulkanDescriptorSets {
 public:
   NO_COPY_OR_ASSIGNMENT(VulkanDescriptorSets)
@@ -714,6 +881,35 @@ public:
   VkFence fence;
 };
 
+class VulkanCommandPool {
+public:
+  NO_COPY_OR_ASSIGNMENT(VulkanCommandPool)
+  VulkanCommandPool() = delete;
+
+  VulkanCommandPool(std::shared_ptr<VulkanDevice> device,
+                    uint32_t queue_family_index,
+                    VkCommandPoolCreateFlags flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT)
+    : device(std::move(device))
+  {
+    VkCommandPoolCreateInfo create_info{
+      VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,       // sType
+      nullptr,                                          // pNext 
+      flags,                                            // flags
+      queue_family_index,                               // queueFamilyIndex 
+    };
+
+    THROW_ON_ERROR(vkCreateCommandPool(this->device->device, &create_info, nullptr, &this->pool));
+  }
+
+  ~VulkanCommandPool()
+  {
+    vkDestroyCommandPool(this->device->device, this->pool, nullptr);
+  }
+
+  std::shared_ptr<VulkanDevice> device;
+  VkCommandPool pool{ nullptr };
+};
+
 class VulkanCommandBuffers {
 public:
   NO_COPY_OR_ASSIGNMENT(VulkanCommandBuffers)
@@ -721,13 +917,17 @@ public:
 
   explicit VulkanCommandBuffers(std::shared_ptr<VulkanDevice> device, 
                                 size_t count = 1,
-                                VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY)
-    : device(std::move(device))
+                                VkCommandBufferLevel level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                std::shared_ptr<VulkanCommandPool> pool = nullptr)
+    : device(std::move(device)),
+      pool(std::move(pool))
   {
+    this->command_pool = this->pool ? this->pool->pool : this->device->default_pool;
+
     VkCommandBufferAllocateInfo allocate_info {
       VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, // sType 
       nullptr,                                        // pNext 
-      this->device->default_pool,                     // commandPool 
+      this->command_pool,                             // commandPool 
       level,                                          // level 
       static_cast<uint32_t>(count),                   // commandBufferCount 
     };
@@ -738,7 +938,7 @@ public:
 
   ~VulkanCommandBuffers()
   {
-    vkFreeCommandBuffers(this->device->device, this->device->default_pool, static_cast<uint32_t>(this->buffers.size()), this->buffers.data());
+    vkFreeCommandBuffers(this->device->device, this->command_pool, static_cast<uint32_t>(this->buffers.size()), this->buffers.data());
   }
 
   void submit(VkQueue queue, 
@@ -767,12 +967,15 @@ public:
                      const std::vector<VkSemaphore> & signal_semaphores,
                      VkFence fence)
   {
+    // one wait stage per wait semaphore
+    std::vector<VkPipelineStageFlags> wait_stages(std::max<size_t>(wait_semaphores.size(), 1), flags);
+
     VkSubmitInfo submit_info{
       VK_STRUCTURE_TYPE_SUBMIT_INFO,                   // sType 
       nullptr,                                         // pNext  
       static_cast<uint32_t>(wait_semaphores.size()),   // waitSemaphoreCount  
       wait_semaphores.data(),                          // pWaitSemaphores  
-      &flags,                                          // pWaitDstStageMask  
+      wait_stages.data(),                              // pWaitDstStageMask  
       static_cast<uint32_t>(buffers.size()),           // commandBufferCount  
       buffers.data(),                                  // pCommandBuffers 
       static_cast<uint32_t>(signal_semaphores.size()), // signalSemaphoreCount
@@ -788,6 +991,8 @@ public:
   }
 
   std::shared_ptr<VulkanDevice> device;
+  std::shared_ptr<VulkanCommandPool> pool;
+  VkCommandPool command_pool{ nullptr };
   std::vector<VkCommandBuffer> buffers;
 };
 
@@ -1110,15 +1315,19 @@ public:
   NO_COPY_OR_ASSIGNMENT(VulkanPipelineCache)
   VulkanPipelineCache() = delete;
 
-  explicit VulkanPipelineCache(std::shared_ptr<VulkanDevice> device)
+  explicit VulkanPipelineCache(std::shared_ptr<VulkanDevice> device, 
+                               const std::vector<char> & initial_data = std::vector<char>())
     : device(std::move(device))
   {
+    // data from another driver or device is ignored rather than handed to the driver
+    const bool compatible = isCompatible(this->device->physical_device, initial_data);
+
     VkPipelineCacheCreateInfo create_info {
       VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO, // sType
       nullptr,                                      // pNext
       0,                                            // flags (reserved for future use)
-      0,                                            // initialDataSize
-      nullptr,                                      // pInitialData
+      compatible ? initial_data.size() : 0,         // initialDataSize
+      compatible ? initial_data.data() : nullptr,   // pInitialData
     };
 
     THROW_ON_ERROR(vkCreatePipelineCache(this->device->device, &create_info, nullptr, &this->cache));
@@ -1129,6 +1338,39 @@ public:
     vkDestroyPipelineCache(this->device->device, this->cache, nullptr);
   }
 
+  std::vector<char> getData() const
+  {
+    size_t size;
+    THROW_ON_ERROR(vkGetPipelineCacheData(this->device->device, this->cache, &size, nullptr));
+    std::vector<char> data(size);
+    THROW_ON_ERROR(vkGetPipelineCacheData(this->device->device, this->cache, &size, data.data()));
+    data.resize(size);
+    return data;
+  }
+
+  // checks the header written by vkGetPipelineCacheData against the device
+  static bool isCompatible(const VulkanPhysicalDevice & physical_device, const std::vector<char> & data)
+  {
+    const size_t header_size = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+    if (data.size() < header_size) {
+      return false;
+    }
+    uint32_t header[4];
+    std::memcpy(header, data.data(), sizeof(header));
+
+    const uint32_t header_length = header[0];
+    const uint32_t header_version = header[1];
+    const uint32_t vendor_id = header[2];
+    const uint32_t device_id = header[3];
+
+    return header_length >= header_size &&
+      header_length <= data.size() &&
+      header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+      vendor_id == physical_device.properties.vendorID &&
+      device_id == physical_device.properties.deviceID &&
+      std::memcmp(data.data() + sizeof(header), physical_device.properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+  }
+
   std::shared_ptr<VulkanDevice> device;
   VkPipelineCache cache{ nullptr };
 };
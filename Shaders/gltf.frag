@@ -0,0 +1,28 @@
+#version 450
+
+layout(std140, binding = 2) uniform Material {
+  vec4 BaseColorFactor;
+};
+
+#ifdef HAS_NORMALS
+layout(location = 0) in vec3 ViewNormal;
+#endif
+
+#ifdef HAS_TEXTURE
+layout(binding = 1) uniform sampler2D BaseColorTexture;
+layout(location = 1) in vec2 texCoord;
+#endif
+
+layout(location = 0) out vec4 FragColor;
+
+void main() {
+  vec4 color = BaseColorFactor;
+#ifdef HAS_TEXTURE
+  color *= texture(BaseColorTexture, texCoord);
+#endif
+#ifdef HAS_NORMALS
+  // a light at the eye, lighting both sides of double sided materials
+  color.rgb *= 0.2 + 0.8 * abs(normalize(ViewNormal).z);
+#endif
+  FragColor = color;
+}
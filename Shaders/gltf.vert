@@ -0,0 +1,33 @@
+#version 450
+
+layout(std140, binding = 0) uniform Transform {
+  mat4 ModelViewMatrix;
+  mat4 ProjectionMatrix;
+};
+
+layout(location = 0) in vec3 Position;
+
+#ifdef HAS_NORMALS
+layout(location = 1) in vec3 Normal;
+layout(location = 0) out vec3 ViewNormal;
+#endif
+
+#ifdef HAS_TEXTURE
+layout(location = 2) in vec2 TexCoord;
+layout(location = 1) out vec2 texCoord;
+#endif
+
+out gl_PerVertex {
+  vec4 gl_Position;
+};
+
+void main() 
+{
+#ifdef HAS_NORMALS
+  ViewNormal = mat3(ModelViewMatrix) * Normal;
+#endif
+#ifdef HAS_TEXTURE
+  texCoord = TexCoord;
+#endif
+  gl_Position = ProjectionMatrix * ModelViewMatrix * vec4(Position, 1.0);
+}
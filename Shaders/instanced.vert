@@ -0,0 +1,21 @@
+#version 450
+
+layout(std140, binding = 0) uniform Transform {
+  mat4 ModelViewMatrix;
+  mat4 ProjectionMatrix;
+};
+
+layout(location = 0) in vec3 Position;
+layout(location = 4) in mat4 InstanceMatrix;
+layout(location = 8) in vec4 InstanceColor;
+layout(location = 0) out vec4 color;
+
+out gl_PerVertex {
+  vec4 gl_Position;
+};
+
+void main() 
+{
+  color = InstanceColor;
+  gl_Position = ProjectionMatrix * ModelViewMatrix * InstanceMatrix * vec4(Position, 1.0);
+}
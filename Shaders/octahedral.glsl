@@ -0,0 +1,10 @@
+// Decodes a unit vector stored as a point on the unfolded octahedron, as
+// written by octahedral_encode in Innovator/Mesh.h.
+vec3 octahedral_decode(vec2 e)
+{
+  vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (v.z < 0.0) {
+    v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+  }
+  return normalize(v);
+}
@@ -11,10 +11,12 @@ layout(std140, binding = 1) uniform ShaderParams {
   vec3 LightPosition;
   float LightDensityFactor;
   vec3 LightIntensity;
-  int NumDensitySteps;
-  int NumLightSteps;
 };
 
+// quality presets are selected with a specializationconstants node
+layout(constant_id = 0) const int NumDensitySteps = 128;
+layout(constant_id = 1) const int NumLightSteps = 32;
+
 layout(set = 0, binding = 3) uniform sampler3D Density;
 
 layout(location = 0) in vec3 vertex;
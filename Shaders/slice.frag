@@ -9,6 +9,9 @@ layout(binding = 1) buffer Octree {
   OctreeNode nodes[];
 } octree;
 
+// number of octree levels, 2^OctreeDepth voxels along each axis
+layout(constant_id = 0) const int OctreeDepth = 8;
+
 layout(location = 0) in vec3 position;
 layout(location = 0) out vec4 FragColor;
 
@@ -34,15 +37,15 @@ float mip_level(in vec3 texcoord) {
 
 void main() {
 
-  int mip = int(mip_level(position * 256.0));
-  int lod = 7 - mip;
+  int mip = int(mip_level(position * float(1 << OctreeDepth)));
+  int lod = OctreeDepth - 1 - mip;
 
-  lod = clamp(lod, 0, 7);
+  lod = clamp(lod, 0, OctreeDepth - 1);
 
   uint node_index = 0;
   vec3 pos = position;
 
-  for (int i = 0; i < 9; i++) {
+  for (int i = 0; i < OctreeDepth; i++) {
     if (i >= lod) break;
     
     int child_index = 0;
@@ -57,5 +60,5 @@ void main() {
 
   int data = octree.nodes[node_index].data + 128;
   float factor = float(data) / 255.0;
-  FragColor = vec4(vec3(origins[lod] * factor), 1);
+  FragColor = vec4(vec3(origins[min(lod, 7)] * factor), 1);
 }
@@ -0,0 +1,170 @@
+// Converts STL files into mesh files, which load without any parsing:
+//
+//   meshconvert input.stl output.mesh [--levels n] [--ratio r]
+//               [--normals 0|8|16] [--float] [--interleave]
+//
+// The mesh is welded and optimized for the vertex cache, overdraw and
+// vertex fetch, and a chain of levels of detail is generated. The full
+// detail level is also split into meshlets for meshletculling. Positions
+// are quantized to 16 bits unless --float is given, generated normals are
+// stored octahedral in 8 or 16 bits, or left out with --normals 0. Vertex
+// streams are stored in separate sections unless --interleave is given.
+
+#include <Innovator/STL.h>
+#include <Innovator/Mesh.h>
+#include <Innovator/MeshFile.h>
+
+#include <vulkan/vulkan.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+template <typename T>
+std::vector<char> bytes(const std::vector<T> & values)
+{
+  const char * data = reinterpret_cast<const char *>(values.data());
+  return std::vector<char>(data, data + values.size() * sizeof(T));
+}
+
+int main(int argc, char *argv[])
+{
+  try {
+    if (argc < 3) {
+      std::cerr << "usage: meshconvert input.stl output.mesh [--levels n] [--ratio r] "
+                   "[--normals 0|8|16] [--float] [--interleave]" << std::endl;
+      return 1;
+    }
+    const std::string input = argv[1];
+    const std::string output = argv[2];
+
+    size_t level_count = 4;
+    float ratio = 0.5f;
+    uint32_t normal_bits = 16;
+    bool quantize = true;
+    bool interleave = false;
+
+    for (int i = 3; i < argc; i++) {
+      const std::string arg = argv[i];
+      const bool has_value = i + 1 < argc;
+      if (arg == "--levels" && has_value) {
+        level_count = std::stoul(argv[++i]);
+      }
+      else if (arg == "--ratio" && has_value) {
+        ratio = std::stof(argv[++i]);
+      }
+      else if (arg == "--normals" && has_value) {
+        normal_bits = static_cast<uint32_t>(std::stoul(argv[++i]));
+      }
+      else if (arg == "--float") {
+        quantize = false;
+      }
+      else if (arg == "--interleave") {
+        interleave = true;
+      }
+      else {
+        throw std::invalid_argument("unknown argument " + arg);
+      }
+    }
+    if (normal_bits != 0 && normal_bits != 8 && normal_bits != 16) {
+      throw std::invalid_argument("--normals takes 0, 8 or 16");
+    }
+
+    const std::vector<float> soup = stl_read_positions(input);
+    const MeshLevels chain = build_mesh_levels(index_positions(soup.data(), soup.size() / 3),
+                                               level_count, ratio, normal_bits != 0);
+
+    MeshFileContents contents;
+    MeshFileHeader & header = contents.header;
+    header.level_count = static_cast<uint32_t>(chain.levels.size());
+
+    Box3 bounds;
+    for (auto & position : chain.positions) {
+      bounds.extend(position);
+    }
+    for (int i = 0; i < 3; i++) {
+      header.bounds[i] = bounds.lower[i];
+      header.bounds[i + 3] = bounds.upper[i];
+      header.position_offset[i] = 0.0f;
+      header.position_scale[i] = 1.0f;
+    }
+
+    // the vertex streams, as bytes per vertex, with their formats
+    struct Stream {
+      std::vector<char> data;
+      uint32_t stride;
+      uint32_t location;
+      VkFormat format;
+    };
+    std::vector<Stream> streams;
+
+    if (quantize) {
+      const QuantizedVertices quantized = quantize_vertices(chain.positions, chain.normals, normal_bits ? normal_bits : 16);
+      for (int i = 0; i < 3; i++) {
+        header.position_offset[i] = quantized.offset[i];
+        header.position_scale[i] = quantized.scale[i];
+      }
+      streams.push_back({ bytes(quantized.positions), 8, 0, VK_FORMAT_R16G16B16A16_UNORM });
+      if (quantized.normal_bits) {
+        streams.push_back({ bytes(quantized.normals), quantized.normal_bits / 4, 1,
+                            quantized.normal_bits == 8 ? VK_FORMAT_R8G8_SNORM : VK_FORMAT_R16G16_SNORM });
+      }
+    }
+    else {
+      streams.push_back({ bytes(chain.positions), 12, 0, VK_FORMAT_R32G32B32_SFLOAT });
+      if (!chain.normals.empty()) {
+        streams.push_back({ bytes(chain.normals), 12, 1, VK_FORMAT_R32G32B32_SFLOAT });
+      }
+    }
+
+    if (interleave && streams.size() > 1) {
+      uint32_t stride = 0;
+      for (auto & stream : streams) {
+        stride += stream.stride;
+      }
+      std::vector<char> vertices(chain.positions.size() * stride);
+      uint32_t offset = 0;
+      for (auto & stream : streams) {
+        for (size_t v = 0; v < chain.positions.size(); v++) {
+          std::memcpy(vertices.data() + v * stride + offset, stream.data.data() + v * stream.stride, stream.stride);
+        }
+        contents.attributes.push_back({ stream.location, 0, static_cast<uint32_t>(stream.format), offset });
+        offset += stream.stride;
+      }
+      contents.add(MeshFileSectionType::Vertices, 0, stride, 0, std::move(vertices));
+    }
+    else {
+      for (auto & stream : streams) {
+        const uint32_t section = contents.add(MeshFileSectionType::Vertices, 0, stream.stride, 0, std::move(stream.data));
+        contents.attributes.push_back({ stream.location, section, static_cast<uint32_t>(stream.format), 0 });
+      }
+    }
+
+    const bool narrow = chain.positions.size() <= 0x10000;
+    for (uint32_t level = 0; level < chain.levels.size(); level++) {
+      const std::vector<uint32_t> & indices = chain.levels[level];
+      if (narrow) {
+        contents.add(MeshFileSectionType::Indices, VK_INDEX_TYPE_UINT16, sizeof(uint16_t), level,
+                     bytes(std::vector<uint16_t>(indices.begin(), indices.end())));
+      }
+      else {
+        contents.add(MeshFileSectionType::Indices, VK_INDEX_TYPE_UINT32, sizeof(uint32_t), level, bytes(indices));
+      }
+      std::cout << "level " << level << ": " << indices.size() / 3 << " triangles" << std::endl;
+    }
+
+    // the bounds are in the space of the positions before quantization
+    const std::vector<Meshlet> meshlets = build_meshlets(chain.positions, chain.levels[0]);
+    contents.add(MeshFileSectionType::Meshlets, 0, sizeof(Meshlet), 0, bytes(meshlets));
+    std::cout << meshlets.size() << " meshlets" << std::endl;
+
+    write_mesh_file(output, std::move(contents));
+  }
+  catch (std::exception & e) {
+    std::cerr << "meshconvert: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
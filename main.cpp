@@ -4,6 +4,9 @@
 #include <Innovator/File.h>
 #include <Innovator/Nodes.h>
 #include <Innovator/Factory.h>
+#ifdef BASISU
+#include <Innovator/Ktx2.h>
+#endif
 
 #include <iostream>
 #include <vector>
@@ -18,6 +21,9 @@ int main(int argc, char *argv[])
 {
   try {
     VulkanImageFactory::Register<GliTextureImage>();
+#ifdef BASISU
+    VulkanImageFactory::Register<Ktx2TextureImage>(".ktx2");
+#endif
 
     std::vector<const char *> instance_layers{
 #ifdef DEBUG
@@ -66,6 +72,24 @@ int main(int argc, char *argv[])
     VkPhysicalDeviceFeatures device_features;
     ::memset(&device_features, VK_FALSE, sizeof(VkPhysicalDeviceFeatures));
 
+    // optional, indirect draws fall back to one draw per command or to
+    // issuing every command without them
+    const VulkanPhysicalDevice physical_device = vulkan->selectPhysicalDevice(device_features);
+    device_features.multiDrawIndirect = physical_device.features.multiDrawIndirect;
+    device_features.drawIndirectFirstInstance = physical_device.features.drawIndirectFirstInstance;
+    if (physical_device.supportsExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME)) {
+      device_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+
+    // transcoded textures pick the best format the device can filter
+    VulkanImageFactory::supports_format = [device = physical_device.device](VkFormat format) {
+      VkFormatProperties properties;
+      vkGetPhysicalDeviceFormatProperties(device, format, &properties);
+      const VkFormatFeatureFlags required =
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+      return (properties.optimalTilingFeatures & required) == required;
+    };
+
     auto device = std::make_shared<VulkanDevice>(vulkan,
                                                  device_features,
                                                  device_layers,
@@ -76,7 +100,7 @@ int main(int argc, char *argv[])
                                                                     VK_IMAGE_ASPECT_COLOR_BIT);
 
     auto depth_attachment = std::make_shared<FramebufferAttachment>(VK_FORMAT_D32_SFLOAT,
-                                                                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                                                                    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                                                                     VK_IMAGE_ASPECT_DEPTH_BIT);
 
     std::vector<VkAttachmentDescription> attachment_descriptions{ {
@@ -164,6 +188,8 @@ int main(int argc, char *argv[])
     auto rendermanager = std::make_shared<RenderManager>(vulkan, device, extent);
 
     rendermanager->init(scene.get());
+    // draws are skipped until their pipeline is compiled, wait for all of them
+    rendermanager->registry->wait();
     rendermanager->redraw(scene.get());
 
     return 0;